@@ -0,0 +1,456 @@
+// Headless throughput benchmark for FileWorker. Runs readFile/saveFile over
+// a matrix of file sizes, chunk sizes, I/O modes and cold or warm page cache
+// and prints one row per run as CSV or JSON:
+//
+//   bench_fileworker --sizes 64M,1G --chunks 64K,1M,auto --cache cold,warm
+//                    --modes buffered,parallel,mapped,uring,uncached --format json
+//
+// Cold runs drop the test file from the page cache (fdatasync +
+// POSIX_FADV_DONTNEED) first, warm runs read it once beforehand. The cache
+// state only applies to reads; saves always write a new file from memory.
+// On tmpfs nothing can be dropped, pass a --dir on a disk for cold rows.
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QRandomGenerator>
+#include <QTextStream>
+#include "fileworker.h"
+#include "parallelreader.h"
+#include "spillfile.h"
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+struct Usage
+{
+    double userSeconds = 0.0;
+    double systemSeconds = 0.0;
+    qint64 readSyscalls = -1;       // -1 when /proc/self/io is not available
+    qint64 writeSyscalls = -1;
+};
+
+struct Result
+{
+    QString operation;
+    QString mode;
+    qint64 fileSize = 0;
+    qint64 chunkSize = 0;           // 0 = chosen by ChunkTuner
+    int threads = 1;                // read threads that actually ran
+    QString cache;
+    int run = 0;
+    QString error;
+    bool fallback = false;          // io_uring was asked for, the QFile path ran
+    double seconds = 0.0;
+    Usage usage;
+    qint64 peakRssKb = -1;
+    TransferMetrics::Snapshot metrics;
+};
+
+QList<qint64> parseSizes(const QString &list, bool allowAuto, bool *ok)
+{
+    QList<qint64> sizes;
+    *ok = true;
+    for (const QString &item : list.split(',', Qt::SkipEmptyParts)) {
+        if (allowAuto && item.trimmed() == "auto") {
+            sizes.append(0);
+            continue;
+        }
+        bool itemOk = false;
+        qint64 size = TransferOptions::parseSize(item, &itemOk);
+        if (!itemOk) {
+            *ok = false;
+            return sizes;
+        }
+        sizes.append(size);
+    }
+    return sizes;
+}
+
+Usage currentUsage()
+{
+    Usage usage;
+#ifdef Q_OS_UNIX
+    struct rusage resources;
+    if (::getrusage(RUSAGE_SELF, &resources) == 0) {
+        usage.userSeconds = resources.ru_utime.tv_sec + resources.ru_utime.tv_usec / 1e6;
+        usage.systemSeconds = resources.ru_stime.tv_sec + resources.ru_stime.tv_usec / 1e6;
+    }
+#endif
+
+    QFile io("/proc/self/io");
+    if (io.open(QIODevice::ReadOnly)) {
+        for (const QByteArray &line : io.readAll().split('\n')) {
+            if (line.startsWith("syscr:"))
+                usage.readSyscalls = line.mid(6).trimmed().toLongLong();
+            else if (line.startsWith("syscw:"))
+                usage.writeSyscalls = line.mid(6).trimmed().toLongLong();
+        }
+    }
+    return usage;
+}
+
+// Peak RSS since the last resetPeakRss(), in KB
+qint64 peakRssKb()
+{
+    QFile status("/proc/self/status");
+    if (status.open(QIODevice::ReadOnly)) {
+        for (const QByteArray &line : status.readAll().split('\n')) {
+            if (line.startsWith("VmHWM:"))
+                return line.mid(6).trimmed().split(' ').first().toLongLong();
+        }
+    }
+
+#ifdef Q_OS_UNIX
+    // Without procfs only the peak of the whole process is known
+    struct rusage resources;
+    if (::getrusage(RUSAGE_SELF, &resources) == 0)
+        return resources.ru_maxrss;
+#endif
+    return -1;
+}
+
+void resetPeakRss()
+{
+    // Linux resets VmHWM to the current RSS when "5" is written here
+    QFile clearRefs("/proc/self/clear_refs");
+    if (clearRefs.open(QIODevice::WriteOnly))
+        clearRefs.write("5");
+}
+
+bool dropFromCache(const QString &filePath)
+{
+#ifdef Q_OS_LINUX
+    int fd = ::open(QFile::encodeName(filePath).constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    // Only clean pages can be dropped
+    ::fdatasync(fd);
+    bool dropped = ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    ::close(fd);
+    return dropped;
+#else
+    Q_UNUSED(filePath);
+    return false;
+#endif
+}
+
+void warmCache(const QString &filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+    QByteArray buffer(4 * 1024 * 1024, Qt::Uninitialized);
+    while (file.read(buffer.data(), buffer.size()) > 0) {
+    }
+}
+
+bool createTestFile(const QString &filePath, qint64 size)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    // Random contents, so no layer below can cheat by compressing or deduplicating
+    QByteArray block(4 * 1024 * 1024, Qt::Uninitialized);
+    QRandomGenerator *random = QRandomGenerator::global();
+    for (qint64 written = 0; written < size; written += block.size()) {
+        random->fillRange(reinterpret_cast<quint32 *>(block.data()), block.size() / 4);
+        qint64 length = qMin<qint64>(block.size(), size - written);
+        if (file.write(block.constData(), length) != length)
+            return false;
+    }
+    return file.flush();
+}
+
+TransferOptions optionsFor(const QString &mode, qint64 chunkSize, int parallelThreads = 0)
+{
+    TransferOptions options;
+    options.verifyAfterSave = false; // measure the save, not the read back
+    options.resumable = false;       // nor the journal's syncs
+    options.checksums = false;       // nor the hashing
+    options.analyzeContent = false;  // nor the byte statistics
+    options.memoryBudget = -1;       // and never a spill file
+    options.chunkSize = chunkSize;
+    options.adaptiveChunkSize = chunkSize == 0;
+    options.readThreads = 1;
+    if (mode == "mapped") {
+        options.readMode = TransferOptions::ReadMode::Mapped;
+    } else if (mode == "uring") {
+        options.ioBackend = TransferOptions::IoBackend::IoUring;
+    } else if (mode == "uncached") {
+        options.bypassCache = true;
+    } else if (mode == "parallel") {
+        options.readThreads = parallelThreads;
+    }
+    return options;
+}
+
+// Runs one FileWorker operation on this thread and fills in the measurements
+template <typename Operation>
+void measure(Result &result, Operation operation)
+{
+    QSharedPointer<OperationControl> control = QSharedPointer<OperationControl>::create();
+
+    resetPeakRss();
+    Usage before = currentUsage();
+    QElapsedTimer timer;
+    timer.start();
+
+    operation(control);
+
+    result.seconds = timer.nsecsElapsed() / 1e9;
+    Usage after = currentUsage();
+    result.peakRssKb = peakRssKb();
+    result.usage.userSeconds = after.userSeconds - before.userSeconds;
+    result.usage.systemSeconds = after.systemSeconds - before.systemSeconds;
+    if (before.readSyscalls >= 0 && after.readSyscalls >= 0) {
+        result.usage.readSyscalls = after.readSyscalls - before.readSyscalls;
+        result.usage.writeSyscalls = after.writeSyscalls - before.writeSyscalls;
+    }
+    result.metrics = control->sampleMetrics();
+}
+
+double megabytesPerSecond(const Result &result)
+{
+    return result.seconds > 0.0 ? result.fileSize / (1024.0 * 1024.0) / result.seconds : 0.0;
+}
+
+QString csvHeader()
+{
+    return "operation,mode,file_size,chunk_size,threads,cache,run,seconds,mb_per_s,cpu_user_s,cpu_system_s,"
+           "read_syscalls,write_syscalls,peak_rss_kb,p50_latency_ns,p99_latency_ns,max_latency_ns,fallback,error";
+}
+
+QString csvRow(const Result &result)
+{
+    QString error = result.error;
+    error.replace('"', "\"\"");
+    return QString("%1,%2,%3,%4,%5,%6,%7,%8,%9,%10,%11,%12,%13,%14,%15,%16,%17,%18,\"%19\"")
+        .arg(result.operation, result.mode)
+        .arg(result.fileSize)
+        .arg(result.chunkSize)
+        .arg(result.threads)
+        .arg(result.cache)
+        .arg(result.run)
+        .arg(result.seconds, 0, 'f', 6)
+        .arg(megabytesPerSecond(result), 0, 'f', 2)
+        .arg(result.usage.userSeconds, 0, 'f', 6)
+        .arg(result.usage.systemSeconds, 0, 'f', 6)
+        .arg(result.usage.readSyscalls)
+        .arg(result.usage.writeSyscalls)
+        .arg(result.peakRssKb)
+        .arg(result.metrics.p50Ns)
+        .arg(result.metrics.p99Ns)
+        .arg(result.metrics.maxNs)
+        .arg(result.fallback ? 1 : 0)
+        .arg(error);
+}
+
+QJsonObject jsonRow(const Result &result)
+{
+    QJsonObject row;
+    row["operation"] = result.operation;
+    row["mode"] = result.mode;
+    row["file_size"] = result.fileSize;
+    row["chunk_size"] = result.chunkSize;
+    row["threads"] = result.threads;
+    row["cache"] = result.cache;
+    row["run"] = result.run;
+    row["seconds"] = result.seconds;
+    row["mb_per_s"] = megabytesPerSecond(result);
+    row["cpu_user_s"] = result.usage.userSeconds;
+    row["cpu_system_s"] = result.usage.systemSeconds;
+    row["read_syscalls"] = result.usage.readSyscalls;
+    row["write_syscalls"] = result.usage.writeSyscalls;
+    row["peak_rss_kb"] = result.peakRssKb;
+    row["p50_latency_ns"] = result.metrics.p50Ns;
+    row["p99_latency_ns"] = result.metrics.p99Ns;
+    row["max_latency_ns"] = result.metrics.maxNs;
+    row["fallback"] = result.fallback;
+    if (!result.error.isEmpty())
+        row["error"] = result.error;
+    return row;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    // ChunkTuner keeps its own per-device profiles, apart from the GUI's
+    app.setApplicationName("bench_fileworker");
+    app.setApplicationVersion("1.0");
+    app.setOrganizationName("Alex Petrov Company");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("FileWorker I/O throughput benchmark");
+    parser.addHelpOption();
+    QCommandLineOption dirOption("dir", "Directory for the test files.", "path", QDir::tempPath());
+    QCommandLineOption sizesOption("sizes", "File sizes.", "list", "64M,256M");
+    QCommandLineOption chunksOption("chunks", "QFile request sizes, auto = ChunkTuner.", "list", "64K,1M,4M,16M");
+    QCommandLineOption modesOption("modes", "buffered, parallel, mapped, uring, uncached.", "list",
+                                   "buffered,parallel,mapped,uring,uncached");
+    QCommandLineOption threadsOption("threads", "Read threads of the parallel mode, 0 = by device type.",
+                                     "count", "0");
+    QCommandLineOption cacheOption("cache", "Page cache state for reads: cold, warm.", "list", "cold,warm");
+    QCommandLineOption operationsOption("operations", "read, save.", "list", "read,save");
+    QCommandLineOption repeatOption("repeat", "Runs per combination.", "count", "3");
+    QCommandLineOption formatOption("format", "csv or json.", "format", "csv");
+    parser.addOptions({dirOption, sizesOption, chunksOption, modesOption, threadsOption, cacheOption,
+                       operationsOption, repeatOption, formatOption});
+    parser.process(app);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+
+    bool sizesOk = false;
+    bool chunksOk = false;
+    QList<qint64> sizes = parseSizes(parser.value(sizesOption), false, &sizesOk);
+    QList<qint64> chunkSizes = parseSizes(parser.value(chunksOption), true, &chunksOk);
+    QStringList modes = parser.value(modesOption).split(',', Qt::SkipEmptyParts);
+    QStringList cacheStates = parser.value(cacheOption).split(',', Qt::SkipEmptyParts);
+    QStringList operations = parser.value(operationsOption).split(',', Qt::SkipEmptyParts);
+    int repeat = qMax(1, parser.value(repeatOption).toInt());
+    bool json = parser.value(formatOption) == "json";
+    if (!sizesOk || !chunksOk || sizes.isEmpty() || chunkSizes.isEmpty()) {
+        err << "Invalid --sizes or --chunks" << Qt::endl;
+        return 2;
+    }
+    bool threadsOk = false;
+    int requestedThreads = parser.value(threadsOption).toInt(&threadsOk);
+    if (!threadsOk || requestedThreads < 0) {
+        err << "Invalid --threads" << Qt::endl;
+        return 2;
+    }
+
+    QDir dir(parser.value(dirOption));
+    QString sourcePath = dir.filePath("bench_fileworker.src");
+    QString destinationPath = dir.filePath("bench_fileworker.dst");
+
+    // The temp directory is tmpfs on most systems: fadvise succeeds there
+    // but the file stays in memory, cold rows would be warm
+    bool inMemory = SpillFile::isInMemory(dir.path());
+    if (inMemory && cacheStates.contains("cold") && operations.contains("read"))
+        err << QDir::toNativeSeparators(dir.path()) << " is in memory, cold reads are reported as cold-unsupported,"
+            << " pass a --dir on a disk" << Qt::endl;
+
+    FileWorker worker;
+    ChunkBuffer loaded;
+    QString lastError;
+    QObject::connect(&worker, &FileWorker::readFinished, [&loaded](const ChunkBuffer &data) { loaded = data; });
+    QObject::connect(&worker, &FileWorker::readError, [&lastError](const QString &error) { lastError = error; });
+    QObject::connect(&worker, &FileWorker::saveError, [&lastError](const QString &error) { lastError = error; });
+
+    // A uring row that ran the QFile path is marked, it measures the wrong backend
+    bool fellBack = false;
+    QObject::connect(&worker, &FileWorker::operationReport, [&fellBack](const QString &report) {
+        if (report.startsWith("io_uring not used"))
+            fellBack = true;
+    });
+
+    QJsonArray rows;
+    if (!json)
+        out << csvHeader() << Qt::endl;
+
+    auto emitRow = [&](const Result &result) {
+        if (json)
+            rows.append(jsonRow(result));
+        else
+            out << csvRow(result) << Qt::endl;
+    };
+
+    for (qint64 size : sizes) {
+        if (!createTestFile(sourcePath, size)) {
+            err << "Cannot create " << sourcePath << Qt::endl;
+            return 1;
+        }
+
+        // FileWorker reads small files, and files on devices it does not
+        // know to serve requests in parallel, with one thread. The rows say
+        // how many ran, --threads forces more.
+        int parallelThreads = requestedThreads > 0 ? requestedThreads : ParallelReader::threadCountFor(sourcePath);
+        bool parallelRuns = size >= ParallelReader::MinFileSize && ParallelReader::isSupported() && parallelThreads > 1;
+        if (modes.contains("parallel") && !parallelRuns)
+            err << "parallel: " << size << " bytes are read by one thread here, pass --threads or a larger size"
+                << Qt::endl;
+
+        for (const QString &mode : modes) {
+            for (qint64 chunkSize : chunkSizes) {
+                // The mapping and the parallel ranges have no request size
+                if ((mode == "mapped" || mode == "parallel") && chunkSize != chunkSizes.first())
+                    continue;
+                TransferOptions options = optionsFor(mode, chunkSize, parallelThreads);
+
+                for (const QString &operation : operations) {
+                    // Mapped and parallel are read modes, saves have no cache state
+                    if (operation == "save" && (mode == "mapped" || mode == "parallel"))
+                        continue;
+                    QStringList states = operation == "read" ? cacheStates : QStringList("n/a");
+
+                    for (const QString &cache : states) {
+                        for (int run = 1; run <= repeat; ++run) {
+                            Result result;
+                            result.operation = operation;
+                            result.mode = mode;
+                            result.fileSize = size;
+                            result.chunkSize = mode == "mapped" || mode == "parallel" ? 0 : chunkSize;
+                            result.threads = mode == "parallel" && parallelRuns ? parallelThreads : 1;
+                            result.cache = cache;
+                            result.run = run;
+                            lastError.clear();
+                            fellBack = false;
+
+                            if (operation == "read") {
+                                if (cache == "cold" && (inMemory || !dropFromCache(sourcePath)))
+                                    result.cache = "cold-unsupported";
+                                else if (cache == "warm")
+                                    warmCache(sourcePath);
+
+                                measure(result, [&](const QSharedPointer<OperationControl> &control) {
+                                    worker.readFile(sourcePath, options, control);
+                                });
+                                loaded.clear();
+                            } else {
+                                // Read once into memory, outside the measurement. Forgetting
+                                // the source keeps saveFile off the kernel copy path.
+                                worker.readFile(sourcePath, optionsFor("buffered", 0));
+                                ChunkBuffer data = loaded;
+                                loaded.clear();
+                                data.setSource(QString(), QDateTime());
+                                QFile::remove(destinationPath);
+
+                                measure(result, [&](const QSharedPointer<OperationControl> &control) {
+                                    worker.saveFile(destinationPath, data, options, control);
+                                });
+                            }
+
+                            result.error = lastError;
+                            result.fallback = fellBack;
+                            emitRow(result);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    QFile::remove(sourcePath);
+    QFile::remove(destinationPath);
+
+    if (json)
+        out << QJsonDocument(rows).toJson() << Qt::flush;
+
+    return 0;
+}
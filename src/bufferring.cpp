@@ -0,0 +1,96 @@
+#include "bufferring.h"
+#include <QMutexLocker>
+
+BufferRing::BufferRing(int count, qint64 bufferSize)
+    : m_slots(count)
+    , m_bufferSize(bufferSize)
+    , m_head(0)
+    , m_tail(0)
+    , m_filled(0)
+    , m_finished(false)
+    , m_aborted(false)
+    , m_producerWaits(0)
+    , m_consumerWaits(0)
+{
+    for (Slot &slot : m_slots)
+        slot.data = QByteArray(bufferSize, Qt::Uninitialized);
+}
+
+char *BufferRing::acquireFree()
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_filled == m_slots.size() && !m_aborted)
+        ++m_producerWaits;
+    while (m_filled == m_slots.size() && !m_aborted)
+        m_notFull.wait(&m_mutex);
+
+    if (m_aborted)
+        return nullptr;
+    return m_slots[m_head].data.data();
+}
+
+void BufferRing::commitFilled(qint64 size)
+{
+    QMutexLocker locker(&m_mutex);
+    m_slots[m_head].size = size;
+    m_head = (m_head + 1) % m_slots.size();
+    ++m_filled;
+    m_notEmpty.wakeOne();
+}
+
+void BufferRing::finish()
+{
+    QMutexLocker locker(&m_mutex);
+    m_finished = true;
+    m_notEmpty.wakeAll();
+}
+
+const char *BufferRing::acquireFilled(qint64 *size)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_filled == 0 && !m_finished && !m_aborted)
+        ++m_consumerWaits;
+    while (m_filled == 0 && !m_finished && !m_aborted)
+        m_notEmpty.wait(&m_mutex);
+
+    if (m_aborted || m_filled == 0)
+        return nullptr;
+
+    const Slot &slot = m_slots.at(m_tail);
+    *size = slot.size;
+    return slot.data.constData();
+}
+
+void BufferRing::releaseFilled()
+{
+    QMutexLocker locker(&m_mutex);
+    m_tail = (m_tail + 1) % m_slots.size();
+    --m_filled;
+    m_notFull.wakeOne();
+}
+
+void BufferRing::abort()
+{
+    QMutexLocker locker(&m_mutex);
+    m_aborted = true;
+    m_notFull.wakeAll();
+    m_notEmpty.wakeAll();
+}
+
+bool BufferRing::isAborted() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_aborted;
+}
+
+quint64 BufferRing::producerWaits() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_producerWaits;
+}
+
+quint64 BufferRing::consumerWaits() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_consumerWaits;
+}
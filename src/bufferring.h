@@ -0,0 +1,57 @@
+#pragma once
+
+#include <QByteArray>
+#include <QMutex>
+#include <QVector>
+#include <QWaitCondition>
+
+// Fixed ring of reusable buffers connecting a producer (reader) and a
+// consumer (writer) running on different threads. The producer blocks when
+// all buffers are full and the consumer blocks when all are empty, so the
+// two stages overlap while memory stays at count * bufferSize.
+class BufferRing
+{
+public:
+    BufferRing(int count, qint64 bufferSize);
+
+    qint64 bufferSize() const { return m_bufferSize; }
+
+    // Producer side: next empty buffer to fill, nullptr once the ring is aborted
+    char *acquireFree();
+    void commitFilled(qint64 size);
+    void finish();   // no more buffers will be filled
+
+    // Consumer side: next filled buffer in order, nullptr at the end of the
+    // stream or once the ring is aborted
+    const char *acquireFilled(qint64 *size);
+    void releaseFilled();
+
+    // Wakes both sides up and makes every further acquire fail
+    void abort();
+    bool isAborted() const;
+
+    // How often each side had to wait for the other. The stage that waits
+    // less is the bottleneck of the copy.
+    quint64 producerWaits() const;
+    quint64 consumerWaits() const;
+
+private:
+    struct Slot
+    {
+        QByteArray data;
+        qint64 size = 0;
+    };
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_notFull;
+    QWaitCondition m_notEmpty;
+    QVector<Slot> m_slots;
+    qint64 m_bufferSize;
+    int m_head;       // next slot the producer fills
+    int m_tail;       // next slot the consumer drains
+    int m_filled;
+    bool m_finished;
+    bool m_aborted;
+    quint64 m_producerWaits;
+    quint64 m_consumerWaits;
+};
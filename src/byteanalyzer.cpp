@@ -0,0 +1,217 @@
+#include "byteanalyzer.h"
+#include <QStringList>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define CUBE_ANALYZER_AVX2
+#endif
+
+namespace {
+// The eight-byte loop spreads a run evenly over the tables, but the tail of
+// every range goes to the first one, so with many small ranges a single
+// counter may see every byte. Flushing before 2^32 bytes keeps it in range.
+const quint64 FlushBytes = 0xFFFFFFFFu;
+
+void countScalar(quint32 (*counts)[256], const uchar *data, size_t size)
+{
+    while (size >= 8) {
+        quint64 word;
+        memcpy(&word, data, 8);
+        ++counts[0][word & 0xFF];
+        ++counts[1][(word >> 8) & 0xFF];
+        ++counts[2][(word >> 16) & 0xFF];
+        ++counts[3][(word >> 24) & 0xFF];
+        ++counts[0][(word >> 32) & 0xFF];
+        ++counts[1][(word >> 40) & 0xFF];
+        ++counts[2][(word >> 48) & 0xFF];
+        ++counts[3][word >> 56];
+        data += 8;
+        size -= 8;
+    }
+    while (size-- > 0)
+        ++counts[0][*data++];
+}
+
+#ifdef CUBE_ANALYZER_AVX2
+// Returns the bytes of data that were whole 128-byte blocks of zeros
+__attribute__((target("avx2")))
+quint64 countAvx2(quint32 (*counts)[256], const uchar *data, size_t size)
+{
+    quint64 zeroBlockBytes = 0;
+    while (size >= 128) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + 32));
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + 64));
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + 96));
+        __m256i any = _mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(c, d));
+        if (_mm256_testz_si256(any, any))
+            zeroBlockBytes += 128;
+        else
+            countScalar(counts, data, 128);
+        data += 128;
+        size -= 128;
+    }
+    countScalar(counts, data, size);
+    return zeroBlockBytes;
+}
+#endif
+
+QString byteName(int byte)
+{
+    if (byte >= 0x21 && byte < 0x7F)
+        return QString("0x%1 '%2'").arg(byte, 2, 16, QChar('0')).arg(QChar(byte));
+    return QString("0x%1").arg(byte, 2, 16, QChar('0'));
+}
+}
+
+quint64 ByteStatistics::nonAsciiBytes() const
+{
+    quint64 bytes = 0;
+    for (int byte = 0x80; byte < 256; ++byte)
+        bytes += histogram[byte];
+    return bytes;
+}
+
+double ByteStatistics::entropy() const
+{
+    if (totalBytes == 0)
+        return 0.0;
+
+    double bits = 0.0;
+    for (quint64 count : histogram) {
+        if (count == 0)
+            continue;
+        double probability = static_cast<double>(count) / totalBytes;
+        bits -= probability * std::log2(probability);
+    }
+    return bits;
+}
+
+ByteStatistics::Kind ByteStatistics::kind() const
+{
+    if (totalBytes == 0)
+        return Kind::Empty;
+    if (entropy() > 7.5)
+        return Kind::Compressed;
+
+    // Text has no NULs and hardly any control characters besides
+    // tab, line feed, form feed and carriage return. UTF-8 passes as text.
+    quint64 control = histogram[0x7F];
+    for (int byte = 0; byte < 0x20; ++byte) {
+        if (byte != '\t' && byte != '\n' && byte != '\f' && byte != '\r')
+            control += histogram[byte];
+    }
+    return control * 100 <= totalBytes ? Kind::Text : Kind::Binary;
+}
+
+QString ByteStatistics::kindName(Kind kind)
+{
+    switch (kind) {
+    case Kind::Empty:
+        return "Empty";
+    case Kind::Text:
+        return "Text";
+    case Kind::Binary:
+        return "Binary";
+    case Kind::Compressed:
+        return "Compressed or encrypted";
+    }
+    return QString();
+}
+
+QString ByteStatistics::summary() const
+{
+    double total = qMax<quint64>(1, totalBytes);
+    return QString("%1, entropy %2 bits/byte, %3% zero, %4% non-ASCII")
+        .arg(kindName(kind()))
+        .arg(entropy(), 0, 'f', 2)
+        .arg(100.0 * zeroBytes() / total, 0, 'f', 2)
+        .arg(100.0 * nonAsciiBytes() / total, 0, 'f', 2);
+}
+
+QString ByteStatistics::toString() const
+{
+    double total = qMax<quint64>(1, totalBytes);
+
+    // The five most common byte values
+    std::array<int, 256> order;
+    for (int byte = 0; byte < 256; ++byte)
+        order[byte] = byte;
+    std::partial_sort(order.begin(), order.begin() + 5, order.end(),
+                      [this](int a, int b) { return histogram[a] > histogram[b]; });
+    QStringList common;
+    for (int rank = 0; rank < 5 && histogram[order[rank]] > 0; ++rank)
+        common << QString("%1 %2%").arg(byteName(order[rank])).arg(100.0 * histogram[order[rank]] / total, 0, 'f', 1);
+
+    QString text;
+    text += QString("Content: %1\n").arg(kindName(kind()));
+    text += QString("Entropy: %1 bits per byte\n").arg(entropy(), 0, 'f', 3);
+    text += QString("Zero bytes: %1%\n").arg(100.0 * zeroBytes() / total, 0, 'f', 2);
+    text += QString("Non-ASCII bytes: %1%\n").arg(100.0 * nonAsciiBytes() / total, 0, 'f', 2);
+    text += QString("Most common bytes: %1\n").arg(common.join(", "));
+    text += QString("Analyzed %1 bytes%2").arg(totalBytes).arg(zeroBlocksSkipped ? " (zero blocks skipped with AVX2)" : "");
+    return text;
+}
+
+ByteAnalyzer::ByteAnalyzer()
+    : m_pending(0)
+    , m_zeroBlockBytes(0)
+{
+    memset(m_counts, 0, sizeof(m_counts));
+    m_statistics.zeroBlocksSkipped = skipsZeroBlocks();
+}
+
+bool ByteAnalyzer::skipsZeroBlocks()
+{
+#ifdef CUBE_ANALYZER_AVX2
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+#else
+    return false;
+#endif
+}
+
+void ByteAnalyzer::update(const char *data, qint64 size)
+{
+    const uchar *bytes = reinterpret_cast<const uchar *>(data);
+    while (size > 0) {
+        size_t length = static_cast<size_t>(qMin<quint64>(size, FlushBytes - m_pending));
+#ifdef CUBE_ANALYZER_AVX2
+        if (m_statistics.zeroBlocksSkipped)
+            m_zeroBlockBytes += countAvx2(m_counts, bytes, length);
+        else
+            countScalar(m_counts, bytes, length);
+#else
+        countScalar(m_counts, bytes, length);
+#endif
+        m_statistics.totalBytes += length;
+        m_pending += length;
+        bytes += length;
+        size -= static_cast<qint64>(length);
+
+        if (m_pending == FlushBytes)
+            flush();
+    }
+}
+
+ByteStatistics ByteAnalyzer::result() const
+{
+    ByteAnalyzer copy(*this);
+    copy.flush();
+    return copy.m_statistics;
+}
+
+void ByteAnalyzer::flush()
+{
+    for (int byte = 0; byte < 256; ++byte) {
+        m_statistics.histogram[byte] += quint64(m_counts[0][byte]) + m_counts[1][byte] + m_counts[2][byte]
+                                        + m_counts[3][byte];
+    }
+    m_statistics.histogram[0] += m_zeroBlockBytes;
+    memset(m_counts, 0, sizeof(m_counts));
+    m_pending = 0;
+    m_zeroBlockBytes = 0;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <QMetaType>
+#include <QString>
+#include <array>
+
+// Byte statistics of a file's contents
+struct ByteStatistics
+{
+    enum class Kind
+    {
+        Empty,
+        Text,
+        Binary,
+        Compressed  // or encrypted, nearly random bytes
+    };
+
+    std::array<quint64, 256> histogram{};
+    quint64 totalBytes = 0;
+    // All-zero 128-byte blocks were recognised with AVX2 and not counted one
+    // byte at a time. Every other byte is always counted in scalar code.
+    bool zeroBlocksSkipped = false;
+
+    quint64 zeroBytes() const { return histogram[0]; }
+    quint64 nonAsciiBytes() const;      // 0x80 and above
+
+    // Shannon entropy in bits per byte, 0 to 8
+    double entropy() const;
+    Kind kind() const;
+    static QString kindName(Kind kind);
+
+    // "Text, entropy 4.71 bits/byte, 0.00% zero, 1.23% non-ASCII"
+    QString summary() const;
+
+    // Several lines for the File Information panel, most common bytes included
+    QString toString() const;
+};
+
+Q_DECLARE_METATYPE(ByteStatistics)
+
+// Builds ByteStatistics incrementally. Bytes are counted into four
+// interleaved tables so runs of one value do not serialise on a single
+// counter. With AVX2, 128-byte blocks of zeros, which dominate disk images
+// and preallocated files, are recognised with a few vector instructions
+// and never touch the tables.
+class ByteAnalyzer
+{
+public:
+    ByteAnalyzer();
+
+    void update(const char *data, qint64 size);
+    ByteStatistics result() const;
+
+    // Whether this CPU takes the AVX2 path for blocks of zeros
+    static bool skipsZeroBlocks();
+
+private:
+    void flush();
+
+    quint32 m_counts[4][256];   // folded into m_statistics before they can overflow
+    quint64 m_pending;          // bytes in m_counts
+    quint64 m_zeroBlockBytes;   // counted by the vector path
+    ByteStatistics m_statistics;
+};
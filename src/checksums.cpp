@@ -0,0 +1,239 @@
+#include "checksums.h"
+#include <QCryptographicHash>
+#include <QStringList>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <nmmintrin.h>
+#define CUBE_CRC32C_SSE42
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define CUBE_CRC32C_ARMV8
+#endif
+
+#include <cstring>
+
+#ifdef CUBE_HAVE_XXHASH
+#include <xxhash.h>
+#endif
+
+namespace {
+// Slicing-by-8 tables for the reflected Castagnoli polynomial
+struct Crc32cTables
+{
+    quint32 table[8][256];
+
+    Crc32cTables()
+    {
+        for (quint32 byte = 0; byte < 256; ++byte) {
+            quint32 crc = byte;
+            for (int bit = 0; bit < 8; ++bit)
+                crc = (crc >> 1) ^ (0x82F63B78u & (0u - (crc & 1u)));
+            table[0][byte] = crc;
+        }
+        for (quint32 byte = 0; byte < 256; ++byte) {
+            for (int slice = 1; slice < 8; ++slice)
+                table[slice][byte] = (table[slice - 1][byte] >> 8) ^ table[0][table[slice - 1][byte] & 0xFF];
+        }
+    }
+};
+
+quint32 crc32cSoftware(quint32 crc, const uchar *data, size_t size)
+{
+    static const Crc32cTables tables;
+    const auto &t = tables.table;
+
+    while (size >= 8) {
+        quint32 low;
+        quint32 high;
+        memcpy(&low, data, 4);
+        memcpy(&high, data + 4, 4);
+        low ^= crc; // little-endian, the only byte order this targets
+        crc = t[7][low & 0xFF] ^ t[6][(low >> 8) & 0xFF] ^ t[5][(low >> 16) & 0xFF] ^ t[4][low >> 24]
+              ^ t[3][high & 0xFF] ^ t[2][(high >> 8) & 0xFF] ^ t[1][(high >> 16) & 0xFF] ^ t[0][high >> 24];
+        data += 8;
+        size -= 8;
+    }
+    while (size-- > 0)
+        crc = (crc >> 8) ^ t[0][(crc ^ *data++) & 0xFF];
+    return crc;
+}
+
+#if defined(CUBE_CRC32C_SSE42)
+// One serial stream of the SSE4.2 crc32 instruction, about 8 bytes per 3
+// cycles. Three interleaved streams folded with PCLMULQDQ would be faster
+// still, but this already outruns the disk and it runs on the hash thread.
+__attribute__((target("sse4.2")))
+quint32 crc32cHardware(quint32 crc, const uchar *data, size_t size)
+{
+    quint64 crc64 = crc;
+    while (size >= 8) {
+        quint64 word;
+        memcpy(&word, data, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+        data += 8;
+        size -= 8;
+    }
+    crc = static_cast<quint32>(crc64);
+    while (size-- > 0)
+        crc = _mm_crc32_u8(crc, *data++);
+    return crc;
+}
+
+bool hasHardwareCrc()
+{
+    static const bool supported = __builtin_cpu_supports("sse4.2");
+    return supported;
+}
+#elif defined(CUBE_CRC32C_ARMV8)
+quint32 crc32cHardware(quint32 crc, const uchar *data, size_t size)
+{
+    while (size >= 8) {
+        quint64 word;
+        memcpy(&word, data, 8);
+        crc = __crc32cd(crc, word);
+        data += 8;
+        size -= 8;
+    }
+    while (size-- > 0)
+        crc = __crc32cb(crc, *data++);
+    return crc;
+}
+
+bool hasHardwareCrc()
+{
+    return true; // compiled for a CPU with the CRC extension
+}
+#else
+quint32 crc32cHardware(quint32 crc, const uchar *data, size_t size)
+{
+    return crc32cSoftware(crc, data, size);
+}
+
+bool hasHardwareCrc()
+{
+    return false;
+}
+#endif
+}
+
+void Crc32cHasher::update(const char *data, qint64 size)
+{
+    if (size <= 0)
+        return;
+
+    const uchar *bytes = reinterpret_cast<const uchar *>(data);
+    if (hasHardwareCrc())
+        m_state = crc32cHardware(m_state, bytes, static_cast<size_t>(size));
+    else
+        m_state = crc32cSoftware(m_state, bytes, static_cast<size_t>(size));
+}
+
+bool Crc32cHasher::isHardwareAccelerated()
+{
+    return hasHardwareCrc();
+}
+
+Checksums::Algorithms Checksums::available(bool sha256)
+{
+    Algorithms algorithms = Crc32c;
+#ifdef CUBE_HAVE_XXHASH
+    algorithms |= Xxh3;
+#endif
+    if (sha256)
+        algorithms |= Sha256;
+    return algorithms;
+}
+
+bool Checksums::matches(const Checksums &other) const
+{
+    Algorithms common = algorithms & other.algorithms;
+    if (common == Algorithms())
+        return false;
+
+    if (common.testFlag(Crc32c) && crc32c != other.crc32c)
+        return false;
+    if (common.testFlag(Xxh3) && xxh3 != other.xxh3)
+        return false;
+    if (common.testFlag(Sha256) && sha256 != other.sha256)
+        return false;
+    return true;
+}
+
+QString Checksums::toString() const
+{
+    QStringList parts;
+    if (algorithms.testFlag(Crc32c))
+        parts << QString("CRC32C %1").arg(crc32c, 8, 16, QChar('0'));
+    if (algorithms.testFlag(Xxh3))
+        parts << QString("XXH3 %1").arg(xxh3, 16, 16, QChar('0'));
+    if (algorithms.testFlag(Sha256))
+        parts << QString("SHA-256 %1").arg(QString::fromLatin1(sha256.toHex()));
+    return parts.join(", ");
+}
+
+struct ChecksumCalculator::Private
+{
+    explicit Private(Checksums::Algorithms algorithms)
+        : algorithms(algorithms)
+        , sha256(QCryptographicHash::Sha256)
+    {
+#ifdef CUBE_HAVE_XXHASH
+        xxh3 = XXH3_createState();
+        XXH3_64bits_reset(xxh3);
+#else
+        this->algorithms.setFlag(Checksums::Xxh3, false);
+#endif
+    }
+
+    ~Private()
+    {
+#ifdef CUBE_HAVE_XXHASH
+        XXH3_freeState(xxh3);
+#endif
+    }
+
+    Checksums::Algorithms algorithms;
+    Crc32cHasher crc32c;
+    QCryptographicHash sha256;
+#ifdef CUBE_HAVE_XXHASH
+    XXH3_state_t *xxh3;
+#endif
+};
+
+ChecksumCalculator::ChecksumCalculator(Checksums::Algorithms algorithms)
+    : d(new Private(algorithms))
+{
+}
+
+ChecksumCalculator::~ChecksumCalculator()
+{
+    delete d;
+}
+
+void ChecksumCalculator::update(const char *data, qint64 size)
+{
+    if (size <= 0)
+        return;
+
+    if (d->algorithms.testFlag(Checksums::Crc32c))
+        d->crc32c.update(data, size);
+#ifdef CUBE_HAVE_XXHASH
+    if (d->algorithms.testFlag(Checksums::Xxh3))
+        XXH3_64bits_update(d->xxh3, data, static_cast<size_t>(size));
+#endif
+    if (d->algorithms.testFlag(Checksums::Sha256))
+        d->sha256.addData(QByteArrayView(data, size));
+}
+
+Checksums ChecksumCalculator::result() const
+{
+    Checksums checksums;
+    checksums.algorithms = d->algorithms;
+    checksums.crc32c = d->crc32c.value();
+#ifdef CUBE_HAVE_XXHASH
+    checksums.xxh3 = XXH3_64bits_digest(d->xxh3);
+#endif
+    if (d->algorithms.testFlag(Checksums::Sha256))
+        checksums.sha256 = d->sha256.result();
+    return checksums;
+}
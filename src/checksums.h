@@ -0,0 +1,71 @@
+#pragma once
+
+#include <QByteArray>
+#include <QFlags>
+#include <QMetaType>
+#include <QString>
+
+// Digests of one transfer. CRC32C is always computed (hardware instruction
+// where the CPU has one), xxHash3 when the build found libxxhash, SHA-256
+// on request since it is an order of magnitude slower.
+struct Checksums
+{
+    enum Algorithm
+    {
+        Crc32c = 0x1,
+        Xxh3 = 0x2,
+        Sha256 = 0x4
+    };
+    Q_DECLARE_FLAGS(Algorithms, Algorithm)
+
+    Algorithms algorithms;
+    quint32 crc32c = 0;
+    quint64 xxh3 = 0;
+    QByteArray sha256;
+
+    bool isEmpty() const { return algorithms == Algorithms(); }
+
+    // CRC32C plus xxHash3 when this build has it, SHA-256 on request
+    static Algorithms available(bool sha256);
+
+    // True when every digest both sides have agrees and there is at least one
+    bool matches(const Checksums &other) const;
+
+    // e.g. "CRC32C 1a2b3c4d, XXH3 0011223344556677"
+    QString toString() const;
+};
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(Checksums::Algorithms)
+Q_DECLARE_METATYPE(Checksums)
+
+// Incremental CRC32C (Castagnoli). Uses the SSE4.2 / ARMv8 CRC32
+// instructions when the CPU supports them, slicing-by-8 tables otherwise.
+class Crc32cHasher
+{
+public:
+    void update(const char *data, qint64 size);
+    quint32 value() const { return ~m_state; }
+
+    static bool isHardwareAccelerated();
+
+private:
+    quint32 m_state = 0xFFFFFFFFu;
+};
+
+// Feeds the same bytes to every selected algorithm
+class ChecksumCalculator
+{
+public:
+    explicit ChecksumCalculator(Checksums::Algorithms algorithms);
+    ~ChecksumCalculator();
+
+    ChecksumCalculator(const ChecksumCalculator &) = delete;
+    ChecksumCalculator &operator=(const ChecksumCalculator &) = delete;
+
+    void update(const char *data, qint64 size);
+    Checksums result() const;
+
+private:
+    struct Private;
+    Private *d;
+};
@@ -0,0 +1,226 @@
+#include "chunkbuffer.h"
+#include "spillfile.h"
+#include <QFile>
+#include <QFileInfo>
+#include <cstring>
+
+// One chunk of zeros behind every hole of every buffer
+static const QByteArray &sharedZeros()
+{
+    static const QByteArray zeros(ChunkBuffer::DefaultChunkSize, '\0');
+    return zeros;
+}
+
+ChunkBuffer::ChunkBuffer(qint64 chunkSize)
+    : m_chunkSize(chunkSize)
+    , m_size(0)
+    , m_sparse(false)
+{
+}
+
+ChunkBuffer ChunkBuffer::fromMapping(const QSharedPointer<QFile> &mapping, const uchar *data,
+                                     qint64 size, qint64 chunkSize)
+{
+    ChunkBuffer buffer(chunkSize);
+    buffer.m_mapping = mapping;
+    buffer.reserve(size);
+
+    const char *bytes = reinterpret_cast<const char *>(data);
+    for (qint64 offset = 0; offset < size; offset += chunkSize) {
+        qint64 length = qMin(chunkSize, size - offset);
+        buffer.m_chunks.append(QByteArray::fromRawData(bytes + offset, length));
+    }
+    buffer.m_size = size;
+
+    return buffer;
+}
+
+ChunkBuffer ChunkBuffer::spilled(qint64 totalSize, const QString &directory, QString *error, qint64 chunkSize)
+{
+    ChunkBuffer buffer(chunkSize);
+    buffer.m_spill = SpillFile::create(totalSize, directory, error);
+    buffer.reserve(totalSize);
+    return buffer;
+}
+
+QByteArray ChunkBuffer::read(qint64 offset, qint64 length) const
+{
+    if (offset < 0 || offset >= m_size || length <= 0)
+        return QByteArray();
+
+    length = qMin(length, m_size - offset);
+    QByteArray result(length, Qt::Uninitialized);
+
+    qint64 copied = 0;
+    while (copied < length) {
+        int index = chunkIndex(offset + copied);
+        qint64 inChunk = offset + copied - chunkOffset(index);
+        const QByteArray &source = m_chunks.at(index);
+        qint64 count = qMin(length - copied, source.size() - inChunk);
+        memcpy(result.data() + copied, source.constData() + inChunk, static_cast<size_t>(count));
+        copied += count;
+    }
+
+    return result;
+}
+
+void ChunkBuffer::reserve(qint64 totalSize)
+{
+    m_chunks.reserve(static_cast<qsizetype>((totalSize + m_chunkSize - 1) / m_chunkSize));
+}
+
+char *ChunkBuffer::appendChunk(qint64 size)
+{
+    Q_ASSERT(size > 0 && size <= m_chunkSize);
+    Q_ASSERT(m_chunks.isEmpty() || m_chunks.last().size() == m_chunkSize);
+
+    // A spilled buffer hands out its mapping, see markFilled() for when
+    // the chunks leave memory again
+    if (m_spill && m_size + size <= m_spill->size()) {
+        char *chunk = m_spill->data() + m_size;
+        m_chunks.append(QByteArray::fromRawData(chunk, size));
+        m_size += size;
+        return chunk;
+    }
+
+    m_chunks.append(QByteArray(size, Qt::Uninitialized));
+    m_size += size;
+    return m_chunks.last().data();
+}
+
+void ChunkBuffer::appendZeroChunk(qint64 size)
+{
+    Q_ASSERT(size > 0 && size <= m_chunkSize);
+    Q_ASSERT(m_chunks.isEmpty() || m_chunks.last().size() == m_chunkSize);
+
+    const QByteArray &zeros = sharedZeros();
+    if (size <= zeros.size())
+        m_chunks.append(QByteArray::fromRawData(zeros.constData(), size));
+    else
+        m_chunks.append(QByteArray(size, '\0'));
+    m_size += size;
+}
+
+void ChunkBuffer::truncate(qint64 size)
+{
+    if (size >= m_size)
+        return;
+    if (size <= 0) {
+        clear();
+        return;
+    }
+
+    int lastIndex = chunkIndex(size - 1);
+    while (m_chunks.size() > lastIndex + 1)
+        m_chunks.removeLast();
+
+    // A prefix is no longer a copy of the source file
+    m_sourcePath.clear();
+    m_checksums = Checksums();
+
+    // Extents past the end go, the last one may end early
+    while (!m_extents.isEmpty() && m_extents.last().offset >= size)
+        m_extents.removeLast();
+    if (!m_extents.isEmpty())
+        m_extents.last().length = qMin(m_extents.last().length, size - m_extents.last().offset);
+
+    // Chunks in a mapping, in the spill file or of the shared zeros are
+    // views, they are shortened. Heap chunks own their data and are cut, a
+    // spilled buffer has them past the end of its file.
+    qint64 lastSize = size - chunkOffset(lastIndex);
+    QByteArray &last = m_chunks.last();
+    const char *lastData = last.constData();
+    bool inSpill = m_spill && lastData >= m_spill->data() && lastData < m_spill->data() + m_spill->size();
+    if (!m_mapping.isNull() || inSpill || lastData == sharedZeros().constData()) {
+        last = QByteArray::fromRawData(lastData, lastSize);
+    } else {
+        last.truncate(lastSize);
+        last.squeeze();
+    }
+
+    m_size = size;
+}
+
+void ChunkBuffer::clear()
+{
+    m_chunks.clear();
+    m_mapping.reset();
+    m_spill.reset();
+    m_reservation.reset();
+    m_size = 0;
+    m_sourcePath.clear();
+    m_checksums = Checksums();
+    m_extents.clear();
+    m_sparse = false;
+}
+
+void ChunkBuffer::setExtents(const QVector<Extent> &extents)
+{
+    m_extents = extents;
+    m_sparse = true;
+}
+
+qint64 ChunkBuffer::dataBytes() const
+{
+    if (!m_sparse)
+        return m_size;
+
+    qint64 bytes = 0;
+    for (const Extent &extent : m_extents)
+        bytes += extent.length;
+    return bytes;
+}
+
+void ChunkBuffer::setSource(const QString &filePath, const QDateTime &lastModified)
+{
+    m_sourcePath = filePath;
+    m_sourceModified = lastModified;
+}
+
+bool ChunkBuffer::matchesSource() const
+{
+    if (m_sourcePath.isEmpty())
+        return false;
+
+    QFileInfo fileInfo(m_sourcePath);
+    return fileInfo.exists() && fileInfo.size() == m_size
+           && fileInfo.lastModified() == m_sourceModified;
+}
+
+qint64 ChunkBuffer::residentBytes() const
+{
+    if (!m_spill)
+        return dataBytes();
+    qint64 resident = m_spill->residentBytes();
+    return resident < 0 ? -1 : qMin(resident, m_size);
+}
+
+qint64 ChunkBuffer::spilledBytes() const
+{
+    if (!m_spill)
+        return 0;
+    qint64 resident = residentBytes();
+    return resident < 0 ? -1 : m_size - resident;
+}
+
+QString ChunkBuffer::spillDirectory() const
+{
+    return m_spill ? m_spill->directory() : QString();
+}
+
+void ChunkBuffer::markFilled(qint64 bytes)
+{
+    if (m_spill)
+        m_spill->filled(bytes);
+}
+
+void ChunkBuffer::releaseResident()
+{
+    if (m_spill)
+        m_spill->evict(0, m_size);
+}
+
+QString ChunkBuffer::mappedPath() const
+{
+    return m_mapping ? m_mapping->fileName() : QString();
+}
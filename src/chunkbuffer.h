@@ -0,0 +1,134 @@
+#pragma once
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QList>
+#include <QMetaType>
+#include <QSharedPointer>
+#include <QVector>
+#include "checksums.h"
+
+class MemoryReservation;
+class QFile;
+class SpillFile;
+
+// Loaded file contents kept as a list of fixed-size chunks instead of one
+// contiguous QByteArray. Chunks are implicitly shared, so copying a buffer
+// (e.g. into a queued signal) is cheap, growing it never reallocates data
+// already read, and all offsets are 64-bit.
+class ChunkBuffer
+{
+public:
+    static constexpr qint64 DefaultChunkSize = 16 * 1024 * 1024; // 16 MB
+
+    // A stretch of a sparse buffer that holds data, everything between
+    // extents is a hole and reads as zeros
+    struct Extent
+    {
+        qint64 offset;
+        qint64 length;
+    };
+
+    explicit ChunkBuffer(qint64 chunkSize = DefaultChunkSize);
+
+    // Splits an existing mapping into chunks without copying. The buffer keeps
+    // the mapping alive until the last copy referencing it is destroyed.
+    static ChunkBuffer fromMapping(const QSharedPointer<QFile> &mapping, const uchar *data,
+                                   qint64 size, qint64 chunkSize = DefaultChunkSize);
+
+    // An empty buffer whose chunks will live in a SpillFile of totalSize
+    // bytes instead of the heap. Returns an ordinary buffer and sets error
+    // when the file cannot be created.
+    static ChunkBuffer spilled(qint64 totalSize, const QString &directory, QString *error,
+                               qint64 chunkSize = DefaultChunkSize);
+
+    bool isEmpty() const { return m_size == 0; }
+    qint64 size() const { return m_size; }
+    qint64 chunkSize() const { return m_chunkSize; }
+    int chunkCount() const { return m_chunks.size(); }
+
+    QByteArray chunk(int index) const { return m_chunks.at(index); }
+    const char *chunkData(int index) const { return m_chunks.at(index).constData(); }
+    qint64 chunkOffset(int index) const { return index * m_chunkSize; }
+    int chunkIndex(qint64 offset) const { return static_cast<int>(offset / m_chunkSize); }
+
+    // Copies up to length bytes starting at offset, crossing chunk borders
+    QByteArray read(qint64 offset, qint64 length) const;
+
+    // Reserves room in the chunk list for a buffer of the given total size
+    void reserve(qint64 totalSize);
+
+    // Appends a new uninitialised chunk of at most chunkSize() bytes and
+    // returns its storage for the caller to fill.
+    char *appendChunk(qint64 size);
+
+    // Appends a chunk of zeros, a hole. Chunks of zeros share one static
+    // allocation, so holes cost no memory.
+    void appendZeroChunk(qint64 size);
+
+    // Drops everything past size, used when a read ends early
+    void truncate(qint64 size);
+
+    void clear();
+
+    // Remembers which file the buffer is a complete, unmodified copy of
+    void setSource(const QString &filePath, const QDateTime &lastModified);
+    QString sourcePath() const { return m_sourcePath; }
+
+    // The file whose mapping holds the chunks, empty when they are not mapped
+    QString mappedPath() const;
+
+    // True while the source file still has the size and modification time it
+    // had when it was read, i.e. the buffer can be re-created from it on disk
+    bool matchesSource() const;
+
+    // Data extents of a buffer read from a sparse file. A buffer that is not
+    // sparse is data throughout.
+    bool isSparse() const { return m_sparse; }
+    QVector<Extent> extents() const { return m_extents; }
+    void setExtents(const QVector<Extent> &extents);
+
+    // Bytes in data extents, size() for a buffer that is not sparse
+    qint64 dataBytes() const;
+
+    // Whether the chunks are held in a SpillFile, and how much of them is in
+    // memory right now. A buffer that is not spilled is resident throughout,
+    // both are -1 when the system cannot tell for a spilled one.
+    bool isSpilled() const { return !m_spill.isNull(); }
+    qint64 residentBytes() const;
+    qint64 spilledBytes() const;
+
+    // Tells a spilled buffer that its first bytes hold their final data, so
+    // all but the last SpillFile::HotWindow of them may leave memory. Readers
+    // call it with their contiguous progress, chunks are appended ahead of
+    // it. Does nothing for a buffer that is not spilled.
+    void markFilled(qint64 bytes);
+
+    // Writes a spilled buffer back and drops it from memory, does nothing
+    // for one that is not spilled
+    void releaseResident();
+    QString spillDirectory() const;
+
+    // Heap memory the buffer counts against the process-wide budget, given
+    // back when the last copy goes away, see FileWorker::createBuffer()
+    void setReservation(const QSharedPointer<MemoryReservation> &reservation) { m_reservation = reservation; }
+
+    // Digests of the whole buffer, computed while it was read
+    void setChecksums(const Checksums &checksums) { m_checksums = checksums; }
+    Checksums checksums() const { return m_checksums; }
+
+private:
+    QList<QByteArray> m_chunks;
+    qint64 m_chunkSize;
+    qint64 m_size;
+    QSharedPointer<QFile> m_mapping;
+    QSharedPointer<SpillFile> m_spill;
+    QSharedPointer<MemoryReservation> m_reservation;
+    QString m_sourcePath;
+    QDateTime m_sourceModified;
+    Checksums m_checksums;
+    QVector<Extent> m_extents;
+    bool m_sparse;
+};
+
+Q_DECLARE_METATYPE(ChunkBuffer)
@@ -0,0 +1,131 @@
+#include "chunktuner.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QSettings>
+#include <QStorageInfo>
+
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#endif
+
+namespace {
+// A measurement window has to be long enough to average out readahead and
+// writeback bursts, but short enough to converge early in the transfer
+const qint64 MinWindowBytes = 32 * 1024 * 1024;
+const qint64 MinWindowNs = 200 * 1000 * 1000;
+const double MinGain = 1.05; // a step must bring at least 5 %
+
+QString settingsKey(const QString &deviceKey, bool writing)
+{
+    return QString("ChunkProfiles/%1/%2").arg(writing ? "write" : "read", deviceKey);
+}
+}
+
+ChunkTuner::ChunkTuner(const QString &filePath, bool writing, bool adaptive, qint64 fixedChunkSize)
+    : m_deviceKey(deviceKeyFor(filePath))
+    , m_writing(writing)
+    , m_adaptive(adaptive && fixedChunkSize <= 0)
+    , m_converged(!m_adaptive)
+    , m_chunkSize(MinChunkSize)
+    , m_growing(true)
+    , m_grew(false)
+    , m_bestChunkSize(MinChunkSize)
+    , m_bestRate(0.0)
+    , m_windowBytes(0)
+    , m_windowNs(0)
+{
+    if (fixedChunkSize > 0) {
+        m_chunkSize = qBound(MinChunkSize, fixedChunkSize, MaxChunkSize);
+        m_bestChunkSize = m_chunkSize;
+        return;
+    }
+    if (!m_adaptive)
+        return;
+
+    QSettings settings;
+    qint64 stored = settings.value(settingsKey(m_deviceKey, writing), MinChunkSize).toLongLong();
+    m_chunkSize = qBound(MinChunkSize, stored, MaxChunkSize);
+    m_bestChunkSize = m_chunkSize;
+}
+
+QString ChunkTuner::deviceKeyFor(const QString &filePath)
+{
+    // A file that is about to be created lives on its directory's device
+    QFileInfo fileInfo(filePath);
+    QString path = fileInfo.exists() ? fileInfo.absoluteFilePath() : fileInfo.absolutePath();
+
+#ifdef Q_OS_UNIX
+    struct stat status;
+    if (::stat(QFile::encodeName(path).constData(), &status) == 0)
+        return QString("dev-%1").arg(static_cast<quint64>(status.st_dev));
+#endif
+    return QString::fromLatin1(QStorageInfo(path).device().toHex());
+}
+
+void ChunkTuner::record(qint64 bytes, qint64 elapsedNs)
+{
+    if (m_converged)
+        return;
+
+    m_windowBytes += bytes;
+    m_windowNs += elapsedNs;
+    if (m_windowBytes >= qMax(MinWindowBytes, 8 * m_chunkSize) || m_windowNs >= MinWindowNs)
+        finishWindow();
+}
+
+void ChunkTuner::save() const
+{
+    if (!m_adaptive || m_bestRate <= 0.0)
+        return;
+
+    QSettings settings;
+    settings.setValue(settingsKey(m_deviceKey, m_writing), m_bestChunkSize);
+}
+
+void ChunkTuner::finishWindow()
+{
+    double rate = m_windowNs > 0 ? static_cast<double>(m_windowBytes) / m_windowNs : 0.0;
+    m_windowBytes = 0;
+    m_windowNs = 0;
+
+    bool first = m_bestRate <= 0.0;
+    if (first || rate > m_bestRate * MinGain) {
+        // Still gaining, keep walking the same way
+        if (!first && m_growing)
+            m_grew = true;
+        m_bestRate = rate;
+        m_bestChunkSize = m_chunkSize;
+        tryNext(m_growing ? m_chunkSize * 2 : m_chunkSize / 2);
+        return;
+    }
+
+    // The last step did not pay off. If growing never helped, smaller
+    // sizes may; otherwise settle on the best size seen.
+    if (m_growing && !m_grew) {
+        m_growing = false;
+        tryNext(m_bestChunkSize / 2);
+        return;
+    }
+
+    m_chunkSize = m_bestChunkSize;
+    m_converged = true;
+}
+
+void ChunkTuner::tryNext(qint64 nextSize)
+{
+    if (nextSize >= MinChunkSize && nextSize <= MaxChunkSize) {
+        m_chunkSize = nextSize;
+        return;
+    }
+
+    // Hit a limit: at the top, smaller sizes are still worth a look unless
+    // growing already helped
+    if (m_growing && !m_grew && m_bestChunkSize / 2 >= MinChunkSize) {
+        m_growing = false;
+        m_chunkSize = m_bestChunkSize / 2;
+        return;
+    }
+
+    m_chunkSize = m_bestChunkSize;
+    m_converged = true;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <QString>
+
+// Picks the read/write size for FileWorker's QFile loops. Starts from the
+// size remembered for the file's block device, measures throughput online
+// and hill-climbs by powers of two between MinChunkSize and MaxChunkSize
+// until a step no longer gains. The best size is stored per device and
+// direction in QSettings when the transfer ends.
+class ChunkTuner
+{
+public:
+    static constexpr qint64 MinChunkSize = 64 * 1024;            // 64 KB
+    static constexpr qint64 MaxChunkSize = 16 * 1024 * 1024;     // 16 MB
+
+    // filePath must exist, writing selects the save profile. A fixedChunkSize
+    // above zero disables tuning and is used as is (clamped to the limits).
+    ChunkTuner(const QString &filePath, bool writing, bool adaptive = true, qint64 fixedChunkSize = 0);
+
+    qint64 chunkSize() const { return m_chunkSize; }
+    bool isConverged() const { return m_converged; }
+
+    // Feeds one completed read or write of bytes that took elapsedNs
+    void record(qint64 bytes, qint64 elapsedNs);
+
+    // Stores the best size found for this device
+    void save() const;
+
+    QString deviceKey() const { return m_deviceKey; }
+
+    // Identifies the block device holding filePath, or the directory it
+    // would be created in
+    static QString deviceKeyFor(const QString &filePath);
+
+private:
+    void finishWindow();
+    void tryNext(qint64 nextSize);
+
+    QString m_deviceKey;
+    bool m_writing;
+    bool m_adaptive;
+    bool m_converged;
+    qint64 m_chunkSize;
+    bool m_growing;             // first larger sizes are tried, then smaller ones
+    bool m_grew;                // a larger size has beaten the starting size
+    qint64 m_bestChunkSize;
+    double m_bestRate;          // bytes per nanosecond
+    qint64 m_windowBytes;
+    qint64 m_windowNs;
+};
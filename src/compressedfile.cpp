@@ -0,0 +1,471 @@
+#include "compressedfile.h"
+#include "operationcontrol.h"
+#include <QDataStream>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThreadPool>
+#include <QWaitCondition>
+#include <atomic>
+#include <cstring>
+
+#ifdef CUBE_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+const char Magic[8] = {'C', 'U', 'B', 'E', 'C', 'M', 'P', '1'};
+const char IndexMagic[8] = {'C', 'U', 'B', 'E', 'I', 'D', 'X', '1'};
+const quint32 Version = 1;
+const qint64 HeaderSize = 32;
+const qint64 FooterSize = 24;
+const qint64 IndexEntrySize = 16;
+const int ZstdLevel = 3;
+
+// Returns a null array when the block cannot be compressed
+QByteArray compressBlock(CompressedFile::Codec codec, const char *data, qint64 size)
+{
+#ifdef CUBE_HAVE_ZSTD
+    if (codec == CompressedFile::Codec::Zstd) {
+        QByteArray compressed(static_cast<qsizetype>(ZSTD_compressBound(static_cast<size_t>(size))), Qt::Uninitialized);
+        size_t length = ZSTD_compress(compressed.data(), static_cast<size_t>(compressed.size()), data,
+                                      static_cast<size_t>(size), ZstdLevel);
+        if (ZSTD_isError(length))
+            return QByteArray();
+        compressed.truncate(static_cast<qsizetype>(length));
+        return compressed;
+    }
+#endif
+    Q_UNUSED(codec);
+    return qCompress(reinterpret_cast<const uchar *>(data), static_cast<qsizetype>(size));
+}
+
+// Decompresses a block of exactly size bytes to target
+bool decompressBlock(CompressedFile::Codec codec, const QByteArray &compressed, char *target, qint64 size)
+{
+#ifdef CUBE_HAVE_ZSTD
+    if (codec == CompressedFile::Codec::Zstd) {
+        size_t length = ZSTD_decompress(target, static_cast<size_t>(size), compressed.constData(),
+                                        static_cast<size_t>(compressed.size()));
+        return !ZSTD_isError(length) && static_cast<qint64>(length) == size;
+    }
+#endif
+    if (codec != CompressedFile::Codec::Zlib)
+        return false;
+
+    QByteArray block = qUncompress(compressed);
+    if (block.size() != size)
+        return false;
+    memcpy(target, block.constData(), static_cast<size_t>(size));
+    return true;
+}
+}
+
+CompressedFile::CompressedFile(int threadCount, Codec codec)
+    : m_threadCount(qMax(1, threadCount))
+    , m_codec(codec)
+    , m_logicalSize(0)
+    , m_compressedSize(0)
+{
+}
+
+CompressedFile::Codec CompressedFile::defaultCodec()
+{
+    return isAvailable(Codec::Zstd) ? Codec::Zstd : Codec::Zlib;
+}
+
+bool CompressedFile::isAvailable(Codec codec)
+{
+#ifdef CUBE_HAVE_ZSTD
+    return codec == Codec::Zlib || codec == Codec::Zstd;
+#else
+    return codec == Codec::Zlib;
+#endif
+}
+
+QString CompressedFile::codecName(Codec codec)
+{
+    switch (codec) {
+    case Codec::Zlib:
+        return "zlib";
+    case Codec::Zstd:
+        return "zstd";
+    }
+    return "unknown";
+}
+
+bool CompressedFile::isContainer(const QString &filePath)
+{
+    QFile file(filePath);
+    char magic[sizeof(Magic)];
+    return file.open(QIODevice::ReadOnly) && file.size() >= HeaderSize + FooterSize
+           && file.read(magic, sizeof(magic)) == sizeof(magic) && memcmp(magic, Magic, sizeof(Magic)) == 0;
+}
+
+CompressedFile::Result CompressedFile::write(QIODevice &file, const ChunkBuffer &data, OperationControl &control,
+                                             const Progress &progress, QString *error)
+{
+    const qint64 size = data.size();
+    const int blockCount = static_cast<int>((size + BlockSize - 1) / BlockSize);
+    m_blocks.clear();
+    m_blocks.reserve(blockCount);
+    m_logicalSize = size;
+    m_compressedSize = 0;
+
+    QDataStream out(&file);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out.writeRawData(Magic, sizeof(Magic));
+    out << static_cast<quint32>(m_codec) << Version << BlockSize << size;
+    if (out.status() != QDataStream::Ok) {
+        if (error)
+            *error = file.errorString();
+        return Result::Failed;
+    }
+    qint64 offset = HeaderSize;
+
+    std::atomic<int> nextBlock(0);
+    std::atomic<bool> stop(false);
+
+    // Compressed blocks wait here until the calling thread writes them in
+    // order. Workers stay at most a few blocks ahead of the writer.
+    QMutex mutex;
+    QWaitCondition changed;
+    QVector<QByteArray> compressed(blockCount);
+    const int window = m_threadCount * 2;
+    int written = 0;
+    int running = m_threadCount;
+    bool cancelled = false;
+    QString firstError;
+
+    auto worker = [&]() {
+        for (;;) {
+            int block = nextBlock.fetch_add(1, std::memory_order_relaxed);
+            if (block >= blockCount || stop.load(std::memory_order_relaxed))
+                break;
+
+            {
+                QMutexLocker locker(&mutex);
+                while (block >= written + window && !stop.load(std::memory_order_relaxed))
+                    changed.wait(&mutex);
+            }
+            if (stop.load(std::memory_order_relaxed))
+                break;
+
+            bool blockCancelled = !control.checkpoint();
+            QByteArray result;
+            if (!blockCancelled) {
+                qint64 blockOffset = block * BlockSize;
+                qint64 length = qMin(BlockSize, size - blockOffset);
+                int index = data.chunkIndex(blockOffset);
+                qint64 inChunk = blockOffset - data.chunkOffset(index);
+
+                // Blocks lie within a chunk unless the buffer has odd chunks
+                if (inChunk + length <= data.chunkSize()) {
+                    result = compressBlock(m_codec, data.chunkData(index) + inChunk, length);
+                } else {
+                    QByteArray copy = data.read(blockOffset, length);
+                    result = compressBlock(m_codec, copy.constData(), length);
+                }
+            }
+
+            QMutexLocker locker(&mutex);
+            if (blockCancelled || result.isNull()) {
+                cancelled = cancelled || blockCancelled;
+                if (!blockCancelled && firstError.isEmpty())
+                    firstError = QString("%1 failed to compress block %2").arg(codecName(m_codec)).arg(block);
+                stop.store(true, std::memory_order_relaxed);
+                changed.wakeAll();
+                break;
+            }
+            compressed[block] = result;
+            changed.wakeAll();
+        }
+
+        QMutexLocker locker(&mutex);
+        --running;
+        changed.wakeAll();
+    };
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(m_threadCount);
+    for (int thread = 0; thread < m_threadCount; ++thread)
+        pool.start(worker);
+
+    QElapsedTimer syscallTimer;
+    QMutexLocker locker(&mutex);
+    while (written < blockCount && !stop.load(std::memory_order_relaxed)) {
+        if (compressed[written].isNull()) {
+            if (running == 0)
+                break;
+            changed.wait(&mutex, 50);
+            continue;
+        }
+
+        QByteArray block = compressed[written];
+        compressed[written] = QByteArray();
+        locker.unlock();
+
+        syscallTimer.start();
+        bool ok = file.write(block) == block.size();
+        control.metrics().recordLatency(syscallTimer.nsecsElapsed());
+
+        locker.relock();
+        if (!ok) {
+            if (firstError.isEmpty())
+                firstError = file.errorString();
+            stop.store(true, std::memory_order_relaxed);
+            changed.wakeAll();
+            break;
+        }
+
+        m_blocks.append(Block{offset, block.size()});
+        offset += block.size();
+        ++written;
+        changed.wakeAll();
+
+        qint64 logicalBytes = qMin(written * BlockSize, size);
+        locker.unlock();
+        progress(logicalBytes, offset, logicalBytes);
+        locker.relock();
+    }
+    stop.store(true, std::memory_order_relaxed);
+    changed.wakeAll();
+    locker.unlock();
+    pool.waitForDone();
+
+    if (!firstError.isEmpty()) {
+        if (error)
+            *error = firstError;
+        return Result::Failed;
+    }
+    if (cancelled || written < blockCount)
+        return Result::Cancelled;
+
+    for (const Block &block : m_blocks)
+        out << block.offset << block.compressedSize;
+    out << offset << static_cast<qint64>(blockCount);
+    out.writeRawData(IndexMagic, sizeof(IndexMagic));
+    if (out.status() != QDataStream::Ok) {
+        if (error)
+            *error = file.errorString();
+        return Result::Failed;
+    }
+
+    m_compressedSize = offset + blockCount * IndexEntrySize + FooterSize;
+    return Result::Done;
+}
+
+bool CompressedFile::open(const QString &filePath, QString *error)
+{
+    auto fail = [error](const QString &message) {
+        if (error)
+            *error = message;
+        return false;
+    };
+
+    m_blocks.clear();
+    m_filePath = filePath;
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+        return fail(file.errorString());
+
+    const qint64 fileSize = file.size();
+    QDataStream in(&file);
+    in.setByteOrder(QDataStream::LittleEndian);
+
+    char magic[sizeof(Magic)];
+    quint32 codec = 0;
+    quint32 version = 0;
+    qint64 blockSize = 0;
+    qint64 logicalSize = 0;
+    if (fileSize < HeaderSize + FooterSize || in.readRawData(magic, sizeof(magic)) != sizeof(magic)
+        || memcmp(magic, Magic, sizeof(Magic)) != 0)
+        return fail("not a compressed file");
+    in >> codec >> version >> blockSize >> logicalSize;
+    if (in.status() != QDataStream::Ok || version != Version || blockSize != BlockSize || logicalSize < 0)
+        return fail("unsupported compressed file version");
+    if (codec != static_cast<quint32>(Codec::Zlib) && codec != static_cast<quint32>(Codec::Zstd))
+        return fail("unknown compression");
+    if (!isAvailable(static_cast<Codec>(codec)))
+        return fail(QString("compressed with %1, which this build cannot decompress")
+                        .arg(codecName(static_cast<Codec>(codec))));
+
+    qint64 indexOffset = 0;
+    qint64 blockCount = 0;
+    if (!file.seek(fileSize - FooterSize))
+        return fail(file.errorString());
+    in >> indexOffset >> blockCount;
+    if (in.readRawData(magic, sizeof(magic)) != sizeof(magic) || memcmp(magic, IndexMagic, sizeof(IndexMagic)) != 0
+        || in.status() != QDataStream::Ok || blockCount != (logicalSize + BlockSize - 1) / BlockSize
+        || indexOffset != fileSize - FooterSize - blockCount * IndexEntrySize)
+        return fail("the block index is damaged, the file was not completely saved");
+
+    if (!file.seek(indexOffset))
+        return fail(file.errorString());
+    m_blocks.reserve(static_cast<int>(blockCount));
+    for (qint64 index = 0; index < blockCount; ++index) {
+        Block block;
+        in >> block.offset >> block.compressedSize;
+        if (in.status() != QDataStream::Ok || block.offset < HeaderSize || block.compressedSize <= 0
+            || block.offset + block.compressedSize > indexOffset) {
+            m_blocks.clear();
+            return fail("the block index is damaged");
+        }
+        m_blocks.append(block);
+    }
+
+    m_codec = static_cast<Codec>(codec);
+    m_logicalSize = logicalSize;
+    m_compressedSize = fileSize;
+    return true;
+}
+
+QByteArray CompressedFile::readBlock(QIODevice &file, int index, QString *error) const
+{
+    const Block &block = m_blocks.at(index);
+    QByteArray compressed;
+    if (file.seek(block.offset))
+        compressed = file.read(block.compressedSize);
+    if (compressed.size() != block.compressedSize) {
+        if (error)
+            *error = file.errorString();
+        return QByteArray();
+    }
+
+    QByteArray logical(static_cast<qsizetype>(blockLength(index)), Qt::Uninitialized);
+    if (!decompressBlock(m_codec, compressed, logical.data(), logical.size())) {
+        if (error)
+            *error = QString("block %1 is damaged").arg(index);
+        return QByteArray();
+    }
+    return logical;
+}
+
+CompressedFile::Result CompressedFile::read(ChunkBuffer &data, OperationControl &control, const Progress &progress,
+                                            QString *error)
+{
+    if (data.chunkSize() % BlockSize != 0) {
+        if (error)
+            *error = "the buffer's chunks do not hold whole blocks";
+        return Result::Failed;
+    }
+
+    // Every chunk is allocated up front, the workers only ever see raw pointers
+    data.reserve(m_logicalSize);
+    QVector<char *> chunks;
+    for (qint64 offset = 0; offset < m_logicalSize; offset += data.chunkSize())
+        chunks.append(data.appendChunk(qMin(data.chunkSize(), m_logicalSize - offset)));
+
+    const qint64 chunkSize = data.chunkSize();
+    const int blockCount = m_blocks.size();
+    std::atomic<int> nextBlock(0);
+    std::atomic<qint64> logicalDone(0);
+    std::atomic<qint64> compressedDone(0);
+    std::atomic<bool> stop(false);
+
+    QMutex mutex;
+    QWaitCondition changed;
+    QVector<bool> completed(blockCount, false);
+    int running = m_threadCount;
+    bool cancelled = false;
+    QString firstError;
+
+    auto worker = [&]() {
+        QElapsedTimer syscallTimer;
+        QFile file(m_filePath);
+        bool opened = file.open(QIODevice::ReadOnly);
+
+        for (;;) {
+            int block = nextBlock.fetch_add(1, std::memory_order_relaxed);
+            if (block >= blockCount || stop.load(std::memory_order_relaxed))
+                break;
+
+            const Block &entry = m_blocks.at(block);
+            bool blockCancelled = !control.checkpoint();
+            QString blockError;
+            if (!blockCancelled && !opened)
+                blockError = file.errorString();
+
+            if (!blockCancelled && blockError.isEmpty()) {
+                syscallTimer.start();
+                QByteArray compressed;
+                if (file.seek(entry.offset))
+                    compressed = file.read(entry.compressedSize);
+                control.metrics().recordLatency(syscallTimer.nsecsElapsed());
+
+                qint64 offset = block * BlockSize;
+                int index = static_cast<int>(offset / chunkSize);
+                if (compressed.size() != entry.compressedSize)
+                    blockError = file.errorString();
+                else if (!decompressBlock(m_codec, compressed, chunks[index] + (offset - index * chunkSize),
+                                          blockLength(block)))
+                    blockError = QString("block %1 is damaged").arg(block);
+            }
+
+            QMutexLocker locker(&mutex);
+            if (blockCancelled || !blockError.isEmpty()) {
+                cancelled = cancelled || blockCancelled;
+                if (firstError.isEmpty())
+                    firstError = blockError;
+                stop.store(true, std::memory_order_relaxed);
+                changed.wakeAll();
+                break;
+            }
+            logicalDone.fetch_add(blockLength(block), std::memory_order_relaxed);
+            compressedDone.fetch_add(entry.compressedSize, std::memory_order_relaxed);
+            completed[block] = true;
+            changed.wakeAll();
+        }
+
+        QMutexLocker locker(&mutex);
+        --running;
+        changed.wakeAll();
+    };
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(m_threadCount);
+    for (int thread = 0; thread < m_threadCount; ++thread)
+        pool.start(worker);
+
+    int contiguousBlocks = 0;
+    qint64 contiguousBytes = 0;
+    QMutexLocker locker(&mutex);
+    for (;;) {
+        while (contiguousBlocks < blockCount && completed[contiguousBlocks])
+            ++contiguousBlocks;
+        bool finished = running == 0;
+        contiguousBytes = qMin(contiguousBlocks * BlockSize, m_logicalSize);
+
+        locker.unlock();
+        progress(logicalDone.load(std::memory_order_relaxed), compressedDone.load(std::memory_order_relaxed),
+                 contiguousBytes);
+        locker.relock();
+
+        if (finished)
+            break;
+        if (running > 0 && (contiguousBlocks == blockCount || !completed[contiguousBlocks]))
+            changed.wait(&mutex, 50);
+    }
+    locker.unlock();
+    pool.waitForDone();
+
+    // What was decompressed in order is kept
+    if (!firstError.isEmpty() || cancelled)
+        data.truncate(contiguousBytes);
+
+    if (!firstError.isEmpty()) {
+        if (error)
+            *error = firstError;
+        return Result::Failed;
+    }
+    if (cancelled)
+        return Result::Cancelled;
+    return Result::Done;
+}
+
+qint64 CompressedFile::blockLength(int index) const
+{
+    return qMin(BlockSize, m_logicalSize - index * BlockSize);
+}
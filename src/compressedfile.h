@@ -0,0 +1,88 @@
+#pragma once
+
+#include <QString>
+#include <QVector>
+#include <functional>
+#include "chunkbuffer.h"
+
+class OperationControl;
+class QIODevice;
+
+// Seekable container for compressed saves. The buffer is cut into blocks
+// that are compressed independently on all cores, with zstd when the build
+// has it and zlib (qCompress) otherwise, and written in order:
+//
+//   header  "CUBECMP1", codec, version, block size, logical size
+//   blocks  the compressed blocks, back to back
+//   index   offset and compressed size of every block
+//   footer  index offset, block count, "CUBEIDX1"
+//
+// All numbers are little endian. The index lets a reader fetch and
+// decompress any block on its own, so reading back is parallel too.
+class CompressedFile
+{
+public:
+    enum class Codec : quint32
+    {
+        Zlib = 1,
+        Zstd = 2
+    };
+
+    static constexpr qint64 BlockSize = 4 * 1024 * 1024;   // logical bytes per block, divides ChunkBuffer chunks
+
+    struct Block
+    {
+        qint64 offset;          // in the container
+        qint64 compressedSize;
+    };
+
+    // Called on the calling thread while the workers run: logical bytes done
+    // by all workers, compressed bytes done, and the length of the logical
+    // prefix that is complete
+    using Progress = std::function<void(qint64 logicalBytes, qint64 compressedBytes, qint64 contiguousBytes)>;
+
+    enum class Result { Done, Cancelled, Failed };
+
+    explicit CompressedFile(int threadCount, Codec codec = defaultCodec());
+
+    // zstd when available
+    static Codec defaultCodec();
+    static bool isAvailable(Codec codec);
+    static QString codecName(Codec codec);
+
+    // True when the file at filePath starts like a container
+    static bool isContainer(const QString &filePath);
+
+    // Compresses data into file, which must be open for writing and empty.
+    // Workers honour pause and cancel through control.
+    Result write(QIODevice &file, const ChunkBuffer &data, OperationControl &control,
+                 const Progress &progress, QString *error);
+
+    // Reads the header and the block index of the container at filePath
+    bool open(const QString &filePath, QString *error);
+
+    // Decompresses one block of the opened container, read from file.
+    // Returns a null array on error.
+    QByteArray readBlock(QIODevice &file, int index, QString *error) const;
+
+    // Decompresses the whole opened container into data, which must be empty
+    Result read(ChunkBuffer &data, OperationControl &control, const Progress &progress, QString *error);
+
+    Codec codec() const { return m_codec; }
+    int threadCount() const { return m_threadCount; }
+    int blockCount() const { return m_blocks.size(); }
+
+    // Of the last write() or the opened container
+    qint64 logicalSize() const { return m_logicalSize; }
+    qint64 compressedSize() const { return m_compressedSize; }
+
+private:
+    qint64 blockLength(int index) const;
+
+    int m_threadCount;
+    Codec m_codec;
+    QString m_filePath;
+    QVector<Block> m_blocks;
+    qint64 m_logicalSize;
+    qint64 m_compressedSize;    // the whole container, header and index included
+};
@@ -0,0 +1,254 @@
+#include "deltawriter.h"
+#include "operationcontrol.h"
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThreadPool>
+#include <QVector>
+#include <QWaitCondition>
+#include <atomic>
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <cerrno>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef Q_OS_UNIX
+namespace {
+// Reads up to size bytes at offset. Returns how many there were, fewer when
+// the file ends first, or -1 on error.
+qint64 preadFully(int fd, char *buffer, qint64 size, qint64 offset, OperationControl &control, QString *error)
+{
+    QElapsedTimer syscallTimer;
+    qint64 done = 0;
+    while (done < size) {
+        syscallTimer.start();
+        ssize_t bytesRead = ::pread(fd, buffer + done, static_cast<size_t>(size - done),
+                                    static_cast<off_t>(offset + done));
+        control.metrics().recordLatency(syscallTimer.nsecsElapsed());
+
+        if (bytesRead < 0) {
+            if (errno == EINTR)
+                continue;
+            *error = qt_error_string(errno);
+            return -1;
+        }
+        if (bytesRead == 0)
+            break;
+        done += bytesRead;
+    }
+    return done;
+}
+
+// Writes [offset, offset + size) of data to the same place in the file
+bool writeData(int fd, const ChunkBuffer &data, qint64 offset, qint64 size, OperationControl &control,
+               QString *error)
+{
+    QElapsedTimer syscallTimer;
+    const qint64 end = offset + size;
+    while (offset < end) {
+        int index = data.chunkIndex(offset);
+        qint64 inChunk = offset - data.chunkOffset(index);
+        qint64 length = qMin(end - offset, data.chunkSize() - inChunk);
+
+        syscallTimer.start();
+        ssize_t bytesWritten = ::pwrite(fd, data.chunkData(index) + inChunk, static_cast<size_t>(length),
+                                        static_cast<off_t>(offset));
+        control.metrics().recordLatency(syscallTimer.nsecsElapsed());
+
+        if (bytesWritten < 0) {
+            if (errno == EINTR)
+                continue;
+            *error = qt_error_string(errno);
+            return false;
+        }
+        offset += bytesWritten;
+    }
+    return true;
+}
+
+// True when [offset, offset + size) of data equals old
+bool sameAsData(const ChunkBuffer &data, qint64 offset, qint64 size, const char *old)
+{
+    while (size > 0) {
+        int index = data.chunkIndex(offset);
+        qint64 inChunk = offset - data.chunkOffset(index);
+        qint64 length = qMin(size, data.chunkSize() - inChunk);
+        if (memcmp(data.chunkData(index) + inChunk, old, static_cast<size_t>(length)) != 0)
+            return false;
+        offset += length;
+        old += length;
+        size -= length;
+    }
+    return true;
+}
+}
+#endif
+
+DeltaWriter::DeltaWriter(int threadCount, qint64 blockSize)
+    : m_threadCount(qMax(1, threadCount))
+    , m_blockSize(qMax<qint64>(4096, blockSize))
+    , m_rangeSize(qMax<qint64>(1, DefaultRangeSize / m_blockSize) * m_blockSize)
+    , m_bytesWritten(0)
+    , m_bytesSkipped(0)
+    , m_blocksWritten(0)
+    , m_blockCount(0)
+{
+}
+
+bool DeltaWriter::isSupported()
+{
+#ifdef Q_OS_UNIX
+    return true;
+#else
+    return false;
+#endif
+}
+
+DeltaWriter::Result DeltaWriter::write(int fd, const ChunkBuffer &data, OperationControl &control,
+                                       const Progress &progress, QString *error)
+{
+    const qint64 size = data.size();
+    m_bytesWritten = 0;
+    m_bytesSkipped = 0;
+    m_blocksWritten = 0;
+    m_blockCount = (size + m_blockSize - 1) / m_blockSize;
+
+#ifdef Q_OS_UNIX
+    struct stat status;
+    if (::fstat(fd, &status) != 0) {
+        if (error)
+            *error = qt_error_string(errno);
+        return Result::Failed;
+    }
+    const qint64 oldSize = status.st_size;
+
+    const qint64 rangeCount = (size + m_rangeSize - 1) / m_rangeSize;
+    std::atomic<qint64> nextRange(0);
+    std::atomic<qint64> bytesDone(0);
+    std::atomic<qint64> bytesWritten(0);
+    std::atomic<qint64> blocksWritten(0);
+    std::atomic<bool> stop(false);
+
+    QMutex mutex;
+    QWaitCondition changed;
+    QVector<bool> completed(static_cast<int>(rangeCount), false);
+    int running = m_threadCount;
+    bool cancelled = false;
+    QString firstError;
+
+    auto worker = [&]() {
+        QByteArray old(static_cast<int>(m_rangeSize), Qt::Uninitialized);
+        for (;;) {
+            qint64 range = nextRange.fetch_add(1, std::memory_order_relaxed);
+            if (range >= rangeCount || stop.load(std::memory_order_relaxed))
+                break;
+
+            qint64 offset = range * m_rangeSize;
+            qint64 end = qMin(offset + m_rangeSize, size);
+            QString rangeError;
+            bool rangeCancelled = !control.checkpoint();
+
+            // What the old file holds of the range, nothing past its end
+            qint64 oldEnd = offset;
+            if (!rangeCancelled && offset < oldSize) {
+                qint64 bytesRead = preadFully(fd, old.data(), qMin(end, oldSize) - offset, offset, control,
+                                              &rangeError);
+                oldEnd = offset + qMax<qint64>(0, bytesRead);
+            }
+
+            // Neighbouring blocks that differ go out in one write
+            qint64 runStart = -1;
+            for (qint64 block = offset; block < end && !rangeCancelled && rangeError.isEmpty();) {
+                qint64 blockEnd = qMin(block + m_blockSize, end);
+                bool same = blockEnd <= oldEnd
+                            && sameAsData(data, block, blockEnd - block, old.constData() + (block - offset));
+                if (!same && runStart < 0)
+                    runStart = block;
+
+                if (runStart >= 0 && (same || blockEnd == end)) {
+                    qint64 runEnd = same ? block : blockEnd;
+                    if (writeData(fd, data, runStart, runEnd - runStart, control, &rangeError)) {
+                        bytesWritten.fetch_add(runEnd - runStart, std::memory_order_relaxed);
+                        blocksWritten.fetch_add((runEnd - runStart + m_blockSize - 1) / m_blockSize,
+                                                std::memory_order_relaxed);
+                    }
+                    runStart = -1;
+                }
+                block = blockEnd;
+            }
+
+            QMutexLocker locker(&mutex);
+            if (rangeCancelled || !rangeError.isEmpty()) {
+                cancelled = cancelled || rangeCancelled;
+                if (firstError.isEmpty())
+                    firstError = rangeError;
+                stop.store(true, std::memory_order_relaxed);
+                changed.wakeAll();
+                break;
+            }
+            bytesDone.fetch_add(end - offset, std::memory_order_relaxed);
+            completed[static_cast<int>(range)] = true;
+            changed.wakeAll();
+        }
+
+        QMutexLocker locker(&mutex);
+        --running;
+        changed.wakeAll();
+    };
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(m_threadCount);
+    for (int thread = 0; thread < m_threadCount; ++thread)
+        pool.start(worker);
+
+    qint64 contiguousRanges = 0;
+    QMutexLocker locker(&mutex);
+    for (;;) {
+        while (contiguousRanges < rangeCount && completed[static_cast<int>(contiguousRanges)])
+            ++contiguousRanges;
+        bool finished = running == 0;
+        qint64 contiguousBytes = qMin(contiguousRanges * m_rangeSize, size);
+
+        locker.unlock();
+        progress(bytesDone.load(std::memory_order_relaxed), contiguousBytes);
+        locker.relock();
+
+        if (finished)
+            break;
+        if (running > 0 && (contiguousRanges == rangeCount || !completed[static_cast<int>(contiguousRanges)]))
+            changed.wait(&mutex, 50);
+    }
+    locker.unlock();
+    pool.waitForDone();
+
+    m_bytesWritten = bytesWritten.load();
+    m_blocksWritten = blocksWritten.load();
+
+    if (!firstError.isEmpty()) {
+        if (error)
+            *error = firstError;
+        return Result::Failed;
+    }
+    if (cancelled)
+        return Result::Cancelled;
+
+    // Growing was done by the writes, a shorter file loses its old tail
+    if (oldSize > size && ::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        if (error)
+            *error = qt_error_string(errno);
+        return Result::Failed;
+    }
+    m_bytesSkipped = size - m_bytesWritten;
+    return Result::Done;
+#else
+    Q_UNUSED(fd);
+    Q_UNUSED(control);
+    Q_UNUSED(progress);
+    if (error)
+        *error = "Delta saves are not supported on this platform";
+    return Result::Failed;
+#endif
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <QString>
+#include <functional>
+#include "chunkbuffer.h"
+
+class OperationControl;
+
+// Saves a buffer over an older version of the same file by rewriting only
+// the blocks that changed. The file is cut into ranges that a pool of
+// workers claims in order. Each worker preads its range of the old file,
+// compares it block by block with the buffer and pwrites the runs of blocks
+// that differ in place. Blocks past the old end are written as they are, and
+// the file is cut to the new size once all ranges are done. Unix only.
+class DeltaWriter
+{
+public:
+    static constexpr qint64 DefaultBlockSize = 256 * 1024;         // compared and rewritten as a unit
+    static constexpr qint64 DefaultRangeSize = 4 * 1024 * 1024;    // claimed by one worker at a time
+
+    // Called on the saving thread while the workers run: bytes compared or
+    // written by all workers, and the length of the prefix that is complete
+    using Progress = std::function<void(qint64 bytesDone, qint64 contiguousBytes)>;
+
+    enum class Result { Done, Cancelled, Failed };
+
+    explicit DeltaWriter(int threadCount, qint64 blockSize = DefaultBlockSize);
+
+    static bool isSupported();
+
+    // Makes the file open for reading and writing at fd hold data. Workers
+    // honour pause and cancel through control, a cancelled save leaves the
+    // file partly updated and saving again finishes it.
+    Result write(int fd, const ChunkBuffer &data, OperationControl &control,
+                 const Progress &progress, QString *error);
+
+    // What the last write() did, bytesSkipped() were already on disk
+    qint64 bytesWritten() const { return m_bytesWritten; }
+    qint64 bytesSkipped() const { return m_bytesSkipped; }
+    qint64 blocksWritten() const { return m_blocksWritten; }
+    qint64 blockCount() const { return m_blockCount; }
+
+    int threadCount() const { return m_threadCount; }
+    qint64 blockSize() const { return m_blockSize; }
+
+private:
+    int m_threadCount;
+    qint64 m_blockSize;
+    qint64 m_rangeSize;
+    qint64 m_bytesWritten;
+    qint64 m_bytesSkipped;
+    qint64 m_blocksWritten;
+    qint64 m_blockCount;
+};
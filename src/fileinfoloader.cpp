@@ -0,0 +1,116 @@
+#include "fileinfoloader.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QMimeDatabase>
+#include <QMutexLocker>
+
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#endif
+
+// Tells apart a file replaced under the same name and modification time
+static quint64 inodeOf(const QString &filePath)
+{
+#ifdef Q_OS_UNIX
+    struct stat status;
+    if (::stat(QFile::encodeName(filePath).constData(), &status) == 0)
+        return static_cast<quint64>(status.st_ino);
+#else
+    Q_UNUSED(filePath);
+#endif
+    return 0;
+}
+
+FileInfoLoader::FileInfoLoader(QObject *parent)
+    : QObject(parent)
+    , m_generation(0)
+    , m_cache(CacheSize)
+{
+    m_pool.setMaxThreadCount(LookupThreads);
+    m_debounce.setSingleShot(true);
+    m_debounce.setInterval(DebounceMs);
+    connect(&m_debounce, &QTimer::timeout, this, &FileInfoLoader::start);
+}
+
+FileInfoLoader::~FileInfoLoader()
+{
+    cancel();
+    m_pool.waitForDone();
+}
+
+void FileInfoLoader::request(const QString &filePath)
+{
+    ++m_generation;
+    m_pendingPath = filePath;
+    m_debounce.start();
+}
+
+void FileInfoLoader::cancel()
+{
+    ++m_generation;
+    m_debounce.stop();
+    m_pool.clear();
+}
+
+void FileInfoLoader::start()
+{
+    quint64 generation = m_generation.load();
+    QString filePath = m_pendingPath;
+
+    m_pool.start([this, filePath, generation]() {
+        if (m_generation.load() != generation)
+            return;
+
+        FileMetadata metadata;
+        if (!lookup(filePath, generation, &metadata))
+            return;
+
+        QMetaObject::invokeMethod(this, [this, metadata, generation]() {
+            if (m_generation.load() == generation)
+                emit loaded(metadata);
+        }, Qt::QueuedConnection);
+    });
+}
+
+bool FileInfoLoader::lookup(const QString &filePath, quint64 generation, FileMetadata *metadata)
+{
+    QFileInfo fileInfo(filePath);
+    metadata->filePath = filePath;
+    metadata->exists = fileInfo.exists();
+    if (!metadata->exists)
+        return true;
+
+    QString key = QString("%1\n%2\n%3")
+                      .arg(fileInfo.absoluteFilePath())
+                      .arg(inodeOf(filePath))
+                      .arg(fileInfo.lastModified().toMSecsSinceEpoch());
+    {
+        QMutexLocker locker(&m_cacheMutex);
+        if (const FileMetadata *cached = m_cache.object(key)) {
+            *metadata = *cached;
+            metadata->filePath = filePath;
+            return true;
+        }
+    }
+
+    metadata->name = fileInfo.fileName();
+    metadata->path = fileInfo.absolutePath();
+    metadata->size = fileInfo.size();
+    metadata->created = fileInfo.birthTime();
+    metadata->modified = fileInfo.lastModified();
+    metadata->readable = fileInfo.isReadable();
+    metadata->writable = fileInfo.isWritable();
+    metadata->executable = fileInfo.isExecutable();
+
+    // Sniffing the MIME type reads the file, the slow part on a remote mount
+    if (m_generation.load() != generation)
+        return false;
+    QMimeDatabase mimeDatabase;
+    QMimeType mimeType = mimeDatabase.mimeTypeForFile(fileInfo);
+    metadata->mimeType = mimeType.name();
+    metadata->mimeComment = mimeType.comment();
+
+    QMutexLocker locker(&m_cacheMutex);
+    m_cache.insert(key, new FileMetadata(*metadata));
+    return true;
+}
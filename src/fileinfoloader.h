@@ -0,0 +1,67 @@
+#pragma once
+
+#include <QCache>
+#include <QDateTime>
+#include <QMutex>
+#include <QObject>
+#include <QThreadPool>
+#include <QTimer>
+#include <atomic>
+
+// What the File Information panel shows about a file
+struct FileMetadata
+{
+    QString filePath;           // as requested
+    bool exists = false;
+    QString name;
+    QString path;
+    qint64 size = 0;
+    QDateTime created;
+    QDateTime modified;
+    bool readable = false;
+    bool writable = false;
+    bool executable = false;
+    QString mimeType;
+    QString mimeComment;
+};
+
+// Looks up file metadata on background threads, so typing a path on a slow
+// mount never blocks the GUI. Requests are debounced, and a newer request
+// makes the older ones moot: those not started yet are skipped, those
+// already running drop their result. Lookups are cached by path, inode and
+// modification time, so an unchanged file costs a stat and no MIME sniffing.
+class FileInfoLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr int DebounceMs = 150;
+    static constexpr int CacheSize = 256;          // files
+    static constexpr int LookupThreads = 2;        // one stuck on a dead mount does not block the next
+
+    explicit FileInfoLoader(QObject *parent = nullptr);
+    ~FileInfoLoader();  // waits for running lookups
+
+    // Looks up filePath once no newer request came for DebounceMs
+    void request(const QString &filePath);
+
+    // Drops the pending and running requests
+    void cancel();
+
+signals:
+    // Only for the latest request
+    void loaded(const FileMetadata &metadata);
+
+private:
+    void start();
+
+    // Runs on a pool thread. Returns false when the request became moot.
+    bool lookup(const QString &filePath, quint64 generation, FileMetadata *metadata);
+
+    QTimer m_debounce;
+    QString m_pendingPath;
+    QThreadPool m_pool;
+    std::atomic<quint64> m_generation;  // of the latest request
+    QMutex m_cacheMutex;
+    QCache<QString, FileMetadata> m_cache;
+};
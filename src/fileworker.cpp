@@ -1,18 +1,268 @@
 #include "fileworker.h"
 #include <QFile>
+#include <QCoreApplication>
+#include <QDir>
 #include <QFileInfo>
-#include <QApplication>
+#include <QThread>
+#include "bufferring.h"
+#include "uringtransfer.h"
+#include "uncachedfile.h"
+#include "chunktuner.h"
+#include "compressedfile.h"
+#include "deltawriter.h"
+#include "parallelreader.h"
+#include "sparsefile.h"
+#include "spillfile.h"
+#include "streamhasher.h"
+#include "transferjournal.h"
+#include <QScopedPointer>
+#include <cstdio>
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#endif
+
+#ifdef Q_OS_LINUX
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+static QString uringReport(const char *operation, const UringTransfer &transfer, qint64 bytes, qint64 elapsedMs)
+{
+    double megabytesPerSecond = elapsedMs > 0 ? (bytes / (1024.0 * 1024.0)) / (elapsedMs / 1000.0) : 0.0;
+    return QString("io_uring %1: queue depth %2, block %3 KB, %4 MB/s")
+        .arg(operation)
+        .arg(transfer.queueDepth())
+        .arg(transfer.blockSize() / 1024)
+        .arg(megabytesPerSecond, 0, 'f', 1);
+}
+
+// Reported whenever io_uring was asked for but the QFile path ran instead
+static QString uringFallbackReport(const char *operation, const QString &reason)
+{
+    return QString("io_uring not used for the %1, using QFile: %2").arg(operation, reason);
+}
+
+static QString cacheReport(const char *operation, const UncachedFile &file, qint64 bytes)
+{
+    return QString("Uncached %1 (%2): %3 of %4 MB left in the page cache")
+        .arg(operation)
+        .arg(file.isDirect() ? "O_DIRECT" : "fadvise")
+        .arg(qMax<qint64>(0, file.cachedBytes()) / (1024.0 * 1024.0), 0, 'f', 1)
+        .arg(bytes / (1024.0 * 1024.0), 0, 'f', 1);
+}
+
+// Calls visit(pointer, length) for the contiguous pieces of [from, to) of data
+template <typename Visitor>
+static void visitRange(const ChunkBuffer &data, qint64 from, qint64 to, Visitor visit)
+{
+    while (from < to) {
+        int index = data.chunkIndex(from);
+        qint64 inChunk = from - data.chunkOffset(index);
+        qint64 length = qMin(to - from, data.chunkSize() - inChunk);
+        visit(data.chunkData(index) + inChunk, length);
+        from += length;
+    }
+}
+
+// Hashes the next stretch [from, to) of data, which the I/O loop completed
+static void hashRange(StreamHasher *hasher, const ChunkBuffer &data, qint64 from, qint64 to)
+{
+    if (hasher)
+        visitRange(data, from, to, [hasher](const char *piece, qint64 length) { hasher->add(piece, length); });
+}
+
+// Hashes the first size bytes of file and leaves it positioned after them.
+// False on a read error or when control was cancelled.
+static bool hashPrefix(QFile &file, qint64 size, ChecksumCalculator &calculator, const OperationControl &control)
+{
+    QByteArray buffer(4 * 1024 * 1024, Qt::Uninitialized);
+    if (!file.seek(0))
+        return false;
+    for (qint64 done = 0; done < size;) {
+        if (control.isCancelled())
+            return false;
+        qint64 bytesRead = file.read(buffer.data(), qMin<qint64>(buffer.size(), size - done));
+        if (bytesRead <= 0)
+            return false;
+        calculator.update(buffer.constData(), bytesRead);
+        done += bytesRead;
+    }
+    return true;
+}
+
+#ifdef Q_OS_LINUX
+// Writes up to size bytes of data at offset to the same place in fd with a
+// single pwritev, the iovecs pointing straight into the chunks. Returns the
+// bytes written, possibly fewer, or -1 with errno set.
+static qint64 gatherWrite(int fd, const ChunkBuffer &data, qint64 offset, qint64 size)
+{
+    static constexpr int MaxVectors = 64;
+    struct iovec vectors[MaxVectors];
+    int count = 0;
+    for (qint64 from = offset, end = offset + size; from < end && count < MaxVectors; ++count) {
+        int index = data.chunkIndex(from);
+        qint64 inChunk = from - data.chunkOffset(index);
+        qint64 length = qMin(end - from, data.chunkSize() - inChunk);
+        vectors[count].iov_base = const_cast<char *>(data.chunkData(index) + inChunk);
+        vectors[count].iov_len = static_cast<size_t>(length);
+        from += length;
+    }
+
+    ssize_t bytesWritten;
+    do {
+        bytesWritten = ::pwritev(fd, vectors, count, static_cast<off_t>(offset));
+    } while (bytesWritten < 0 && errno == EINTR);
+    return bytesWritten;
+}
+#endif
+
+// Identifies what a save journal was written for
+static QByteArray journalIdentity(const ChunkBuffer &data)
+{
+    if (data.matchesSource())
+        return TransferJournal::fileIdentity(data.sourcePath());
+    return QByteArray("buffer");
+}
+
+// Checks that the data to save still has the blocks a journal lists. An
+// unmodified copy of a file is vouched for by the file's identity.
+static TransferJournal::DataCrc journalDataCrc(const ChunkBuffer &data)
+{
+    if (data.matchesSource())
+        return TransferJournal::DataCrc();
+    return [data](qint64 offset, qint64 size) {
+        Crc32cHasher hasher;
+        visitRange(data, offset, offset + size, [&hasher](const char *piece, qint64 length) {
+            hasher.update(piece, length);
+        });
+        return hasher.value();
+    };
+}
+
+// Syncs what the journal is about to list, QFile's buffer included
+static bool checkpointJournal(TransferJournal &journal, QFile &file, bool force = false)
+{
+    return file.flush() && journal.checkpoint(file.handle(), force);
+}
+
+static QString resumeReport(qint64 resumeOffset, qint64 totalBytes)
+{
+    return QString("Resumed at %1 MB of %2 MB: %3 bytes already on disk were verified against the journal and skipped")
+        .arg(resumeOffset / (1024.0 * 1024.0), 0, 'f', 1)
+        .arg(totalBytes / (1024.0 * 1024.0), 0, 'f', 1)
+        .arg(resumeOffset);
+}
+
+static QString deltaReport(const DeltaWriter &writer)
+{
+    return QString("Delta save: %1 MB written, %2 MB unchanged and skipped (%3 of %4 blocks of %5 KB differed)")
+        .arg(writer.bytesWritten() / (1024.0 * 1024.0), 0, 'f', 1)
+        .arg(writer.bytesSkipped() / (1024.0 * 1024.0), 0, 'f', 1)
+        .arg(writer.blocksWritten())
+        .arg(writer.blockCount())
+        .arg(writer.blockSize() / 1024);
+}
+
+static QString sparseReport(const char *operation, qint64 dataBytes, int extentCount, qint64 totalBytes)
+{
+    return QString("Sparse %1: %2 MB of data in %3 extents, %4 MB of holes skipped")
+        .arg(operation)
+        .arg(dataBytes / (1024.0 * 1024.0), 0, 'f', 1)
+        .arg(extentCount)
+        .arg((totalBytes - dataBytes) / (1024.0 * 1024.0), 0, 'f', 1);
+}
+
+static QString compressionReport(const char *operation, const CompressedFile &container, qint64 elapsedMs)
+{
+    double seconds = elapsedMs > 0 ? elapsedMs / 1000.0 : 0.0;
+    double logicalMB = container.logicalSize() / (1024.0 * 1024.0);
+    double compressedMB = container.compressedSize() / (1024.0 * 1024.0);
+    return QString("Compressed %1 (%2, %3 threads): %4 MB stored as %5 MB (%6%), %7 MB/s logical, %8 MB/s compressed")
+        .arg(operation)
+        .arg(CompressedFile::codecName(container.codec()))
+        .arg(container.threadCount())
+        .arg(logicalMB, 0, 'f', 1)
+        .arg(compressedMB, 0, 'f', 1)
+        .arg(logicalMB > 0 ? 100.0 * compressedMB / logicalMB : 100.0, 0, 'f', 1)
+        .arg(seconds > 0 ? logicalMB / seconds : 0.0, 0, 'f', 1)
+        .arg(seconds > 0 ? compressedMB / seconds : 0.0, 0, 'f', 1);
+}
+
+// Reads pass analyze to have the content analysed along with the hashing
+static StreamHasher *createHasher(const TransferOptions &options, bool analyze = false)
+{
+    analyze = analyze && options.analyzeContent;
+    if (!options.checksums && !analyze)
+        return nullptr;
+    return new StreamHasher(options.checksums ? Checksums::available(options.sha256) : Checksums::Algorithms(),
+                            analyze);
+}
 
 FileWorker::FileWorker(QObject *parent)
     : QObject(parent)
     , m_lastOperationTime(0)
-    , m_stop(false)
-    , m_start(false)
+    , m_nextAnalysis(1)
+{
+}
+
+FileWorker::~FileWorker()
+{
+    // Analyses still running are of no use to anyone any more
+    for (const Analysis &analysis : std::as_const(m_analyses))
+        analysis.hasher->cancel();
+    for (const Analysis &analysis : std::as_const(m_analyses)) {
+        analysis.thread->wait();
+        delete analysis.thread;
+    }
+}
+
+ChunkBuffer FileWorker::createBuffer(qint64 size, const TransferOptions &options, qint64 dataBytes)
 {
+    qint64 budget = options.memoryBudget == 0 ? SpillFile::defaultBudget() : options.memoryBudget;
+    if (dataBytes < 0)
+        dataBytes = size;
+    if (budget <= 0 || !SpillFile::isSupported())
+        return ChunkBuffer();
+
+    // The budget is shared with the reads of other workers and with every
+    // buffer still held, e.g. the one the window shows
+    ChunkBuffer data;
+    QSharedPointer<MemoryReservation> reservation = MemoryReservation::reserve(dataBytes, budget);
+    if (reservation) {
+        data.setReservation(reservation);
+        return data;
+    }
+
+    qint64 heldBytes = MemoryReservation::reservedBytes();
+    QString error;
+    data = ChunkBuffer::spilled(size, options.spillDirectory, &error);
+    if (data.isSpilled()) {
+        emit operationReport(QString("%1 MB exceed the memory budget of %2 MB with %3 MB held by other buffers, "
+                                     "spilling to %4")
+                                 .arg(dataBytes / (1024.0 * 1024.0), 0, 'f', 1)
+                                 .arg(budget / (1024.0 * 1024.0), 0, 'f', 1)
+                                 .arg(heldBytes / (1024.0 * 1024.0), 0, 'f', 1)
+                                 .arg(QDir::toNativeSeparators(data.spillDirectory())));
+    } else {
+        // Counted all the same, later reads spill instead
+        emit operationReport(QString("Cannot spill to disk, reading into memory: %1").arg(error));
+        data.setReservation(MemoryReservation::reserve(dataBytes, -1));
+    }
+    return data;
 }
 
-void FileWorker::readFile(const QString &filePath)
+void FileWorker::readFile(const QString &filePath, const TransferOptions &options,
+                          const QSharedPointer<OperationControl> &control)
 {
+    beginOperation(control);
+
     QFile file(filePath);
     if (!file.exists()) {
         emit readError("File does not exist.");
@@ -21,136 +271,1547 @@ void FileWorker::readFile(const QString &filePath)
     
     QFileInfo fileInfo(filePath);
     qint64 fileSize = fileInfo.size();
+
+    // Saved compressed, read back through the block index
+    if (CompressedFile::isContainer(filePath)) {
+        readCompressed(fileInfo, options);
+        return;
+    }
+
+    if (options.readMode == TransferOptions::ReadMode::Mapped && fileSize > 0) {
+        readMapped(fileInfo, options);
+        return;
+    }
+    
+    if (options.bypassCache && UncachedFile::isSupported()) {
+        UncachedFile uncachedFile(filePath);
+        if (!uncachedFile.open(QIODevice::ReadOnly)) {
+            emit readError(QString("Cannot open file for reading: %1").arg(uncachedFile.errorString()));
+            return;
+        }
+        if (readBuffered(uncachedFile, fileInfo, options)) {
+            uncachedFile.close();
+            emit operationReport(cacheReport("read", uncachedFile, fileSize));
+        }
+        return;
+    }
     
     if (!file.open(QIODevice::ReadOnly)) {
         emit readError(QString("Cannot open file for reading: %1").arg(file.errorString()));
         return;
     }
-    
+
+    // Holes of sparse files are skipped instead of read as zeros
+    QVector<ChunkBuffer::Extent> extents;
+    if (SparseFile::isSupported() && SparseFile::hasHoles(file.handle(), fileSize)
+        && SparseFile::dataExtents(file.handle(), fileSize, &extents)) {
+        readSparse(file, fileInfo, options, extents);
+        return;
+    }
+
+    if (options.ioBackend == TransferOptions::IoBackend::IoUring) {
+        if (!UringTransfer::isAvailable())
+            emit operationReport(uringFallbackReport("read", "not supported by this build or kernel"));
+        else if (readUring(file, fileInfo, options))
+            return;
+    }
+
+    // Large files from devices that serve requests in parallel are read by
+    // several threads at once
+    if (fileSize >= ParallelReader::MinFileSize && ParallelReader::isSupported()) {
+        int threadCount = options.readThreads > 0 ? options.readThreads
+                                                  : ParallelReader::threadCountFor(fileInfo.absoluteFilePath());
+        if (threadCount > 1) {
+            readParallel(file, fileInfo, options, threadCount);
+            return;
+        }
+    }
+
+    readBuffered(file, fileInfo, options);
+}
+
+bool FileWorker::readBuffered(QIODevice &file, const QFileInfo &fileInfo, const TransferOptions &options)
+{
+    qint64 fileSize = fileInfo.size();
+    ChunkTuner tuner(fileInfo.absoluteFilePath(), false, options.adaptiveChunkSize, options.chunkSize);
+    QElapsedTimer syscallTimer;
+
     // Start timer
     m_timer.start();
+    m_control->metrics().start();
     emit startRead(true);
     emit setRotationDirection(true);
-    m_start = true;
+    m_control->setProgress(0, fileSize);
     
-    QByteArray data;
-    const qint64 chunkSize = 64 * 1024; // 64 KB chunks
+    // Chunks are allocated once at their final size and filled in place, so
+    // data already read is never moved and peak memory equals the file size
+    ChunkBuffer data = createBuffer(fileSize, options);
+    data.reserve(fileSize);
     qint64 totalBytesRead = 0;
+    char *chunk = nullptr;
+    qint64 chunkFill = 0;
+    qint64 chunkCapacity = 0;
+
+    // Declared after data, so it stops before the chunks it hashes go away
+    QScopedPointer<StreamHasher> hasher(createHasher(options, true));
     
-    while (!file.atEnd()) {
-        QByteArray chunk = file.read(chunkSize);
-        if (chunk.isEmpty()) {
-            if (file.error() != QFile::NoError) {
-                emit readError(QString("Error reading file: %1").arg(file.errorString()));
-                return;
-            }
-            break;
+    // Reads the size seen at open time. Files that report no size (pipes,
+    // procfs) are read in whole chunks until the end.
+    while (fileSize == 0 ? !file.atEnd() : totalBytesRead < fileSize) {
+        if (chunkFill == chunkCapacity) {
+            chunkCapacity = fileSize > 0 ? qMin(data.chunkSize(), fileSize - totalBytesRead)
+                                         : data.chunkSize();
+            chunk = data.appendChunk(chunkCapacity);
+            chunkFill = 0;
         }
 
-        if(m_stop == true)
+        syscallTimer.start();
+        qint64 bytesRead = file.read(chunk + chunkFill, qMin(tuner.chunkSize(), chunkCapacity - chunkFill));
+        qint64 latency = syscallTimer.nsecsElapsed();
+        m_control->metrics().recordLatency(latency);
+        if (bytesRead > 0)
+            tuner.record(bytesRead, latency);
+        if (bytesRead < 0) {
+            emit readError(QString("Error reading file: %1").arg(file.errorString()));
+            return false;
+        }
+        if (bytesRead == 0)
+            break;
+
+        if (!m_control->checkpoint())
         {
-            qDebug() << "read" << m_stop;
-            m_stop = false;
+            if (hasher)
+                hasher->abort();
+            data.truncate(totalBytesRead);
             emit readFinished(data);
             emit stoptRead(false);
             emit cancelOperation_();
-            return;
+            return false;
         }
 
-        data.append(chunk);
-        totalBytesRead += chunk.size();
+        if (hasher)
+            hasher->add(chunk + chunkFill, bytesRead);
+        chunkFill += bytesRead;
+        totalBytesRead += bytesRead;
+        data.markFilled(totalBytesRead);
         
-        // Emit progress for every 5% or at the end
-        if (fileSize > 0) {
-            static qint64 lastProgressPercent = 0;
-            qint64 currentPercent = (totalBytesRead * 100) / fileSize;
-            if (currentPercent != lastProgressPercent || totalBytesRead == fileSize) {
-                emit readProgress(totalBytesRead, fileSize);
-                lastProgressPercent = currentPercent;
-                QApplication::processEvents(); // Keep UI responsive                
-            }            
-        }        
+        // Published for the GUI to sample, no event per chunk
+        m_control->setProgress(totalBytesRead);
     }
-    
+
+    tuner.save();
+    Checksums checksums = hasher ? hasher->finish() : Checksums();
+    data.truncate(totalBytesRead);
+    data.setChecksums(checksums);
+
+    // A complete spilled buffer leaves memory, reads fault it back in
+    data.releaseResident();
+    if (totalBytesRead == fileSize)
+        data.setSource(fileInfo.absoluteFilePath(), fileInfo.lastModified());
     file.close();
     
     // Record operation time
     m_lastOperationTime = m_timer.elapsed();
-        
+    m_control->metrics().stop();
+
+    if (!checksums.isEmpty())
+        emit checksumsComputed("Read", checksums);
+    if (hasher && hasher->isAnalyzing())
+        analyzeInBackground(hasher.take(), data);
     emit readFinished(data);
     emit stoptRead(false);
-    m_start = false;
+    return true;
 }
 
-void FileWorker::saveFile(const QString &filePath, const QByteArray &data)
+void FileWorker::readMapped(const QFileInfo &fileInfo, const TransferOptions &options)
 {
-    QFile file(filePath);
+    qint64 fileSize = fileInfo.size();
+    QFile *mappedFile = new QFile(fileInfo.absoluteFilePath());
+    if (!mappedFile->open(QIODevice::ReadOnly)) {
+        emit readError(QString("Cannot open file for reading: %1").arg(mappedFile->errorString()));
+        delete mappedFile;
+        return;
+    }
+
+    uchar *mappedData = mappedFile->map(0, fileSize);
+    if (mappedData == nullptr) {
+        emit readError(QString("Cannot map file: %1").arg(mappedFile->errorString()));
+        delete mappedFile;
+        return;
+    }
+
+    // The loaded buffer owns the mapping, it is unmapped with its last copy
+    QSharedPointer<QFile> mapping(mappedFile, [mappedData](QFile *file) {
+        file->unmap(mappedData);
+        delete file;
+    });
+
+#ifdef Q_OS_UNIX
+    // The whole mapping is consumed front to back: let the kernel read ahead
+    // aggressively and drop pages behind us instead of keeping them hot.
+    madvise(mappedData, static_cast<size_t>(fileSize), MADV_SEQUENTIAL);
+    madvise(mappedData, static_cast<size_t>(fileSize), MADV_WILLNEED);
+#endif
+
+    // Start timer
+    m_timer.start();
+    m_control->metrics().start();
+    emit startRead(true);
+    emit setRotationDirection(true);
+    m_control->setProgress(0, fileSize);
+
+    // The data is "read" once its pages are resident. Fault them in range by
+    // range by touching one byte per page, so progress and cancel still work.
+    const qint64 chunkSize = 4 * 1024 * 1024; // 4 MB ranges
+    const qint64 pageSize = 4096;
+    const volatile uchar *pages = mappedData;
+    qint64 totalBytesRead = 0;
+    uchar sink = 0;
+    QElapsedTimer faultTimer;
+    QScopedPointer<StreamHasher> hasher(createHasher(options, true));
+
+    while (totalBytesRead < fileSize) {
+        if (!m_control->checkpoint())
+        {
+            if (hasher)
+                hasher->abort();
+            emit readFinished(ChunkBuffer::fromMapping(mapping, mappedData, totalBytesRead));
+            emit stoptRead(false);
+            emit cancelOperation_();
+            return;
+        }
+
+        qint64 rangeEnd = qMin(totalBytesRead + chunkSize, fileSize);
+        faultTimer.start();
+        for (qint64 offset = totalBytesRead; offset < rangeEnd; offset += pageSize)
+            sink ^= pages[offset];
+        m_control->metrics().recordLatency(faultTimer.nsecsElapsed());
+        if (hasher)
+            hasher->add(reinterpret_cast<const char *>(mappedData) + totalBytesRead, rangeEnd - totalBytesRead);
+        totalBytesRead = rangeEnd;
+
+        m_control->setProgress(totalBytesRead);
+    }
+    Q_UNUSED(sink);
+
+    // Record operation time
+    m_lastOperationTime = m_timer.elapsed();
+    m_control->metrics().stop();
+
+    Checksums checksums = hasher ? hasher->finish() : Checksums();
+
+    ChunkBuffer data = ChunkBuffer::fromMapping(mapping, mappedData, fileSize);
+    data.setSource(fileInfo.absoluteFilePath(), fileInfo.lastModified());
+    data.setChecksums(checksums);
+    if (!checksums.isEmpty())
+        emit checksumsComputed("Read", checksums);
+    if (hasher && hasher->isAnalyzing())
+        analyzeInBackground(hasher.take(), data);
+    emit readFinished(data);
+    emit stoptRead(false);
+}
+
+void FileWorker::readCompressed(const QFileInfo &fileInfo, const TransferOptions &options)
+{
+    int threadCount = options.readThreads > 0 ? options.readThreads : QThread::idealThreadCount();
+    CompressedFile container(threadCount);
+    QString error;
+    if (!container.open(fileInfo.absoluteFilePath(), &error)) {
+        emit readError(QString("Cannot read compressed file: %1").arg(error));
+        return;
+    }
+
+    // Start timer
+    m_timer.start();
+    m_control->metrics().start();
+    emit startRead(true);
+    emit setRotationDirection(true);
+    m_control->setProgress(0, container.logicalSize());
+    m_control->setStoredBytes(0);
+
+    ChunkBuffer data = createBuffer(container.logicalSize(), options);
+    QScopedPointer<StreamHasher> hasher(createHasher(options, true));
+    qint64 hashedBytes = 0;
+
+    // Blocks finish out of order, the hasher follows the complete prefix
+    CompressedFile::Result result = container.read(data, *m_control,
+                                                   [&](qint64 logicalBytes, qint64 compressedBytes,
+                                                       qint64 contiguousBytes) {
+        hashRange(hasher.data(), data, hashedBytes, contiguousBytes);
+        hashedBytes = contiguousBytes;
+        data.markFilled(contiguousBytes);
+
+        // Published for the GUI to sample, no event per chunk
+        m_control->setStoredBytes(compressedBytes);
+        m_control->setProgress(logicalBytes);
+    }, &error);
+
+    if (result == CompressedFile::Result::Cancelled) {
+        if (hasher)
+            hasher->abort();
+        emit readFinished(data);
+        emit stoptRead(false);
+        emit cancelOperation_();
+        return;
+    }
+    if (result == CompressedFile::Result::Failed) {
+        emit readError(QString("Error reading compressed file: %1").arg(error));
+        emit stoptRead(false);
+        return;
+    }
+
+    // Not a copy of the file on disk, so never copied back by the kernel
+    Checksums checksums = hasher ? hasher->finish() : Checksums();
+    data.setChecksums(checksums);
+
+    // A complete spilled buffer leaves memory, reads fault it back in
+    data.releaseResident();
+
+    // Record operation time
+    m_lastOperationTime = m_timer.elapsed();
+    m_control->metrics().stop();
+
+    emit operationReport(compressionReport("read", container, m_lastOperationTime));
+    if (!checksums.isEmpty())
+        emit checksumsComputed("Read", checksums);
+    if (hasher && hasher->isAnalyzing())
+        analyzeInBackground(hasher.take(), data);
+    emit readFinished(data);
+    emit stoptRead(false);
+}
+
+void FileWorker::readSparse(QFile &file, const QFileInfo &fileInfo, const TransferOptions &options,
+                            const QVector<ChunkBuffer::Extent> &extents)
+{
+#ifdef Q_OS_LINUX
+    qint64 fileSize = fileInfo.size();
+    const qint64 requestSize = 4 * 1024 * 1024;
+
+    // Start timer
+    m_timer.start();
+    m_control->metrics().start();
+    emit startRead(true);
+    emit setRotationDirection(true);
+    m_control->setProgress(0, fileSize);
+
+    qint64 extentBytes = 0;
+    for (const ChunkBuffer::Extent &dataExtent : extents)
+        extentBytes += dataExtent.length;
+    ChunkBuffer data = createBuffer(fileSize, options, extentBytes);
+    data.reserve(fileSize);
+    QScopedPointer<StreamHasher> hasher(createHasher(options, true));
+    QElapsedTimer syscallTimer;
+    qint64 dataBytes = 0;
+    qint64 done = 0;    // everything before is read or zeroed
+    bool cancelled = false;
+    QString error;
+    int extent = 0;
+
+    while (done < fileSize && !cancelled && error.isEmpty()) {
+        qint64 chunkStart = done;
+        qint64 chunkEnd = qMin(chunkStart + data.chunkSize(), fileSize);
+        while (extent < extents.size() && extents[extent].offset + extents[extent].length <= chunkStart)
+            ++extent;
+
+        // A chunk that lies in a hole is not even allocated
+        if (extent == extents.size() || extents[extent].offset >= chunkEnd) {
+            if (!m_control->checkpoint()) {
+                cancelled = true;
+                break;
+            }
+            data.appendZeroChunk(chunkEnd - chunkStart);
+            hashRange(hasher.data(), data, chunkStart, chunkEnd);
+            done = chunkEnd;
+            m_control->setProgress(done);
+            continue;
+        }
+
+        char *chunk = data.appendChunk(chunkEnd - chunkStart);
+        for (int index = extent; index < extents.size() && extents[index].offset < chunkEnd; ++index) {
+            qint64 from = qMax(extents[index].offset, chunkStart);
+            qint64 to = qMin(extents[index].offset + extents[index].length, chunkEnd);
+            memset(chunk + (done - chunkStart), 0, static_cast<size_t>(from - done));
+            done = from;
+
+            while (done < to) {
+                if (!m_control->checkpoint()) {
+                    cancelled = true;
+                    break;
+                }
+
+                syscallTimer.start();
+                ssize_t bytesRead = ::pread(file.handle(), chunk + (done - chunkStart),
+                                            static_cast<size_t>(qMin(requestSize, to - done)),
+                                            static_cast<off_t>(done));
+                m_control->metrics().recordLatency(syscallTimer.nsecsElapsed());
+
+                if (bytesRead < 0) {
+                    if (errno == EINTR)
+                        continue;
+                    error = qt_error_string(errno);
+                    break;
+                }
+                if (bytesRead == 0) {
+                    error = "the file shrank while it was read";
+                    break;
+                }
+
+                done += bytesRead;
+                dataBytes += bytesRead;
+
+                // Published for the GUI to sample, no event per chunk
+                m_control->setProgress(done);
+            }
+            if (cancelled || !error.isEmpty())
+                break;
+        }
+        if (cancelled || !error.isEmpty())
+            break;
+
+        memset(chunk + (done - chunkStart), 0, static_cast<size_t>(chunkEnd - done));
+        hashRange(hasher.data(), data, chunkStart, chunkEnd);
+        done = chunkEnd;
+        data.markFilled(done);
+        m_control->setProgress(done);
+    }
+
+    file.close();
+
+    if (cancelled) {
+        if (hasher)
+            hasher->abort();
+        data.setExtents(extents);
+        data.truncate(done);
+        emit readFinished(data);
+        emit stoptRead(false);
+        emit cancelOperation_();
+        return;
+    }
+    if (!error.isEmpty()) {
+        emit readError(QString("Error reading file: %1").arg(error));
+        emit stoptRead(false);
+        return;
+    }
+
+    Checksums checksums = hasher ? hasher->finish() : Checksums();
+    data.setExtents(extents);
+    data.setSource(fileInfo.absoluteFilePath(), fileInfo.lastModified());
+    data.setChecksums(checksums);
+
+    // A complete spilled buffer leaves memory, reads fault it back in
+    data.releaseResident();
+
+    // Record operation time
+    m_lastOperationTime = m_timer.elapsed();
+    m_control->metrics().stop();
+
+    emit operationReport(sparseReport("read", dataBytes, extents.size(), fileSize));
+    if (!checksums.isEmpty())
+        emit checksumsComputed("Read", checksums);
+    if (hasher && hasher->isAnalyzing())
+        analyzeInBackground(hasher.take(), data);
+    emit readFinished(data);
+    emit stoptRead(false);
+#else
+    Q_UNUSED(extents);
+    readBuffered(file, fileInfo, options);
+#endif
+}
+
+void FileWorker::saveFile(const QString &filePath, const ChunkBuffer &data, const TransferOptions &options,
+                          const QSharedPointer<OperationControl> &control)
+{
+    beginOperation(control);
+
+    // Saving an unchanged buffer onto its own source has nothing to do
+    if (!options.compress && data.matchesSource() && isSameFile(data.sourcePath(), filePath)) {
+        QFile::remove(TransferJournal::journalPath(filePath));
+        m_lastOperationTime = 0;
+        emit operationReport(QString("%1 is unchanged, nothing to save").arg(QDir::toNativeSeparators(filePath)));
+        emit saveFinished();
+        emit stopWrite(false);
+        return;
+    }
+
+    // The pages of a mapped buffer are the file's own, truncating the file
+    // would pull them away mid-save. The save goes to a temporary file next
+    // to it, which then takes its place.
+    if (m_replacePath.isEmpty() && isSameFile(data.mappedPath(), filePath)) {
+        QString temporaryPath = QString("%1.cube-%2.tmp").arg(filePath).arg(QCoreApplication::applicationPid());
+        TransferOptions replaceOptions = options;
+        replaceOptions.resumable = false;
+        replaceOptions.deltaSave = false;
+        m_replacePath = filePath;
+        saveFile(temporaryPath, data, replaceOptions, m_control);
+        m_replacePath.clear();
+        QFile::remove(temporaryPath);   // left by a failed or cancelled save
+        return;
+    }
+
+    QFile plainFile(filePath);
+    UncachedFile uncachedFile(filePath);
+    bool uncached = options.bypassCache && UncachedFile::isSupported();
+    QIODevice &file = uncached ? static_cast<QIODevice &>(uncachedFile) : plainFile;
     qint64 totalBytes = data.size();
-    
-    if (!file.open(QIODevice::WriteOnly)) {
+
+    // A compressed file is always written whole, never resumed or patched
+    if (options.compress) {
+        QFile::remove(TransferJournal::journalPath(filePath));
+        saveCompressed(filePath, data, options);
+        return;
+    }
+
+    // An older version of the file only needs the blocks that changed
+    if (options.deltaSave && !uncached && DeltaWriter::isSupported() && QFileInfo(filePath).isFile()) {
+        saveDelta(filePath, data, options);
+        return;
+    }
+
+    // Holes are not written, and zero blocks become holes when asked to
+    if ((data.isSparse() || options.punchZeros) && !uncached && SparseFile::isSupported()) {
+        QFile::remove(TransferJournal::journalPath(filePath));
+        saveSparse(filePath, data, options);
+        return;
+    }
+
+    // Large saves keep a journal, so an interrupted one continues where it
+    // stopped. O_DIRECT and io_uring saves are not journaled.
+    TransferJournal journal(filePath, totalBytes, journalIdentity(data));
+    bool journaled = options.resumable && !uncached && TransferJournal::isUseful(totalBytes);
+    qint64 resumeOffset = 0;
+    if (journaled) {
+        resumeOffset = journal.resumableBytes(*m_control, journalDataCrc(data));
+        if (resumeOffset < 0) {
+            emit stopWrite(false);
+            emit cancelOperation_();
+            return;
+        }
+        if (resumeOffset > 0)
+            emit operationReport(resumeReport(resumeOffset, totalBytes));
+    } else {
+        journal.remove(); // left by an earlier save of something else
+    }
+
+    // An untouched copy of a file still on disk is better copied by the kernel
+    if (data.matchesSource()) {
+        if (saveFromSource(data.sourcePath(), filePath, data, options, journaled ? &journal : nullptr, resumeOffset))
+            return;
+    }
+
+    // A resumed save keeps the verified prefix
+    if (!file.open(resumeOffset > 0 ? QIODevice::ReadWrite : QIODevice::WriteOnly)
+        || (resumeOffset > 0 && !plainFile.seek(resumeOffset))) {
         emit saveError(QString("Cannot open file for writing: %1").arg(file.errorString()));
         return;
     }
+
+    if (!uncached && resumeOffset == 0 && options.ioBackend == TransferOptions::IoBackend::IoUring) {
+        if (!UringTransfer::isAvailable()) {
+            emit operationReport(uringFallbackReport("save", "not supported by this build or kernel"));
+        } else if (saveUring(plainFile, data, options)) {
+            journal.remove();
+            return;
+        }
+    }
+
+    if (journaled)
+        journaled = journal.begin(resumeOffset);
     
     // Start timer
     m_timer.start();
+    m_control->metrics().start();
     emit startWrite(true);
     emit setRotationDirection(false);
-    m_start = true;
+    m_control->setProgress(resumeOffset, totalBytes);
     
-    const qint64 chunkSize = 64 * 1024; // 64 KB chunks
-    qint64 totalBytesWritten = 0;
+    ChunkTuner tuner(filePath, true, options.adaptiveChunkSize, options.chunkSize);
+    QElapsedTimer syscallTimer;
+    QScopedPointer<StreamHasher> hasher(createHasher(options));
+    qint64 totalBytesWritten = resumeOffset;
+
+    // The digest covers the whole file, the skipped prefix comes from memory
+    hashRange(hasher.data(), data, 0, resumeOffset);
     
+    // Plain files are written with pwritev straight from the chunks, each
+    // call spanning chunk borders. QFile has no gather write, and O_DIRECT
+    // needs UncachedFile's aligned bounce buffer.
+#ifdef Q_OS_LINUX
+    const bool gather = !uncached;
+#else
+    const bool gather = false;
+#endif
+
     while (totalBytesWritten < totalBytes) {
-        qint64 bytesToWrite = qMin(chunkSize, totalBytes - totalBytesWritten);
-        QByteArray chunk = data.mid(static_cast<int>(totalBytesWritten), static_cast<int>(bytesToWrite));
-        
-        qint64 bytesWritten = file.write(chunk);
-        if (bytesWritten == -1) {
+        qint64 bytesToWrite = qMin(tuner.chunkSize(), totalBytes - totalBytesWritten);
+        qint64 bytesWritten = -1;
+        QString writeError;
+
+        syscallTimer.start();
+#ifdef Q_OS_LINUX
+        if (gather) {
+            bytesWritten = gatherWrite(plainFile.handle(), data, totalBytesWritten, bytesToWrite);
+            if (bytesWritten < 0)
+                writeError = qt_error_string(errno);
+        }
+#endif
+        if (!gather) {
+            // Written straight from the chunk, no intermediate copy
+            int index = data.chunkIndex(totalBytesWritten);
+            qint64 inChunk = totalBytesWritten - data.chunkOffset(index);
+            bytesToWrite = qMin(bytesToWrite, data.chunkSize() - inChunk);
+            bytesWritten = file.write(data.chunkData(index) + inChunk, bytesToWrite);
+            if (bytesWritten < 0)
+                writeError = file.errorString();
+        }
+        qint64 latency = syscallTimer.nsecsElapsed();
+        m_control->metrics().recordLatency(latency);
+        if (bytesWritten > 0)
+            tuner.record(bytesWritten, latency);
+        if (bytesWritten < 0) {
+            if (journaled)
+                checkpointJournal(journal, plainFile, true);
             file.close();
-            emit saveError(QString("Error writing to file: %1").arg(file.errorString()));
+            emit saveError(QString("Error writing to file: %1").arg(writeError));
             return;
         }
 
-        if(m_stop == true)
+        if (journaled) {
+            visitRange(data, totalBytesWritten, totalBytesWritten + bytesWritten,
+                       [&journal](const char *piece, qint64 length) { journal.add(piece, length); });
+            if (!checkpointJournal(journal, plainFile)) {
+                file.close();
+                emit saveError(QString("Error writing to file: %1").arg(qt_error_string()));
+                return;
+            }
+        }
+
+        if (!m_control->checkpoint())
         {
-            qDebug() << "read" << m_stop;
-            m_stop = false;
-            emit readFinished(data);
-            emit stoptRead(false);
+            if (journaled)
+                checkpointJournal(journal, plainFile, true);
+            emit stopWrite(false);
             emit cancelOperation_();
             return;
         }
-        
+
+        hashRange(hasher.data(), data, totalBytesWritten, totalBytesWritten + bytesWritten);
         totalBytesWritten += bytesWritten;
-        
-        // Emit progress for every 5% or at the end
-        static qint64 lastProgressPercent = 0;
-        qint64 currentPercent = (totalBytesWritten * 100) / totalBytes;
-        if (currentPercent != lastProgressPercent || totalBytesWritten == totalBytes) {
-            emit saveProgress(totalBytesWritten, totalBytes);
-            lastProgressPercent = currentPercent;
-            QApplication::processEvents(); // Keep UI responsive
-        }
+
+        // Published for the GUI to sample, no event per chunk
+        m_control->setProgress(totalBytesWritten);
     }
-    
+
+    tuner.save();
+
+    if (uncached && !uncachedFile.commit()) {
+        file.close();
+        emit saveError(QString("Error writing to file: %1").arg(file.errorString()));
+        return;
+    }
+    
     file.close();
+    journal.remove();
     
     // Record operation time
     m_lastOperationTime = m_timer.elapsed();
+    m_control->metrics().stop();
 
-    emit saveFinished();
+    if (uncached)
+        emit operationReport(cacheReport("save", uncachedFile, totalBytes));
+    verifySaved(filePath, data, hasher ? hasher->finish() : Checksums(), options);
+    finishSave(filePath);
+    emit stopWrite(false);
+}
+
+bool FileWorker::readUring(QFile &file, const QFileInfo &fileInfo, const TransferOptions &options)
+{
+    UringTransfer transfer(options.queueDepth, options.blockSize);
+    QString error;
+    if (!transfer.open(file.handle(), ChunkBuffer::DefaultChunkSize, &error)) {
+        emit operationReport(uringFallbackReport("read", error));
+        return false;
+    }
+
+    qint64 fileSize = fileInfo.size();
+
+    // Start timer
+    m_timer.start();
+    m_control->metrics().start();
+    emit startRead(true);
+    emit setRotationDirection(true);
+    m_control->setProgress(0, fileSize);
+
+    ChunkBuffer data = createBuffer(fileSize, options);
+    data.reserve(fileSize);
+    qint64 bytesDone = 0;
+
+    // Requests overlap, so the latency recorded is the time between two
+    // retired requests rather than the time of a single one
+    QElapsedTimer completionTimer;
+    completionTimer.start();
+
+    QScopedPointer<StreamHasher> hasher(createHasher(options, true));
+
+    UringTransfer::Result result = transfer.read(data, fileSize, [&](qint64 totalBytesRead) {
+        m_control->metrics().recordLatency(completionTimer.nsecsElapsed());
+        completionTimer.restart();
+        hashRange(hasher.data(), data, bytesDone, totalBytesRead);
+        bytesDone = totalBytesRead;
+        data.markFilled(totalBytesRead);
+        if (!m_control->checkpoint())
+            return false;
+
+        // Published for the GUI to sample, no event per chunk
+        m_control->setProgress(totalBytesRead);
+        return true;
+    }, &error);
+
+    file.close();
+
+    if (result == UringTransfer::Result::Cancelled) {
+        if (hasher)
+            hasher->abort();
+        data.truncate(bytesDone);
+        emit readFinished(data);
+        emit stoptRead(false);
+        emit cancelOperation_();
+        return true;
+    }
+    if (result == UringTransfer::Result::Failed) {
+        emit readError(QString("Error reading file: %1").arg(error));
+        emit stoptRead(false);
+        return true;
+    }
+
+    Checksums checksums = hasher ? hasher->finish() : Checksums();
+    data.setSource(fileInfo.absoluteFilePath(), fileInfo.lastModified());
+    data.setChecksums(checksums);
+
+    // A complete spilled buffer leaves memory, reads fault it back in
+    data.releaseResident();
+
+    // Record operation time
+    m_lastOperationTime = m_timer.elapsed();
+    m_control->metrics().stop();
+
+    emit operationReport(uringReport("read", transfer, fileSize, m_lastOperationTime));
+    if (!checksums.isEmpty())
+        emit checksumsComputed("Read", checksums);
+    if (hasher && hasher->isAnalyzing())
+        analyzeInBackground(hasher.take(), data);
+    emit readFinished(data);
+    emit stoptRead(false);
+    return true;
+}
+
+void FileWorker::readParallel(QFile &file, const QFileInfo &fileInfo, const TransferOptions &options,
+                              int threadCount)
+{
+    qint64 fileSize = fileInfo.size();
+    ParallelReader reader(threadCount);
+
+    // Start timer
+    m_timer.start();
+    m_control->metrics().start();
+    emit startRead(true);
+    emit setRotationDirection(true);
+    m_control->setProgress(0, fileSize);
+
+    ChunkBuffer data = createBuffer(fileSize, options);
+    QScopedPointer<StreamHasher> hasher(createHasher(options, true));
+    qint64 hashedBytes = 0;
+    QString error;
+
+    // Ranges finish out of order, the hasher follows the complete prefix
+    ParallelReader::Result result = reader.read(file.handle(), data, fileSize, *m_control,
+                                                [&](qint64 bytesDone, qint64 contiguousBytes) {
+        hashRange(hasher.data(), data, hashedBytes, contiguousBytes);
+        hashedBytes = contiguousBytes;
+        data.markFilled(contiguousBytes);
+
+        // Published for the GUI to sample, no event per chunk
+        m_control->setProgress(bytesDone);
+    }, &error);
+
+    file.close();
+
+    if (result == ParallelReader::Result::Cancelled) {
+        if (hasher)
+            hasher->abort();
+        data.truncate(reader.contiguousBytes());
+        emit readFinished(data);
+        emit stoptRead(false);
+        emit cancelOperation_();
+        return;
+    }
+    if (result == ParallelReader::Result::Failed) {
+        emit readError(QString("Error reading file: %1").arg(error));
+        emit stoptRead(false);
+        return;
+    }
+
+    Checksums checksums = hasher ? hasher->finish() : Checksums();
+    data.setSource(fileInfo.absoluteFilePath(), fileInfo.lastModified());
+    data.setChecksums(checksums);
+
+    // A complete spilled buffer leaves memory, reads fault it back in
+    data.releaseResident();
+
+    // Record operation time
+    m_lastOperationTime = m_timer.elapsed();
+    m_control->metrics().stop();
+
+    emit operationReport(QString("Parallel read with %1 threads").arg(threadCount));
+    if (!checksums.isEmpty())
+        emit checksumsComputed("Read", checksums);
+    if (hasher && hasher->isAnalyzing())
+        analyzeInBackground(hasher.take(), data);
+    emit readFinished(data);
+    emit stoptRead(false);
+}
+
+bool FileWorker::saveUring(QFile &file, const ChunkBuffer &data, const TransferOptions &options)
+{
+    UringTransfer transfer(options.queueDepth, options.blockSize);
+    QString error;
+    if (!transfer.open(file.handle(), data.chunkSize(), &error)) {
+        emit operationReport(uringFallbackReport("save", error));
+        return false;
+    }
+
+    qint64 totalBytes = data.size();
+
+    // Start timer
+    m_timer.start();
+    m_control->metrics().start();
+    emit startWrite(true);
+    emit setRotationDirection(false);
+    m_control->setProgress(0, totalBytes);
+
+    QElapsedTimer completionTimer;
+    completionTimer.start();
+    QScopedPointer<StreamHasher> hasher(createHasher(options));
+    qint64 bytesDone = 0;
+
+    UringTransfer::Result result = transfer.write(data, [&](qint64 totalBytesWritten) {
+        m_control->metrics().recordLatency(completionTimer.nsecsElapsed());
+        completionTimer.restart();
+        hashRange(hasher.data(), data, bytesDone, totalBytesWritten);
+        bytesDone = totalBytesWritten;
+        if (!m_control->checkpoint())
+            return false;
+
+        // Published for the GUI to sample, no event per chunk
+        m_control->setProgress(totalBytesWritten);
+        return true;
+    }, &error);
+
+    file.close();
+
+    if (result == UringTransfer::Result::Cancelled) {
+        emit stopWrite(false);
+        emit cancelOperation_();
+        return true;
+    }
+    if (result == UringTransfer::Result::Failed) {
+        emit saveError(QString("Error writing to file: %1").arg(error));
+        emit stopWrite(false);
+        return true;
+    }
+
+    // Record operation time
+    m_lastOperationTime = m_timer.elapsed();
+    m_control->metrics().stop();
+
+    emit operationReport(uringReport("save", transfer, totalBytes, m_lastOperationTime));
+    verifySaved(file.fileName(), data, hasher ? hasher->finish() : Checksums(), options);
+    finishSave(file.fileName());
+    emit stopWrite(false);
+    return true;
+}
+
+void FileWorker::saveCompressed(const QString &filePath, const ChunkBuffer &data, const TransferOptions &options)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        emit saveError(QString("Cannot open file for writing: %1").arg(file.errorString()));
+        return;
+    }
+
+    CompressedFile container(QThread::idealThreadCount());
+    qint64 totalBytes = data.size();
+
+    // Start timer
+    m_timer.start();
+    m_control->metrics().start();
+    emit startWrite(true);
+    emit setRotationDirection(false);
+    m_control->setProgress(0, totalBytes);
+    m_control->setStoredBytes(0);
+
+    QScopedPointer<StreamHasher> hasher(createHasher(options));
+    qint64 hashedBytes = 0;
+    QString error;
+
+    CompressedFile::Result result = container.write(file, data, *m_control,
+                                                    [&](qint64 logicalBytes, qint64 compressedBytes,
+                                                        qint64 contiguousBytes) {
+        hashRange(hasher.data(), data, hashedBytes, contiguousBytes);
+        hashedBytes = contiguousBytes;
+
+        // Published for the GUI to sample, no event per chunk
+        m_control->setStoredBytes(compressedBytes);
+        m_control->setProgress(logicalBytes);
+    }, &error);
+
+    file.close();
+
+    if (result == CompressedFile::Result::Cancelled) {
+        emit stopWrite(false);
+        emit cancelOperation_();
+        return;
+    }
+    if (result == CompressedFile::Result::Failed) {
+        emit saveError(QString("Error writing to file: %1").arg(error));
+        return;
+    }
+
+    // Record operation time
+    m_lastOperationTime = m_timer.elapsed();
+    m_control->metrics().stop();
+
+    emit operationReport(compressionReport("save", container, m_lastOperationTime));
+    verifySaved(filePath, data, hasher ? hasher->finish() : Checksums(), options);
+    finishSave(filePath);
+    emit stopWrite(false);
+}
+
+void FileWorker::saveDelta(const QString &filePath, const ChunkBuffer &data, const TransferOptions &options)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadWrite)) {
+        emit saveError(QString("Cannot open file for writing: %1").arg(file.errorString()));
+        return;
+    }
+
+    qint64 totalBytes = data.size();
+    int threadCount = options.readThreads > 0 ? options.readThreads : ParallelReader::threadCountFor(filePath);
+    DeltaWriter writer(threadCount);
+
+    // Start timer
+    m_timer.start();
+    m_control->metrics().start();
+    emit startWrite(true);
+    emit setRotationDirection(false);
+    m_control->setProgress(0, totalBytes);
+
+    QScopedPointer<StreamHasher> hasher(createHasher(options));
+    qint64 hashedBytes = 0;
+    QString error;
+
+    // Ranges finish out of order, the hasher follows the complete prefix
+    DeltaWriter::Result result = writer.write(file.handle(), data, *m_control,
+                                              [&](qint64 bytesDone, qint64 contiguousBytes) {
+        hashRange(hasher.data(), data, hashedBytes, contiguousBytes);
+        hashedBytes = contiguousBytes;
+
+        // Published for the GUI to sample, no event per chunk
+        m_control->setProgress(bytesDone);
+    }, &error);
+
+    file.close();
+
+    if (result == DeltaWriter::Result::Cancelled) {
+        if (hasher)
+            hasher->abort();
+        emit stopWrite(false);
+        emit cancelOperation_();
+        return;
+    }
+    if (result == DeltaWriter::Result::Failed) {
+        emit saveError(QString("Error writing to file: %1").arg(error));
+        return;
+    }
+
+    // The file is complete, a journal left by an interrupted save is moot
+    QFile::remove(TransferJournal::journalPath(filePath));
+
+    // Record operation time
+    m_lastOperationTime = m_timer.elapsed();
+    m_control->metrics().stop();
+
+    emit operationReport(deltaReport(writer));
+    verifySaved(filePath, data, hasher ? hasher->finish() : Checksums(), options);
+    finishSave(filePath);
+    emit stopWrite(false);
+}
+
+void FileWorker::saveSparse(const QString &filePath, const ChunkBuffer &data, const TransferOptions &options)
+{
+    // Truncated, so every byte that is not written stays a hole
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        emit saveError(QString("Cannot open file for writing: %1").arg(file.errorString()));
+        return;
+    }
+
+    qint64 totalBytes = data.size();
+    QVector<ChunkBuffer::Extent> extents = data.extents();
+    if (!data.isSparse() && totalBytes > 0)
+        extents = {ChunkBuffer::Extent{0, totalBytes}};
+    const qint64 requestSize = 4 * 1024 * 1024;
+
+    // Start timer
+    m_timer.start();
+    m_control->metrics().start();
+    emit startWrite(true);
+    emit setRotationDirection(false);
+    m_control->setProgress(0, totalBytes);
+
+    QScopedPointer<StreamHasher> hasher(createHasher(options));
+    QElapsedTimer syscallTimer;
+    qint64 hashedBytes = 0;
+    qint64 bytesWritten = 0;
+
+    for (const ChunkBuffer::Extent &extent : extents) {
+        qint64 offset = extent.offset;
+        qint64 end = extent.offset + extent.length;
+
+        while (offset < end) {
+            if (!m_control->checkpoint())
+            {
+                emit stopWrite(false);
+                emit cancelOperation_();
+                return;
+            }
+
+            int index = data.chunkIndex(offset);
+            qint64 inChunk = offset - data.chunkOffset(index);
+            const char *piece = data.chunkData(index) + inChunk;
+            qint64 length = qMin(qMin(requestSize, end - offset), data.chunkSize() - inChunk);
+
+            bool zeros = false;
+            if (options.punchZeros)
+                length = SparseFile::runLength(piece, offset, length, &zeros);
+
+            // Seeking past the end and writing there leaves a hole behind
+            if (!zeros) {
+                syscallTimer.start();
+                bool written = file.seek(offset) && file.write(piece, length) == length;
+                m_control->metrics().recordLatency(syscallTimer.nsecsElapsed());
+                if (!written) {
+                    file.close();
+                    emit saveError(QString("Error writing to file: %1").arg(file.errorString()));
+                    return;
+                }
+                bytesWritten += length;
+            }
+
+            offset += length;
+            hashRange(hasher.data(), data, hashedBytes, offset);
+            hashedBytes = offset;
+
+            // Published for the GUI to sample, no event per chunk
+            m_control->setProgress(offset);
+        }
+    }
+
+    // A hole at the end is made by the size alone
+    hashRange(hasher.data(), data, hashedBytes, totalBytes);
+    if (!file.resize(totalBytes)) {
+        file.close();
+        emit saveError(QString("Error writing to file: %1").arg(file.errorString()));
+        return;
+    }
+    file.close();
+
+    // Record operation time
+    m_lastOperationTime = m_timer.elapsed();
+    m_control->metrics().stop();
+
+    emit operationReport(sparseReport("save", bytesWritten, extents.size(), totalBytes));
+    verifySaved(filePath, data, hasher ? hasher->finish() : Checksums(), options);
+    finishSave(filePath);
     emit stopWrite(false);
-    m_start = false;
 }
 
-void FileWorker::cancelOperation()
-{    
-    if(m_start == false)
+bool FileWorker::saveFromSource(const QString &sourcePath, const QString &filePath, const ChunkBuffer &data,
+                                const TransferOptions &options, TransferJournal *journal, qint64 resumeOffset)
+{
+#ifdef Q_OS_LINUX
+    if (isSameFile(sourcePath, filePath))
+        return false;
+
+    int sourceFd = ::open(QFile::encodeName(sourcePath).constData(), O_RDONLY | O_CLOEXEC);
+    if (sourceFd < 0)
+        return false;
+
+    // A resumed save keeps the verified prefix
+    int destinationFd = ::open(QFile::encodeName(filePath).constData(),
+                               O_WRONLY | O_CREAT | O_CLOEXEC | (resumeOffset > 0 ? 0 : O_TRUNC), 0666);
+    if (destinationFd < 0) {
+        ::close(sourceFd);
+        return false; // let the regular path report the error
+    }
+
+    qint64 totalBytes = data.size();
+
+    // Start timer
+    m_timer.start();
+    m_control->metrics().start();
+    emit startWrite(true);
+    emit setRotationDirection(false);
+    m_control->setProgress(resumeOffset, totalBytes);
+
+    // 1. Reflink: shares the extents on CoW filesystems (btrfs, XFS), the
+    //    copy is a metadata operation regardless of the file size
+    if (!m_control->checkpoint())
+    {
+        ::close(sourceFd);
+        ::close(destinationFd);
+        emit stopWrite(false);
+        emit cancelOperation_();
+        return true;
+    }
+    bool copied = ::ioctl(destinationFd, FICLONE, sourceFd) == 0;
+    qint64 totalBytesWritten = copied ? totalBytes : resumeOffset;
+
+    // A clone is the whole file at once, the offset the journal kept from an
+    // earlier attempt is stale now
+    if (copied && journal) {
+        journal->remove();
+        journal = nullptr;
+    }
+
+    // The kernel moves the data, the journal sees it in memory
+    if (journal && !copied && !journal->begin(resumeOffset))
+        journal = nullptr;
+    auto recordJournal = [journal, &data, destinationFd](qint64 from, qint64 to, bool force) {
+        if (!journal)
+            return true;
+        visitRange(data, from, to, [journal](const char *piece, qint64 length) { journal->add(piece, length); });
+        return journal->checkpoint(destinationFd, force);
+    };
+
+    // 2. copy_file_range, then 3. sendfile: the data still moves, but only
+    //    inside the kernel. Both continue from the offset reached so far.
+    enum class Method { CopyFileRange, SendFile };
+    Method method = Method::CopyFileRange;
+    const qint64 chunkSize = 8 * 1024 * 1024; // 8 MB per call
+    QElapsedTimer syscallTimer;
+
+    while (!copied && totalBytesWritten < totalBytes) {
+        size_t bytesToCopy = static_cast<size_t>(qMin(chunkSize, totalBytes - totalBytesWritten));
+        off_t sourceOffset = static_cast<off_t>(totalBytesWritten);
+        ssize_t bytesCopied;
+
+        syscallTimer.start();
+        if (method == Method::CopyFileRange) {
+            off_t destinationOffset = sourceOffset;
+            bytesCopied = ::copy_file_range(sourceFd, &sourceOffset, destinationFd, &destinationOffset,
+                                            bytesToCopy, 0);
+        } else {
+            if (::lseek(destinationFd, sourceOffset, SEEK_SET) < 0)
+                bytesCopied = -1;
+            else
+                bytesCopied = ::sendfile(destinationFd, sourceFd, &sourceOffset, bytesToCopy);
+        }
+        m_control->metrics().recordLatency(syscallTimer.nsecsElapsed());
+
+        if (bytesCopied < 0) {
+            int error = errno;
+            if (error == EINTR)
+                continue;
+
+            bool unsupported = error == ENOSYS || error == EXDEV || error == EINVAL
+                               || error == EOPNOTSUPP || error == EBADF;
+            if (unsupported && method == Method::CopyFileRange) {
+                method = Method::SendFile;
+                continue;
+            }
+
+            recordJournal(totalBytesWritten, totalBytesWritten, true);
+            ::close(sourceFd);
+            ::close(destinationFd);
+            if (unsupported && totalBytesWritten == resumeOffset) {
+                // Nothing was written yet, the caller falls back to write()
+                return false;
+            }
+
+            emit saveError(QString("Error writing to file: %1").arg(qt_error_string(error)));
+            emit stopWrite(false);
+            return true;
+        }
+
+        if (bytesCopied == 0) {
+            // The source shrank after it was read
+            ::close(sourceFd);
+            ::close(destinationFd);
+            emit saveError("Error writing to file: source file changed during the copy.");
+            emit stopWrite(false);
+            return true;
+        }
+
+        if (!recordJournal(totalBytesWritten, totalBytesWritten + bytesCopied, false)) {
+            int error = errno;
+            ::close(sourceFd);
+            ::close(destinationFd);
+            emit saveError(QString("Error writing to file: %1").arg(qt_error_string(error)));
+            emit stopWrite(false);
+            return true;
+        }
+
+        if (!m_control->checkpoint())
+        {
+            recordJournal(totalBytesWritten + bytesCopied, totalBytesWritten + bytesCopied, true);
+            ::close(sourceFd);
+            ::close(destinationFd);
+            emit stopWrite(false);
+            emit cancelOperation_();
+            return true;
+        }
+
+        totalBytesWritten += bytesCopied;
+
+        // Published for the GUI to sample, no event per chunk
+        m_control->setProgress(totalBytesWritten);
+    }
+
+    if (copied)
+        m_control->setProgress(totalBytes);
+
+    ::close(sourceFd);
+    if (::close(destinationFd) != 0) {
+        int error = errno;
+        emit saveError(QString("Error writing to file: %1").arg(qt_error_string(error)));
+        emit stopWrite(false);
+        return true;
+    }
+    if (journal)
+        journal->remove();
+
+    // Record operation time
+    m_lastOperationTime = m_timer.elapsed();
+    m_control->metrics().stop();
+
+    verifySaved(filePath, data, Checksums(), options);
+    finishSave(filePath);
+    emit stopWrite(false);
+    return true;
+#else
+    Q_UNUSED(sourcePath);
+    Q_UNUSED(filePath);
+    Q_UNUSED(data);
+    Q_UNUSED(options);
+    Q_UNUSED(journal);
+    Q_UNUSED(resumeOffset);
+    return false;
+#endif
+}
+
+void FileWorker::streamCopy(const QString &sourcePath, const QString &filePath, const TransferOptions &options,
+                            const QSharedPointer<OperationControl> &control)
+{
+    beginOperation(control);
+
+    QFile source(sourcePath);
+    if (!source.exists()) {
+        emit saveError("Source file does not exist.");
         return;
+    }
+    if (isSameFile(sourcePath, filePath)) {
+        emit saveError("Source and destination are the same file.");
+        return;
+    }
+    if (!source.open(QIODevice::ReadOnly)) {
+        emit saveError(QString("Cannot open file for reading: %1").arg(source.errorString()));
+        return;
+    }
+
+    qint64 totalBytes = source.size();
+
+    // Continues an interrupted copy of the same, unchanged source
+    TransferJournal journal(filePath, totalBytes, TransferJournal::fileIdentity(sourcePath));
+    bool journaled = options.resumable && TransferJournal::isUseful(totalBytes);
+    qint64 resumeOffset = 0;
+    if (journaled) {
+        resumeOffset = journal.resumableBytes(*m_control);
+        if (resumeOffset < 0) {
+            emit cancelOperation_();
+            return;
+        }
+        if (resumeOffset > 0)
+            emit operationReport(resumeReport(resumeOffset, totalBytes));
+    } else {
+        journal.remove();
+    }
+
+    QFile file(filePath);
+    if (!file.open(resumeOffset > 0 ? QIODevice::ReadWrite : QIODevice::WriteOnly)
+        || !file.seek(resumeOffset) || !source.seek(resumeOffset)) {
+        emit saveError(QString("Cannot open file for writing: %1").arg(file.errorString()));
+        return;
+    }
+    if (journaled)
+        journaled = journal.begin(resumeOffset);
+
+    // Start timer
+    m_timer.start();
+    m_control->metrics().start();
+    emit startWrite(true);
+    emit setRotationDirection(true);
+    m_control->setProgress(resumeOffset, totalBytes);
 
-    m_stop = true;
-    qDebug() << m_stop;
+    // Reader stage on its own thread, writer stage here. Memory use is fixed
+    // by the ring, however big the file is.
+    const int bufferCount = 8;
+    const qint64 bufferSize = 4 * 1024 * 1024; // 4 MB buffers
+    BufferRing ring(bufferCount, bufferSize);
+    QString readErrorString;
+
+    // The reader hashes what it reads for the verification: the ring hands
+    // a buffer back for refilling as soon as it is written, too early for a
+    // StreamHasher. A resumed copy hashes the kept prefix of the source first.
+    QScopedPointer<ChecksumCalculator> calculator(
+        options.checksums ? new ChecksumCalculator(Checksums::available(options.sha256)) : nullptr);
+    ChecksumCalculator *hashing = calculator.data();
+    const OperationControl *readControl = m_control.data();
+
+    QThread *reader = QThread::create([&source, &ring, &readErrorString, hashing, readControl, resumeOffset]() {
+        if (hashing && resumeOffset > 0 && !hashPrefix(source, resumeOffset, *hashing, *readControl)) {
+            if (!readControl->isCancelled())
+                readErrorString = source.errorString();
+            ring.abort();
+            return;
+        }
+        while (char *buffer = ring.acquireFree()) {
+            qint64 bytesRead = source.read(buffer, ring.bufferSize());
+            if (bytesRead < 0) {
+                readErrorString = source.errorString();
+                ring.abort();
+                return;
+            }
+            if (bytesRead == 0)
+                break;
+            if (hashing)
+                hashing->update(buffer, bytesRead);
+            ring.commitFilled(bytesRead);
+        }
+        ring.finish();
+    });
+    reader->start();
+
+    qint64 totalBytesWritten = resumeOffset;
+    qint64 buffersWritten = 0;
+    quint64 lastProducerWaits = 0;
+    quint64 lastConsumerWaits = 0;
+    bool readBound = true;
+    QString writeErrorString;
+    bool cancelled = false;
+
+    QElapsedTimer syscallTimer;
+
+    qint64 size = 0;
+    while (const char *buffer = ring.acquireFilled(&size)) {
+        syscallTimer.start();
+        qint64 bytesWritten = file.write(buffer, size);
+        m_control->metrics().recordLatency(syscallTimer.nsecsElapsed());
+
+        // The reader refills the buffer once it is released
+        if (journaled && bytesWritten == size)
+            journal.add(buffer, bytesWritten);
+        ring.releaseFilled();
+        if (bytesWritten != size) {
+            writeErrorString = file.errorString();
+            break;
+        }
+
+        if (journaled && !checkpointJournal(journal, file)) {
+            writeErrorString = qt_error_string();
+            break;
+        }
+
+        if (!m_control->checkpoint())
+        {
+            cancelled = true;
+            break;
+        }
+
+        totalBytesWritten += bytesWritten;
+
+        // Published for the GUI to sample, no event per chunk
+        m_control->setProgress(totalBytesWritten, qMax(totalBytes, totalBytesWritten));
+
+        // Spin the cube the way of the slower stage: clockwise while the
+        // writer waits for data, counterclockwise while the reader waits for
+        // free buffers. Judged over a full turn of the ring.
+        if (++buffersWritten % bufferCount == 0) {
+            quint64 producerWaits = ring.producerWaits();
+            quint64 consumerWaits = ring.consumerWaits();
+            if (producerWaits != lastProducerWaits || consumerWaits != lastConsumerWaits) {
+                bool nowReadBound = consumerWaits - lastConsumerWaits >= producerWaits - lastProducerWaits;
+                if (nowReadBound != readBound) {
+                    readBound = nowReadBound;
+                    emit setRotationDirection(readBound);
+                }
+                lastProducerWaits = producerWaits;
+                lastConsumerWaits = consumerWaits;
+            }
+        }
+    }
+
+    ring.abort();
+    reader->wait();
+    delete reader;
+
+    // The reader may have stopped for the cancel before a buffer was written
+    cancelled = cancelled || m_control->isCancelled();
+
+    // What reached the disk stays resumable, a complete copy needs no journal
+    bool complete = !cancelled && writeErrorString.isEmpty() && readErrorString.isEmpty();
+    if (journaled && !complete)
+        checkpointJournal(journal, file, true);
+    source.close();
+    file.close();
+    if (complete)
+        journal.remove();
+
+    if (cancelled) {
+        emit stopWrite(false);
+        emit cancelOperation_();
+        return;
+    }
+
+    if (!writeErrorString.isEmpty()) {
+        emit saveError(QString("Error writing to file: %1").arg(writeErrorString));
+        emit stopWrite(false);
+        return;
+    }
+    if (!readErrorString.isEmpty()) {
+        emit saveError(QString("Error reading file: %1").arg(readErrorString));
+        emit stopWrite(false);
+        return;
+    }
+
+    // Record operation time
+    m_lastOperationTime = m_timer.elapsed();
+    m_control->metrics().stop();
+
+    // No buffer holds a source digest, the copy is checked against what
+    // the reader hashed
+    verifySaved(filePath, ChunkBuffer(), calculator ? calculator->result() : Checksums(), options);
+    finishSave(filePath);
+    emit stopWrite(false);
+}
+
+void FileWorker::analyzeInBackground(StreamHasher *hasher, const ChunkBuffer &data)
+{
+    // The statistics take longer than the digests, readFinished does not
+    // wait for them. The thread holds data, the analysed chunks stay valid.
+    int id = m_nextAnalysis++;
+    QSharedPointer<StreamHasher> analyzer(hasher);
+    QThread *thread = QThread::create([this, analyzer, data, id]() {
+        ByteStatistics statistics;
+        if (analyzer->finishAnalysis(&statistics))
+            emit contentAnalyzed(statistics, id);
+    });
+    connect(thread, &QThread::finished, this, [this, id]() {
+        Analysis analysis = m_analyses.take(id);
+        delete analysis.thread;
+    });
+    m_analyses.insert(id, {thread, analyzer});
+    emit analysisStarted(id);
+    thread->start();
+}
+
+void FileWorker::finishSave(const QString &filePath)
+{
+    if (!m_replacePath.isEmpty()) {
+        // Atomic where rename() may replace an existing file
+        QByteArray from = QFile::encodeName(filePath);
+        QByteArray to = QFile::encodeName(m_replacePath);
+        if (std::rename(from.constData(), to.constData()) != 0
+            && !(QFile::remove(m_replacePath) && QFile::rename(filePath, m_replacePath))) {
+            emit saveError(QString("Cannot replace %1: %2").arg(QDir::toNativeSeparators(m_replacePath),
+                                                               qt_error_string()));
+            return;
+        }
+    }
+    emit saveFinished();
+}
+
+void FileWorker::verifySaved(const QString &filePath, const ChunkBuffer &data, const Checksums &written,
+                             const TransferOptions &options)
+{
+    if (!written.isEmpty())
+        emit checksumsComputed("Save", written);
+
+    // Compare against the source file's digest when the data was read from
+    // one, so a buffer changed in memory is caught as well
+    Checksums expected = data.checksums().isEmpty() ? written : data.checksums();
+    if (!options.verifyAfterSave || expected.isEmpty())
+        return;
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        emit saveVerified(false, QString("Cannot open the saved file: %1").arg(file.errorString()));
+        return;
+    }
+
+    // Read back through the page cache, which is what other readers will see
+    ChecksumCalculator calculator(expected.algorithms);
+
+    // A compressed file is checked by what it decompresses to
+    if (options.compress) {
+        CompressedFile container(1);
+        QString error;
+        if (!container.open(filePath, &error)) {
+            emit saveVerified(false, QString("Cannot read the saved file: %1").arg(error));
+            return;
+        }
+        for (int index = 0; index < container.blockCount(); ++index) {
+            if (m_control->isCancelled())
+                return;
+            QByteArray block = container.readBlock(file, index, &error);
+            if (block.isNull()) {
+                emit saveVerified(false, QString("Error reading the saved file: %1").arg(error));
+                return;
+            }
+            calculator.update(block.constData(), block.size());
+        }
+    } else {
+        QByteArray buffer(4 * 1024 * 1024, Qt::Uninitialized);
+        qint64 bytesRead;
+        while ((bytesRead = file.read(buffer.data(), buffer.size())) > 0) {
+            if (m_control->isCancelled())
+                return;
+            calculator.update(buffer.constData(), bytesRead);
+        }
+        if (bytesRead < 0) {
+            emit saveVerified(false, QString("Error reading the saved file: %1").arg(file.errorString()));
+            return;
+        }
+    }
+
+    Checksums actual = calculator.result();
+    bool matches = actual.matches(expected);
+    QString details = matches ? actual.toString()
+                              : QString("expected %1, found %2").arg(expected.toString(), actual.toString());
+    if (!written.isEmpty() && !data.checksums().isEmpty() && !written.matches(data.checksums()))
+        details += " (the data in memory differs from its source)";
+    emit saveVerified(matches, details);
+}
+
+void FileWorker::beginOperation(const QSharedPointer<OperationControl> &control)
+{
+    // Callers that do not want to pause or cancel may pass no control block
+    m_control = control ? control : QSharedPointer<OperationControl>::create();
+}
+
+bool FileWorker::isSameFile(const QString &sourcePath, const QString &filePath)
+{
+    QString source = QFileInfo(sourcePath).canonicalFilePath();
+    return !source.isEmpty() && source == QFileInfo(filePath).canonicalFilePath();
 }
 
 qint64 FileWorker::getLastOperationTime() const
@@ -1,8 +1,20 @@
 #pragma once
 
 #include <QObject>
-#include <QByteArray>
 #include <QElapsedTimer>
+#include <QHash>
+#include <QSharedPointer>
+#include "byteanalyzer.h"
+#include "chunkbuffer.h"
+#include "operationcontrol.h"
+#include "transferoptions.h"
+
+class QFile;
+class QFileInfo;
+class QIODevice;
+class QThread;
+class StreamHasher;
+class TransferJournal;
 
 class FileWorker : public QObject
 {
@@ -10,17 +22,30 @@ class FileWorker : public QObject
 
 public:
     explicit FileWorker(QObject *parent = nullptr);
-    
+    ~FileWorker() override;
+
     qint64 getLastOperationTime() const;
 
+    // True when both paths name one existing file, links and ".." resolved.
+    // Copying a file onto itself would truncate it before it is read.
+    static bool isSameFile(const QString &sourcePath, const QString &filePath);
+
 public slots:
-    void readFile(const QString &filePath);
-    void saveFile(const QString &filePath, const QByteArray &data);
-    void cancelOperation();
+    // Each operation is paused and cancelled through its control block
+    void readFile(const QString &filePath, const TransferOptions &options = TransferOptions(),
+                  const QSharedPointer<OperationControl> &control = QSharedPointer<OperationControl>());
+    void saveFile(const QString &filePath, const ChunkBuffer &data,
+                  const TransferOptions &options = TransferOptions(),
+                  const QSharedPointer<OperationControl> &control = QSharedPointer<OperationControl>());
+
+    // Copies sourcePath to filePath without loading it, reading and writing
+    // at the same time through a small ring of buffers
+    void streamCopy(const QString &sourcePath, const QString &filePath,
+                    const TransferOptions &options = TransferOptions(),
+                    const QSharedPointer<OperationControl> &control = QSharedPointer<OperationControl>());
 
 signals:
-    void readProgress(qint64 bytesRead, qint64 totalBytes);
-    void readFinished(const QByteArray &data);
+    void readFinished(const ChunkBuffer &data);
     void readError(const QString &error);
 
     void startRead(const bool start);
@@ -29,17 +54,93 @@ signals:
     void stopWrite(const bool start);
     void setRotationDirection(const bool direction);
     
-    void saveProgress(qint64 bytesWritten, qint64 totalBytes);
     void saveFinished();
     void saveError(const QString &error);
 
     void cancelOperation_();
 
+    // Human readable summary of how an operation went (backend, throughput)
+    void operationReport(const QString &report);
+
+    // Digests of the bytes read or written, operation is "Read" or "Save"
+    void checksumsComputed(const QString &operation, const Checksums &checksums);
+
+    // With TransferOptions::analyzeContent, a read sends analysisStarted
+    // before readFinished. The byte statistics are computed in the
+    // background and follow later in contentAnalyzed with the same id,
+    // possibly while the next operation runs.
+    void analysisStarted(int analysis);
+    void contentAnalyzed(const ByteStatistics &statistics, int analysis);
+
+    // Result of re-reading a saved file, sent before saveFinished
+    void saveVerified(bool matches, const QString &details);
+
 private:
+    void beginOperation(const QSharedPointer<OperationControl> &control);
+
+    // An empty buffer for a read of size bytes, of which dataBytes take
+    // memory (all by default). Beyond options.memoryBudget its chunks live in
+    // a SpillFile instead of the heap.
+    ChunkBuffer createBuffer(qint64 size, const TransferOptions &options, qint64 dataBytes = -1);
+
+    // Returns true when the whole file was read
+    bool readBuffered(QIODevice &file, const QFileInfo &fileInfo, const TransferOptions &options);
+    void readMapped(const QFileInfo &fileInfo, const TransferOptions &options);
+
+    // Decompresses a file saved with options.compress, blocks in parallel
+    void readCompressed(const QFileInfo &fileInfo, const TransferOptions &options);
+
+    // Reads only the data extents of a sparse file, holes become shared zeros
+    void readSparse(QFile &file, const QFileInfo &fileInfo, const TransferOptions &options,
+                    const QVector<ChunkBuffer::Extent> &extents);
+
+    // io_uring variants, return false without side effects when the ring
+    // cannot be set up so the caller can use the QFile path instead
+    bool readUring(QFile &file, const QFileInfo &fileInfo, const TransferOptions &options);
+    bool saveUring(QFile &file, const ChunkBuffer &data, const TransferOptions &options);
+
+    // Reads a large file with threadCount concurrent pread workers
+    void readParallel(QFile &file, const QFileInfo &fileInfo, const TransferOptions &options, int threadCount);
+
+    // Saves data as a CompressedFile container, blocks compressed in parallel
+    void saveCompressed(const QString &filePath, const ChunkBuffer &data, const TransferOptions &options);
+
+    // Saves data over an existing file, rewriting only the blocks that changed
+    void saveDelta(const QString &filePath, const ChunkBuffer &data, const TransferOptions &options);
+
+    // Saves data with its holes, and with options.punchZeros its zero
+    // blocks, left out of the file
+    void saveSparse(const QString &filePath, const ChunkBuffer &data, const TransferOptions &options);
+
+    // Re-creates data at filePath by having the kernel copy its source file,
+    // from resumeOffset on. Returns false, having written nothing, when no
+    // kernel method applies.
+    bool saveFromSource(const QString &sourcePath, const QString &filePath, const ChunkBuffer &data,
+                        const TransferOptions &options, TransferJournal *journal, qint64 resumeOffset);
+
+    // Takes over hasher and finishes its analysis on a thread of its own
+    void analyzeInBackground(StreamHasher *hasher, const ChunkBuffer &data);
+
+    // Emits saveFinished for a save that wrote filePath, after moving it over
+    // m_replacePath when the save went to a temporary file
+    void finishSave(const QString &filePath);
+
+    // Re-reads a saved file and compares it with the source or written digest
+    void verifySaved(const QString &filePath, const ChunkBuffer &data, const Checksums &written,
+                     const TransferOptions &options);
+
     QElapsedTimer m_timer;
     qint64 m_lastOperationTime;
-    bool m_stop;
-    bool m_start;
+    QSharedPointer<OperationControl> m_control;
+    QString m_replacePath;  // replaced by the running save's temporary file, see saveFile
+
+    struct Analysis
+    {
+        QThread *thread;
+        QSharedPointer<StreamHasher> hasher;
+    };
+    QHash<int, Analysis> m_analyses;    // by id, see analysisStarted
+    int m_nextAnalysis;
 };
 
 
@@ -3,10 +3,18 @@
 #include <QMouseEvent>
 #include <QOpenGLShaderProgram>
 #include <QCoreApplication>
+#include <QWindow>
 #include <math.h>
 
 bool GLWidget::m_transparent = false;
 
+// Spin model: the velocity approaches the target exponentially, faster
+// when speeding up than when coasting down
+static const float SpinUpSeconds = 0.35f;
+static const float SpinDownSeconds = 0.8f;
+static const float RestVelocity = 0.5f;         // degrees per second, a stopping cube is at rest below
+static const float MaxFrameSeconds = 0.1f;      // longer gaps, e.g. a stalled GUI, are stepped as this
+
 void GLWidget::initCubeGeometry(float width)
 {
     float width_div_2 = width / 2.0f;
@@ -72,11 +80,13 @@ GLWidget::GLWidget(QWidget *parent)
     : QOpenGLWidget(parent)
     , m_indexBuf(QOpenGLBuffer::IndexBuffer)
     , m_program(nullptr)
-    , m_timer(new QTimer(this))
     , m_rotationAngle(0.0f)
-    , m_rotationSpeed(1.0f)
+    , m_rotationSpeed(30.0f)
+    , m_angularVelocity(0.0f)
+    , m_throughputFactor(1.0f)
     , m_rotationDirection(false) // counterclockwise by default // против часовой стрелки
     , m_isRunning(false)
+    , m_isPaused(false)
 {
     m_core = QSurfaceFormat::defaultFormat().profile() == QSurfaceFormat::CoreProfile;
     qDebug() << m_core;
@@ -87,8 +97,9 @@ GLWidget::GLWidget(QWidget *parent)
         setFormat(fmt);
     }
 
-    m_timer->setInterval(16); // ~60 FPS
-    connect(m_timer, &QTimer::timeout, this, &GLWidget::updateRotation);
+    // Frames are paced by the display, not by a timer, and only requested
+    // while the cube moves
+    connect(this, &QOpenGLWidget::frameSwapped, this, &GLWidget::advanceAnimation);
 }
 
 GLWidget::~GLWidget()
@@ -308,25 +319,27 @@ void GLWidget::setRunning(bool running)
 {
     if (m_isRunning != running) {
         m_isRunning = running;
-        if (m_isRunning) {
-            m_timer->start();
+        m_isPaused = false;
+        if (m_isRunning)
             emit rotationStarted();
-        } else {
-            m_timer->stop();
+        else
             emit rotationStopped();
-        }
+        // A stopped cube coasts to rest instead of stopping dead
+        animate();
     }
 }
 
 void GLWidget::setRotationSpeed(int speed)
 {
-    // Map slider value (0-100) to rotation speed (0.0-5.0)
-    m_rotationSpeed = speed * 0.05f;
+    // Map slider value (0-100) to rotation speed (0-150 degrees per second)
+    m_rotationSpeed = speed * 1.5f;
+    animate();
 }
 
 void GLWidget::setRotationDirection(bool clockwise)
 {
     m_rotationDirection = clockwise;
+    animate();
 }
 
 void GLWidget::resetRotation()
@@ -335,20 +348,83 @@ void GLWidget::resetRotation()
     update();
 }
 
-void GLWidget::updateRotation()
+void GLWidget::setPaused(bool paused)
 {
-    if (m_isRunning)
-    {
-        float delta = m_rotationSpeed * 0.5f; // Scale factor for reasonable speed
-        if (m_rotationDirection) {
-            m_rotationAngle += delta; // Clockwise
-        } else {
-            m_rotationAngle -= delta; // Counterclockwise
-        }
-        // Keep angle in [0, 360) range
-        if (m_rotationAngle >= 360.0f) m_rotationAngle -= 360.0f;
-        if (m_rotationAngle < 0.0f) m_rotationAngle += 360.0f;
+    if (m_isPaused == paused)
+        return;
 
-        update();
+    // Slows down to rest while paused and spins up again after
+    m_isPaused = paused;
+    animate();
+}
+
+void GLWidget::setThroughput(double megabytesPerSecond)
+{
+    // Logarithmic, so 10 MB/s still turns and 3 GB/s does not blur: about
+    // 0.35 at 10 MB/s, 0.67 at 100 MB/s and 1 at 1 GB/s
+    if (megabytesPerSecond < 0.0)
+        m_throughputFactor = 1.0f;
+    else
+        m_throughputFactor = qBound(0.2f, static_cast<float>(log10(1.0 + megabytesPerSecond) / 3.0), 1.5f);
+    animate();
+}
+
+void GLWidget::showEvent(QShowEvent *event)
+{
+    QOpenGLWidget::showEvent(event);
+
+    // Restored from minimized, frames were not scheduled while it was
+    if (QWindow *window = this->window()->windowHandle())
+        connect(window, &QWindow::windowStateChanged, this, &GLWidget::animate, Qt::UniqueConnection);
+    animate();
+}
+
+float GLWidget::targetVelocity() const
+{
+    if (!m_isRunning || m_isPaused)
+        return 0.0f;
+    float speed = m_rotationSpeed * m_throughputFactor;
+    return m_rotationDirection ? speed : -speed;
+}
+
+bool GLWidget::isOnScreen() const
+{
+    QWindow *window = this->window()->windowHandle();
+    return isVisible() && window && window->isExposed() && !(window->windowState() & Qt::WindowMinimized);
+}
+
+void GLWidget::animate()
+{
+    bool moving = m_angularVelocity != 0.0f || targetVelocity() != 0.0f;
+    if (!moving || !isOnScreen()) {
+        // Nothing is rendered until something changes, a hidden cube resumes
+        // without a jump when it is shown again
+        m_frameClock.invalidate();
+        return;
+    }
+
+    if (!m_frameClock.isValid())
+        m_frameClock.start();
+    update();
+}
+
+void GLWidget::advanceAnimation()
+{
+    // Also reached by repaints while idle, e.g. when the window is exposed again
+    if (m_frameClock.isValid()) {
+        float dt = qMin(m_frameClock.nsecsElapsed() / 1e9f, MaxFrameSeconds);
+        m_frameClock.restart();
+
+        float target = targetVelocity();
+        float timeConstant = qAbs(target) > qAbs(m_angularVelocity) ? SpinUpSeconds : SpinDownSeconds;
+        m_angularVelocity += (target - m_angularVelocity) * (1.0f - expf(-dt / timeConstant));
+        if (target == 0.0f && qAbs(m_angularVelocity) < RestVelocity)
+            m_angularVelocity = 0.0f;
+
+        // Keep angle in [0, 360) range
+        m_rotationAngle = fmodf(m_rotationAngle + m_angularVelocity * dt, 360.0f);
+        if (m_rotationAngle < 0.0f)
+            m_rotationAngle += 360.0f;
     }
+    animate();
 }
@@ -7,7 +7,7 @@
 #include <QOpenGLBuffer>
 #include <QOpenGLContext>
 #include <QMatrix4x4>
-#include <QTimer>
+#include <QElapsedTimer>
 
 struct VertexData
 {
@@ -47,6 +47,10 @@ public slots:
     void setRotationSpeed(int speed);
     void setRotationDirection(bool clockwise);
     void resetRotation();
+    void setPaused(bool paused);
+
+    // Scales the spin with the live transfer rate, negative when unknown
+    void setThroughput(double megabytesPerSecond);
 
 
 signals:
@@ -66,12 +70,19 @@ protected:
     void resizeGL(int width, int height) override;
     void mousePressEvent(QMouseEvent *event) override;
     void mouseMoveEvent(QMouseEvent *event) override;
+    void showEvent(QShowEvent *event) override;
 
 private slots:
-    void updateRotation();
+    // Schedules the next frame while the cube moves and can be seen
+    void animate();
+
+    // Steps the rotation by the real time since the last frame, on frameSwapped
+    void advanceAnimation();
 
 private:
     void setupVertexAttribs();
+    float targetVelocity() const;
+    bool isOnScreen() const;
 
     bool m_core;
     int m_xRot = 0;
@@ -97,12 +108,15 @@ private:
     QOpenGLBuffer m_arrayBuf;
     QOpenGLBuffer m_indexBuf;
 
-    QTimer *m_timer;
-    // Rotation parameters
+    // Rotation parameters, angles in degrees
+    QElapsedTimer m_frameClock;   // since the last step, invalid while no frames are scheduled
     float m_rotationAngle;
-    float m_rotationSpeed ;
+    float m_rotationSpeed;        // degrees per second at full speed, from the slider
+    float m_angularVelocity;      // degrees per second, positive is clockwise
+    float m_throughputFactor;     // from setThroughput(), 1 when unknown
     bool m_rotationDirection; // true = clockwise, false = counterclockwise
     bool m_isRunning;
+    bool m_isPaused;
 };
 
 
@@ -0,0 +1,390 @@
+#include "headlessrunner.h"
+#include "fileworker.h"
+#include "jobscheduler.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <csignal>
+#include <cstdio>
+
+namespace {
+// Set from the signal handler, turned into a cancel by the progress timer
+volatile std::sig_atomic_t interruptRequested = 0;
+
+// Which failure the exit code reports when jobs end differently
+int severity(HeadlessRunner::ExitCode code)
+{
+    switch (code) {
+    case HeadlessRunner::Success:
+        return 0;
+    case HeadlessRunner::Cancelled:
+        return 1;
+    case HeadlessRunner::VerifyFailed:
+        return 2;
+    default:
+        return 3;
+    }
+}
+
+#ifdef Q_OS_UNIX
+void requestInterrupt(int)
+{
+    interruptRequested = 1;
+}
+#endif
+}
+
+HeadlessRunner::HeadlessRunner(QObject *parent)
+    : QObject(parent)
+    , m_scheduler(nullptr)
+    , m_printProgress(true)
+    , m_cancelRequested(false)
+    , m_exitCode(Success)
+{
+    connect(&m_progressTimer, &QTimer::timeout, this, &HeadlessRunner::printProgress);
+}
+
+HeadlessRunner::~HeadlessRunner()
+{
+    // The scheduler cancels what is still running
+    delete m_scheduler;
+}
+
+bool HeadlessRunner::isRequested(int argc, char *argv[])
+{
+    for (int index = 1; index < argc; ++index) {
+        QByteArray argument(argv[index]);
+        if (argument == "--headless" || argument == "--read" || argument == "--copy")
+            return true;
+    }
+    return false;
+}
+
+int HeadlessRunner::exec(const QStringList &arguments)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Reads or copies files through FileWorker without the GUI.\n"
+                                     "  --read <source> [<source>...]\n"
+                                     "  --copy <source> <destination> [<source> <destination>...]\n"
+                                     "Each file is a job, up to --jobs of them run at the same time.");
+    QCommandLineOption helpOption = parser.addHelpOption();
+    QCommandLineOption headlessOption("headless", "Run without the GUI (implied by --read and --copy).");
+    QCommandLineOption readOption("read", "Read the source files into memory.");
+    QCommandLineOption copyOption("copy", "Read each source file, then save it to its destination.");
+    QCommandLineOption streamOption("stream", "With --copy: stream through a buffer ring instead of loading the file.");
+    QCommandLineOption chunkOption("chunk", "Fixed QFile request size, e.g. 4M (default: tuned per device).", "size");
+    QCommandLineOption modeOption("mode", "Read mode: buffered or mapped.", "mode", "buffered");
+    QCommandLineOption backendOption("backend", "I/O backend: blocking or uring.", "backend", "blocking");
+    QCommandLineOption queueDepthOption("queue-depth", "io_uring requests in flight.", "count", "32");
+    QCommandLineOption blockSizeOption("block-size", "io_uring request size.", "size", "1M");
+    QCommandLineOption threadsOption("threads", "Parallel read workers for large files, 0 = by device type.", "count", "0");
+    QCommandLineOption noCacheOption("no-cache", "Bypass the page cache (O_DIRECT or fadvise).");
+    QCommandLineOption noChecksumsOption("no-checksums", "Do not compute checksums or verify the saved file.");
+    QCommandLineOption sha256Option("sha256", "Also compute SHA-256.");
+    QCommandLineOption noVerifyOption("no-verify", "Do not re-read and verify the saved file.");
+    QCommandLineOption noResumeOption("no-resume", "Always start over, without a journal next to the destination.");
+    QCommandLineOption deltaOption("delta", "Rewrite only the blocks that differ when the destination exists.");
+    QCommandLineOption punchZerosOption("punch-zeros", "Leave runs of zeros out of saved files as holes.");
+    QCommandLineOption compressOption("compress", "Save block-compressed, zstd when available, zlib otherwise.");
+    QCommandLineOption noAnalyzeOption("no-analyze", "Do not compute byte statistics of read files.");
+    QCommandLineOption memoryBudgetOption("memory-budget", "Reads past it spill to disk, shared by all jobs, 0 = half the RAM.",
+                                          "size|unlimited", "0");
+    QCommandLineOption spillDirOption("spill-dir", "Directory for spill files, the cache directory by default.", "dir");
+    QCommandLineOption jobsOption("jobs", "Jobs running at the same time.", "count",
+                                  QString::number(JobScheduler::DefaultWorkerCount));
+    QCommandLineOption deviceLimitOption("per-device", "Jobs running at the same time on one device.", "count",
+                                         QString::number(JobScheduler::DefaultDeviceLimit));
+    QCommandLineOption intervalOption("progress-interval", "Milliseconds between progress lines, 0 for none.", "ms", "500");
+    parser.addOptions({headlessOption, readOption, copyOption, streamOption, chunkOption, modeOption,
+                       backendOption, queueDepthOption, blockSizeOption, threadsOption, noCacheOption, noChecksumsOption,
+                       sha256Option, noVerifyOption, noResumeOption, deltaOption, punchZerosOption, compressOption,
+                       noAnalyzeOption, memoryBudgetOption, spillDirOption, jobsOption, deviceLimitOption, intervalOption});
+
+    if (!parser.parse(arguments)) {
+        fprintf(stderr, "%s\n", qPrintable(parser.errorText()));
+        return UsageError;
+    }
+    if (parser.isSet(helpOption)) {
+        fprintf(stdout, "%s", qPrintable(parser.helpText()));
+        return Success;
+    }
+
+    QStringList paths = parser.positionalArguments();
+    bool copy = parser.isSet(copyOption);
+    if (copy == parser.isSet(readOption) || paths.isEmpty() || (copy && paths.size() % 2 != 0)) {
+        fprintf(stderr, "Expected --read <source>... or --copy <source> <destination>...\n");
+        return UsageError;
+    }
+    bool stream = copy && parser.isSet(streamOption);
+    TransferOptions options;
+
+    QString error;
+    for (int index = 0; copy && index + 1 < paths.size(); index += 2) {
+        if (FileWorker::isSameFile(paths.at(index), paths.at(index + 1)))
+            error = QString("Cannot copy %1 onto itself").arg(paths.at(index));
+    }
+    if (parser.isSet(chunkOption)) {
+        bool ok = false;
+        options.chunkSize = TransferOptions::parseSize(parser.value(chunkOption), &ok);
+        if (!ok)
+            error = "Invalid --chunk";
+    }
+
+    QString mode = parser.value(modeOption);
+    if (mode == "mapped")
+        options.readMode = TransferOptions::ReadMode::Mapped;
+    else if (mode != "buffered")
+        error = "Invalid --mode";
+
+    QString backend = parser.value(backendOption);
+    if (backend == "uring")
+        options.ioBackend = TransferOptions::IoBackend::IoUring;
+    else if (backend != "blocking")
+        error = "Invalid --backend";
+
+    bool ok = false;
+    options.queueDepth = parser.value(queueDepthOption).toInt(&ok);
+    if (!ok || options.queueDepth <= 0)
+        error = "Invalid --queue-depth";
+    options.blockSize = TransferOptions::parseSize(parser.value(blockSizeOption), &ok);
+    if (!ok || options.blockSize <= 0 || ChunkBuffer::DefaultChunkSize % options.blockSize != 0)
+        error = "Invalid --block-size, it has to divide 16M";
+    options.readThreads = parser.value(threadsOption).toInt(&ok);
+    if (!ok || options.readThreads < 0)
+        error = "Invalid --threads";
+    options.bypassCache = parser.isSet(noCacheOption);
+    options.checksums = !parser.isSet(noChecksumsOption);
+    options.sha256 = parser.isSet(sha256Option);
+    options.verifyAfterSave = !parser.isSet(noVerifyOption);
+    options.resumable = !parser.isSet(noResumeOption);
+    options.deltaSave = parser.isSet(deltaOption);
+    options.punchZeros = parser.isSet(punchZerosOption);
+    options.compress = parser.isSet(compressOption);
+    options.analyzeContent = !parser.isSet(noAnalyzeOption);
+    QString memoryBudget = parser.value(memoryBudgetOption);
+    if (memoryBudget == "unlimited") {
+        options.memoryBudget = -1;
+    } else if (memoryBudget.trimmed() != "0") {
+        options.memoryBudget = TransferOptions::parseSize(memoryBudget, &ok);
+        if (!ok)
+            error = "Invalid --memory-budget";
+    }
+    options.spillDirectory = parser.value(spillDirOption);
+
+    int jobs = parser.value(jobsOption).toInt(&ok);
+    if (!ok || jobs <= 0)
+        error = "Invalid --jobs";
+    int deviceLimit = parser.value(deviceLimitOption).toInt(&ok);
+    if (!ok || deviceLimit <= 0)
+        error = "Invalid --per-device";
+
+    int interval = parser.value(intervalOption).toInt(&ok);
+    if (!ok || interval < 0)
+        error = "Invalid --progress-interval";
+
+    if (!error.isEmpty()) {
+        fprintf(stderr, "%s\n", qPrintable(error));
+        return UsageError;
+    }
+
+    // The timer also turns Ctrl+C into a clean cancel, so it runs even
+    // without progress lines
+    m_printProgress = interval > 0;
+    m_progressTimer.start(interval > 0 ? interval : 200);
+
+#ifdef Q_OS_UNIX
+    std::signal(SIGINT, requestInterrupt);
+    std::signal(SIGTERM, requestInterrupt);
+#endif
+
+    m_scheduler = new JobScheduler(jobs);
+    m_scheduler->setDeviceLimit(deviceLimit);
+    connect(m_scheduler, &JobScheduler::phaseStarted, this, &HeadlessRunner::onPhaseStarted);
+    connect(m_scheduler, &JobScheduler::phaseFinished, this, &HeadlessRunner::onPhaseFinished);
+    connect(m_scheduler, &JobScheduler::jobError, this, &HeadlessRunner::onJobError);
+    connect(m_scheduler, &JobScheduler::jobReport, this, &HeadlessRunner::onJobReport);
+    connect(m_scheduler, &JobScheduler::jobChecksums, this, &HeadlessRunner::onJobChecksums);
+    connect(m_scheduler, &JobScheduler::jobVerified, this, &HeadlessRunner::onJobVerified);
+    connect(m_scheduler, &JobScheduler::idle, this, &HeadlessRunner::onIdle);
+
+    // Queued once the event loop runs, so every event is seen
+    QTimer::singleShot(0, this, [this, paths, copy, stream, options]() {
+        if (!copy) {
+            for (const QString &path : paths)
+                m_scheduler->addRead(path, options);
+            return;
+        }
+        for (int index = 0; index + 1 < paths.size(); index += 2) {
+            if (stream)
+                m_scheduler->addStreamCopy(paths.at(index), paths.at(index + 1), options);
+            else
+                m_scheduler->addCopy(paths.at(index), paths.at(index + 1), options);
+        }
+    });
+
+    QCoreApplication::exec();
+    return m_exitCode;
+}
+
+void HeadlessRunner::onPhaseStarted(int id)
+{
+    JobScheduler::Job job = m_scheduler->job(id);
+    m_printedBytes.insert(id, -1);
+
+    QJsonObject object;
+    object["event"] = "start";
+    object["job"] = id;
+    object["operation"] = JobScheduler::operationName(job);
+    object["source"] = job.saving ? QString() : job.sourcePath;
+    object["destination"] = job.destinationPath;
+    print(object);
+}
+
+void HeadlessRunner::onPhaseFinished(int id)
+{
+    m_printedBytes.remove(id);
+
+    // A failed phase was reported by onJobError()
+    JobScheduler::Job job = m_scheduler->job(id);
+    if (job.state == JobScheduler::State::Failed || !job.control)
+        return;
+
+    TransferMetrics::Snapshot metrics = job.control->sampleMetrics();
+    QJsonObject object;
+    object["event"] = job.state == JobScheduler::State::Cancelled ? "cancelled" : "done";
+    object["job"] = id;
+    object["operation"] = JobScheduler::operationName(job);
+    object["bytes"] = metrics.bytesDone;
+    object["total"] = metrics.totalBytes;
+    object["elapsed_ms"] = metrics.elapsedMs;
+    object["avg_mb_per_s"] = metrics.averageMBps;
+    object["calls"] = static_cast<qint64>(metrics.calls);
+    object["p50_latency_ns"] = metrics.p50Ns;
+    object["p99_latency_ns"] = metrics.p99Ns;
+    object["max_latency_ns"] = metrics.maxNs;
+    print(object);
+}
+
+void HeadlessRunner::onJobError(int id, const QString &error)
+{
+    QJsonObject object;
+    object["event"] = "error";
+    object["job"] = id;
+    object["operation"] = JobScheduler::operationName(m_scheduler->job(id));
+    object["message"] = error;
+    print(object);
+}
+
+void HeadlessRunner::onJobReport(int id, const QString &report)
+{
+    QJsonObject object;
+    object["event"] = "report";
+    object["job"] = id;
+    object["operation"] = JobScheduler::operationName(m_scheduler->job(id));
+    object["message"] = report;
+    print(object);
+}
+
+void HeadlessRunner::onJobChecksums(int id, const QString &operation, const Checksums &checksums)
+{
+    QJsonObject object;
+    object["event"] = "checksums";
+    object["job"] = id;
+    object["operation"] = operation.toLower();
+    if (checksums.algorithms.testFlag(Checksums::Crc32c))
+        object["crc32c"] = QString("%1").arg(checksums.crc32c, 8, 16, QChar('0'));
+    if (checksums.algorithms.testFlag(Checksums::Xxh3))
+        object["xxh3"] = QString("%1").arg(checksums.xxh3, 16, 16, QChar('0'));
+    if (checksums.algorithms.testFlag(Checksums::Sha256))
+        object["sha256"] = QString::fromLatin1(checksums.sha256.toHex());
+    print(object);
+}
+
+void HeadlessRunner::onJobVerified(int id, bool matches, const QString &details)
+{
+    QJsonObject object;
+    object["event"] = "verified";
+    object["job"] = id;
+    object["operation"] = JobScheduler::operationName(m_scheduler->job(id));
+    object["matches"] = matches;
+    object["details"] = details;
+    print(object);
+}
+
+void HeadlessRunner::onIdle()
+{
+    // Failures outrank verification failures, which outrank cancels. Among
+    // equals the first job decides.
+    ExitCode code = Success;
+    for (int id : m_scheduler->jobIds()) {
+        JobScheduler::Job job = m_scheduler->job(id);
+        ExitCode jobCode = Success;
+        if (job.state == JobScheduler::State::Failed) {
+            bool reading = job.type == JobScheduler::Type::Read
+                           || (job.type == JobScheduler::Type::Copy && !job.saving);
+            jobCode = reading ? ReadFailed : SaveFailed;
+        } else if (job.verificationFailed) {
+            jobCode = VerifyFailed;
+        } else if (job.state == JobScheduler::State::Cancelled) {
+            jobCode = Cancelled;
+        }
+        if (severity(jobCode) > severity(code))
+            code = jobCode;
+    }
+
+    m_progressTimer.stop();
+    m_exitCode = code;
+    QCoreApplication::exit(code);
+}
+
+void HeadlessRunner::printProgress()
+{
+    if (interruptRequested && !m_cancelRequested) {
+        m_cancelRequested = true;
+        m_scheduler->cancelAll();
+    }
+
+    if (!m_printProgress)
+        return;
+
+    for (auto it = m_printedBytes.begin(); it != m_printedBytes.end(); ++it) {
+        JobScheduler::Job job = m_scheduler->job(it.key());
+        if (!job.control)
+            continue;
+
+        // Sampled on every tick so the EWMA sees all intervals
+        TransferMetrics::Snapshot metrics = job.control->sampleMetrics();
+        if (metrics.totalBytes <= 0 || metrics.bytesDone == it.value())
+            continue;
+        it.value() = metrics.bytesDone;
+
+        QJsonObject object;
+        object["event"] = "progress";
+        object["job"] = it.key();
+        object["operation"] = JobScheduler::operationName(job);
+        object["bytes"] = metrics.bytesDone;
+        object["total"] = metrics.totalBytes;
+        object["mb_per_s"] = metrics.currentMBps;
+        object["avg_mb_per_s"] = metrics.averageMBps;
+        object["eta_ms"] = metrics.etaMs;
+
+        // Compressed transfers also give the bytes on disk
+        qint64 storedBytes = job.control->storedBytes();
+        if (storedBytes >= 0 && metrics.bytesDone > 0) {
+            double ratio = static_cast<double>(storedBytes) / metrics.bytesDone;
+            object["stored_bytes"] = storedBytes;
+            object["stored_mb_per_s"] = metrics.currentMBps * ratio;
+            object["avg_stored_mb_per_s"] = metrics.averageMBps * ratio;
+        }
+        print(object);
+    }
+}
+
+void HeadlessRunner::print(const QJsonObject &object)
+{
+    // One line per event, flushed so pipelines see it immediately
+    QByteArray line = QJsonDocument(object).toJson(QJsonDocument::Compact);
+    fprintf(stdout, "%s\n", line.constData());
+    fflush(stdout);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <QHash>
+#include <QObject>
+#include <QStringList>
+#include <QTimer>
+#include "checksums.h"
+
+class JobScheduler;
+class QJsonObject;
+
+// Command-line front end for FileWorker, used instead of MainWindow when the
+// program is started with --headless, --read or --copy. Needs only a
+// QCoreApplication. Every file given is a JobScheduler job, so several
+// files are read or copied in parallel. Progress and results are printed to
+// stdout as one JSON object per line:
+//
+//   {"event":"progress","job":1,"operation":"read","bytes":...,"total":...,"mb_per_s":...,"eta_ms":...}
+class HeadlessRunner : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum ExitCode
+    {
+        Success = 0,
+        Failure = 1,            // unexpected internal error
+        UsageError = 2,
+        ReadFailed = 3,
+        SaveFailed = 4,
+        Cancelled = 5,          // SIGINT/SIGTERM
+        VerifyFailed = 6        // the saved file does not match its source
+    };
+
+    explicit HeadlessRunner(QObject *parent = nullptr);
+    ~HeadlessRunner();
+
+    // True when the arguments ask for the headless mode, checked before any
+    // QCoreApplication exists
+    static bool isRequested(int argc, char *argv[]);
+
+    // Parses the arguments and runs the jobs in the application's event
+    // loop. Returns the process exit code, the worst of all jobs.
+    int exec(const QStringList &arguments);
+
+private slots:
+    void onPhaseStarted(int id);
+    void onPhaseFinished(int id);
+    void onJobError(int id, const QString &error);
+    void onJobReport(int id, const QString &report);
+    void onJobChecksums(int id, const QString &operation, const Checksums &checksums);
+    void onJobVerified(int id, bool matches, const QString &details);
+    void onIdle();
+    void printProgress();
+
+private:
+    void print(const QJsonObject &object);
+
+    JobScheduler *m_scheduler;
+    QTimer m_progressTimer;
+    QHash<int, qint64> m_printedBytes;  // per running job
+    bool m_printProgress;
+    bool m_cancelRequested;
+    int m_exitCode;
+};
@@ -0,0 +1,289 @@
+#include "hexview.h"
+#include <QFontDatabase>
+#include <QKeyEvent>
+#include <QPainter>
+#include <QScrollBar>
+#include <QWheelEvent>
+
+namespace {
+// Above this many rows the vertical scroll bar is scaled
+const int ScrollBarRange = 1 << 30;
+
+QChar printable(uchar byte)
+{
+    return byte >= 0x20 && byte < 0x7F ? QChar(byte) : QChar('.');
+}
+}
+
+HexView::HexView(QWidget *parent)
+    : QAbstractScrollArea(parent)
+    , m_size(0)
+    , m_mode(Mode::Hex)
+    , m_topRow(0)
+    , m_pages(CachedPages)
+    , m_updatingScrollBar(false)
+{
+    setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+    setFocusPolicy(Qt::StrongFocus);
+    connect(verticalScrollBar(), &QScrollBar::valueChanged, this, &HexView::scrollBarMoved);
+    connect(horizontalScrollBar(), &QScrollBar::valueChanged, viewport(), qOverload<>(&QWidget::update));
+}
+
+void HexView::setData(const ChunkBuffer &data)
+{
+    m_file.close();
+    m_data = data;
+    m_size = data.size();
+    m_pages.clear();
+    m_topRow = 0;
+    updateScrollBars();
+    viewport()->update();
+}
+
+bool HexView::openFile(const QString &filePath, QString *error)
+{
+    setData(ChunkBuffer());
+
+    // Pages are read as rows are formatted, nothing is read up front
+    m_file.setFileName(filePath);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        *error = m_file.errorString();
+        return false;
+    }
+    m_size = m_file.size();
+    updateScrollBars();
+    viewport()->update();
+    return true;
+}
+
+void HexView::clear()
+{
+    setData(ChunkBuffer());
+}
+
+QString HexView::filePath() const
+{
+    return m_file.isOpen() ? m_file.fileName() : QString();
+}
+
+void HexView::setMode(HexView::Mode mode)
+{
+    if (mode == m_mode)
+        return;
+
+    // Keeps the byte at the top in view
+    qint64 offset = topOffset();
+    m_mode = mode;
+    m_pages.clear();
+    m_topRow = offset / bytesPerRow();
+    updateScrollBars();
+    setTopRow(m_topRow);
+}
+
+void HexView::scrollToOffset(qint64 offset)
+{
+    setTopRow(offset / bytesPerRow());
+}
+
+qint64 HexView::rowCount() const
+{
+    return (m_size + bytesPerRow() - 1) / bytesPerRow();
+}
+
+int HexView::visibleRows() const
+{
+    return qMax(1, viewport()->height() / fontMetrics().height());
+}
+
+qint64 HexView::lastTopRow() const
+{
+    return qMax<qint64>(0, rowCount() - visibleRows());
+}
+
+int HexView::offsetDigits() const
+{
+    int digits = 8;
+    while (digits < 16 && (m_size >> (4 * digits)) > 0)
+        ++digits;
+    return digits;
+}
+
+int HexView::rowWidth() const
+{
+    if (m_mode == Mode::Hex)
+        return offsetDigits() + 2 + 16 * 3 + 1 + 16;
+    return offsetDigits() + 2 + 64;
+}
+
+const QStringList *HexView::page(qint64 index)
+{
+    if (const QStringList *rows = m_pages.object(index))
+        return rows;
+
+    const qint64 pageBytes = qint64(PageRows) * bytesPerRow();
+    const qint64 offset = index * pageBytes;
+    QByteArray bytes = readBytes(offset, pageBytes);
+
+    QStringList *rows = new QStringList;
+    rows->reserve(PageRows);
+    for (int start = 0; start < bytes.size(); start += bytesPerRow()) {
+        rows->append(formatRow(bytes.constData() + start, qMin(bytesPerRow(), int(bytes.size()) - start),
+                               offset + start));
+    }
+    m_pages.insert(index, rows);
+    return rows;
+}
+
+QByteArray HexView::readBytes(qint64 offset, qint64 length)
+{
+    if (!m_file.isOpen())
+        return m_data.read(offset, length);
+
+    // A file that shrank since it was opened just shows fewer rows
+    if (!m_file.seek(offset))
+        return QByteArray();
+    return m_file.read(qMin(length, m_size - offset));
+}
+
+QString HexView::formatRow(const char *bytes, int length, qint64 offset) const
+{
+    static const char digits[] = "0123456789abcdef";
+
+    QString row;
+    row.reserve(rowWidth());
+    row += QString("%1  ").arg(offset, offsetDigits(), 16, QChar('0'));
+
+    if (m_mode == Mode::Hex) {
+        for (int index = 0; index < 16; ++index) {
+            if (index < length) {
+                uchar byte = static_cast<uchar>(bytes[index]);
+                row += QChar(digits[byte >> 4]);
+                row += QChar(digits[byte & 0xF]);
+                row += QChar(' ');
+            } else {
+                row += "   ";
+            }
+            if (index == 7)
+                row += QChar(' ');
+        }
+    }
+    for (int index = 0; index < length; ++index)
+        row += printable(static_cast<uchar>(bytes[index]));
+    return row;
+}
+
+void HexView::setTopRow(qint64 row)
+{
+    m_topRow = qBound<qint64>(0, row, lastTopRow());
+
+    // The scroll bar follows without feeding back into m_topRow
+    QScrollBar *scrollBar = verticalScrollBar();
+    qint64 last = lastTopRow();
+    m_updatingScrollBar = true;
+    if (last <= ScrollBarRange)
+        scrollBar->setValue(static_cast<int>(m_topRow));
+    else
+        scrollBar->setValue(static_cast<int>(static_cast<double>(m_topRow) / last * ScrollBarRange));
+    m_updatingScrollBar = false;
+
+    viewport()->update();
+}
+
+void HexView::updateScrollBars()
+{
+    QScrollBar *scrollBar = verticalScrollBar();
+    qint64 last = lastTopRow();
+    m_updatingScrollBar = true;
+    scrollBar->setRange(0, static_cast<int>(qMin<qint64>(last, ScrollBarRange)));
+    scrollBar->setPageStep(last <= ScrollBarRange ? visibleRows() : ScrollBarRange / 1000);
+    scrollBar->setSingleStep(1);
+    m_updatingScrollBar = false;
+
+    int width = rowWidth() * fontMetrics().horizontalAdvance(QChar('0'));
+    horizontalScrollBar()->setRange(0, qMax(0, width - viewport()->width()));
+    horizontalScrollBar()->setPageStep(viewport()->width());
+
+    setTopRow(m_topRow);
+}
+
+void HexView::scrollBarMoved(int value)
+{
+    if (m_updatingScrollBar)
+        return;
+
+    qint64 last = lastTopRow();
+    if (last <= ScrollBarRange)
+        m_topRow = value;
+    else
+        m_topRow = static_cast<qint64>(static_cast<double>(value) / ScrollBarRange * last);
+    viewport()->update();
+}
+
+void HexView::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+
+    QPainter painter(viewport());
+    painter.fillRect(viewport()->rect(), palette().base());
+    if (m_size == 0)
+        return;
+
+    painter.setPen(palette().text().color());
+    const int lineHeight = fontMetrics().height();
+    const int x = 4 - horizontalScrollBar()->value();
+    int y = fontMetrics().ascent();
+
+    const qint64 endRow = qMin(m_topRow + visibleRows() + 1, rowCount());
+    for (qint64 row = m_topRow; row < endRow; ++row, y += lineHeight) {
+        const QStringList *rows = page(row / PageRows);
+        int index = static_cast<int>(row % PageRows);
+        if (index < rows->size())
+            painter.drawText(x, y, rows->at(index));
+    }
+}
+
+void HexView::resizeEvent(QResizeEvent *event)
+{
+    QAbstractScrollArea::resizeEvent(event);
+    updateScrollBars();
+}
+
+void HexView::wheelEvent(QWheelEvent *event)
+{
+    // Three rows per notch, as in the other item views
+    int steps = event->angleDelta().y() / 40;
+    if (steps == 0) {
+        event->ignore();
+        return;
+    }
+    setTopRow(m_topRow - steps);
+    event->accept();
+}
+
+void HexView::keyPressEvent(QKeyEvent *event)
+{
+    switch (event->key()) {
+    case Qt::Key_Up:
+        setTopRow(m_topRow - 1);
+        break;
+    case Qt::Key_Down:
+        setTopRow(m_topRow + 1);
+        break;
+    case Qt::Key_PageUp:
+        setTopRow(m_topRow - visibleRows());
+        break;
+    case Qt::Key_PageDown:
+        setTopRow(m_topRow + visibleRows());
+        break;
+    case Qt::Key_Home:
+        setTopRow(0);
+        break;
+    case Qt::Key_End:
+        setTopRow(lastTopRow());
+        break;
+    default:
+        QAbstractScrollArea::keyPressEvent(event);
+        return;
+    }
+    event->accept();
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <QAbstractScrollArea>
+#include <QCache>
+#include <QFile>
+#include <QStringList>
+#include "chunkbuffer.h"
+
+// Read-only hex or text view of a ChunkBuffer or a file of any size. Only the
+// rows on screen are read and formatted, in pages of PageRows rows that are
+// kept in a small LRU cache, so opening and scrolling cost the same for 1 KB
+// and for 50 GB.
+// Positions are 64-bit rows. The scroll bar only has int range, so for
+// huge buffers it is scaled and wheel and keys move the rows directly.
+class HexView : public QAbstractScrollArea
+{
+    Q_OBJECT
+
+public:
+    enum class Mode
+    {
+        Hex,    // offset, 16 bytes in hex, the same bytes as characters
+        Text    // offset and 64 bytes as characters, lines are not followed
+    };
+
+    static constexpr int PageRows = 256;        // formatted together
+    static constexpr int CachedPages = 64;
+
+    explicit HexView(QWidget *parent = nullptr);
+
+    // Shows data, a shallow copy of the buffer
+    void setData(const ChunkBuffer &data);
+
+    // Shows the file at filePath, reading only the pages on screen. The file
+    // is not mapped, so it may be rewritten or truncated while it is shown.
+    bool openFile(const QString &filePath, QString *error);
+
+    // Releases the buffer or the file
+    void clear();
+
+    // The file opened with openFile(), empty when showing a buffer
+    QString filePath() const;
+
+    Mode mode() const { return m_mode; }
+    qint64 topOffset() const { return m_topRow * bytesPerRow(); }
+
+public slots:
+    void setMode(HexView::Mode mode);
+    void scrollToOffset(qint64 offset);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+    void wheelEvent(QWheelEvent *event) override;
+    void keyPressEvent(QKeyEvent *event) override;
+
+private:
+    int bytesPerRow() const { return m_mode == Mode::Hex ? 16 : 64; }
+    qint64 rowCount() const;
+    int visibleRows() const;
+    qint64 lastTopRow() const;
+    int offsetDigits() const;
+    int rowWidth() const;   // in characters
+
+    // Formatted rows of one page, from the cache when possible
+    const QStringList *page(qint64 index);
+    QByteArray readBytes(qint64 offset, qint64 length);
+    QString formatRow(const char *bytes, int length, qint64 offset) const;
+
+    void setTopRow(qint64 row);
+    void updateScrollBars();
+    void scrollBarMoved(int value);
+
+    ChunkBuffer m_data;
+    QFile m_file;
+    qint64 m_size;
+    Mode m_mode;
+    qint64 m_topRow;
+    QCache<qint64, QStringList> m_pages;
+    bool m_updatingScrollBar;
+};
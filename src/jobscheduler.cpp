@@ -0,0 +1,425 @@
+#include "jobscheduler.h"
+#include "chunktuner.h"
+#include "fileworker.h"
+#include <QThread>
+
+JobScheduler::JobScheduler(int workerCount, QObject *parent)
+    : QObject(parent)
+    , m_deviceLimit(DefaultDeviceLimit)
+    , m_nextId(1)
+{
+    qRegisterMetaType<TransferOptions>();
+    qRegisterMetaType<ChunkBuffer>();
+    qRegisterMetaType<QSharedPointer<OperationControl>>();
+    qRegisterMetaType<Checksums>();
+    qRegisterMetaType<ByteStatistics>();
+
+    m_slots.resize(qMax(1, workerCount));
+    for (int index = 0; index < m_slots.size(); ++index) {
+        Slot &slot = m_slots[index];
+        slot.thread = new QThread(this);
+        slot.thread->setObjectName(QString("JobWorker%1").arg(index));
+        slot.worker = new FileWorker();
+        slot.worker->moveToThread(slot.thread);
+        connect(slot.thread, &QThread::finished, slot.worker, &QObject::deleteLater);
+
+        connect(slot.worker, &FileWorker::readFinished, this, [this, index](const ChunkBuffer &data) {
+            m_slots[index].succeeded = true;
+            m_slots[index].data = data;
+        });
+        connect(slot.worker, &FileWorker::saveFinished, this, [this, index]() {
+            m_slots[index].succeeded = true;
+        });
+        connect(slot.worker, &FileWorker::readError, this, [this, index](const QString &error) {
+            m_slots[index].error = error;
+        });
+        connect(slot.worker, &FileWorker::saveError, this, [this, index](const QString &error) {
+            m_slots[index].error = error;
+        });
+        connect(slot.worker, &FileWorker::cancelOperation_, this, [this, index]() {
+            m_slots[index].cancelled = true;
+        });
+
+        connect(slot.worker, &FileWorker::operationReport, this, [this, index](const QString &report) {
+            if (Job *job = slotJob(index))
+                emit jobReport(job->id, report);
+        });
+        connect(slot.worker, &FileWorker::checksumsComputed, this,
+                [this, index](const QString &operation, const Checksums &checksums) {
+            if (Job *job = slotJob(index))
+                emit jobChecksums(job->id, operation, checksums);
+        });
+        // The statistics arrive after the read, possibly while the worker
+        // already runs another job
+        connect(slot.worker, &FileWorker::analysisStarted, this, [this, index](int analysis) {
+            if (Job *job = slotJob(index))
+                m_slots[index].analyses.insert(analysis, job->id);
+        });
+        connect(slot.worker, &FileWorker::contentAnalyzed, this,
+                [this, index](const ByteStatistics &statistics, int analysis) {
+            int id = m_slots[index].analyses.take(analysis);
+            if (id != 0)
+                emit jobReport(id, QString("Content: %1").arg(statistics.summary()));
+            if (isIdle())
+                emit idle();
+        });
+        connect(slot.worker, &FileWorker::saveVerified, this, [this, index](bool matches, const QString &details) {
+            if (Job *job = slotJob(index)) {
+                job->verificationFailed = job->verificationFailed || !matches;
+                emit jobVerified(job->id, matches, details);
+            }
+        });
+
+        slot.thread->start();
+    }
+}
+
+JobScheduler::~JobScheduler()
+{
+    for (Job &job : m_jobs) {
+        if (job.state == State::Running && job.control)
+            job.control->cancel();
+    }
+    for (Slot &slot : m_slots) {
+        slot.thread->quit();
+        slot.thread->wait();
+    }
+}
+
+int JobScheduler::addRead(const QString &filePath, const TransferOptions &options, int priority)
+{
+    Job job;
+    job.type = Type::Read;
+    job.sourcePath = filePath;
+    job.options = options;
+    job.priority = priority;
+    return addJob(job);
+}
+
+int JobScheduler::addSave(const QString &filePath, const ChunkBuffer &data, const TransferOptions &options,
+                          int priority)
+{
+    Job job;
+    job.type = Type::Save;
+    job.destinationPath = filePath;
+    job.data = data;
+    job.options = options;
+    job.priority = priority;
+    return addJob(job);
+}
+
+int JobScheduler::addCopy(const QString &sourcePath, const QString &filePath, const TransferOptions &options,
+                          int priority)
+{
+    if (FileWorker::isSameFile(sourcePath, filePath))
+        return 0;
+
+    Job job;
+    job.type = Type::Copy;
+    job.sourcePath = sourcePath;
+    job.destinationPath = filePath;
+    job.options = options;
+    job.priority = priority;
+    return addJob(job);
+}
+
+int JobScheduler::addStreamCopy(const QString &sourcePath, const QString &filePath, const TransferOptions &options,
+                                int priority)
+{
+    if (FileWorker::isSameFile(sourcePath, filePath))
+        return 0;
+
+    Job job;
+    job.type = Type::StreamCopy;
+    job.sourcePath = sourcePath;
+    job.destinationPath = filePath;
+    job.options = options;
+    job.priority = priority;
+    return addJob(job);
+}
+
+int JobScheduler::addJob(Job job)
+{
+    job.id = m_nextId++;
+    for (const QString &path : {job.sourcePath, job.destinationPath}) {
+        if (path.isEmpty())
+            continue;
+        QString device = ChunkTuner::deviceKeyFor(path);
+        if (!job.devices.contains(device))
+            job.devices.append(device);
+    }
+
+    int id = job.id;
+    m_jobs.insert(id, job);
+    emit jobAdded(id);
+    dispatch();
+    return id;
+}
+
+void JobScheduler::cancel(int id)
+{
+    auto it = m_jobs.find(id);
+    if (it == m_jobs.end())
+        return;
+
+    // A running job ends once its worker reaches a checkpoint
+    if (it->state == State::Running) {
+        it->control->cancel();
+        return;
+    }
+    if (it->state != State::Queued)
+        return;
+
+    endJob(*it, State::Cancelled);
+    emit jobChanged(id);
+    emit jobFinished(id);
+    if (isIdle())
+        emit idle();
+}
+
+void JobScheduler::cancelAll()
+{
+    const QList<int> ids = m_jobs.keys();
+    for (int id : ids)
+        cancel(id);
+}
+
+void JobScheduler::pause(int id)
+{
+    auto it = m_jobs.find(id);
+    if (it == m_jobs.end() || it->state != State::Running)
+        return;
+    it->control->pause();
+    emit jobChanged(id);
+}
+
+void JobScheduler::resume(int id)
+{
+    auto it = m_jobs.find(id);
+    if (it == m_jobs.end() || it->state != State::Running)
+        return;
+    it->control->resume();
+    emit jobChanged(id);
+}
+
+void JobScheduler::setPriority(int id, int priority)
+{
+    auto it = m_jobs.find(id);
+    if (it == m_jobs.end() || it->state != State::Queued || it->priority == priority)
+        return;
+    it->priority = priority;
+    emit jobChanged(id);
+}
+
+void JobScheduler::setDeviceLimit(int limit)
+{
+    m_deviceLimit = qMax(1, limit);
+    dispatch();
+}
+
+void JobScheduler::removeFinished()
+{
+    for (auto it = m_jobs.begin(); it != m_jobs.end();) {
+        if (it->isFinished())
+            it = m_jobs.erase(it);
+        else
+            ++it;
+    }
+}
+
+bool JobScheduler::isIdle() const
+{
+    for (const Job &job : m_jobs) {
+        if (!job.isFinished())
+            return false;
+    }
+    for (const Slot &slot : m_slots) {
+        if (!slot.analyses.isEmpty())
+            return false;
+    }
+    return true;
+}
+
+QString JobScheduler::operationName(const Job &job)
+{
+    switch (job.type) {
+    case Type::Read:
+        return "read";
+    case Type::Save:
+        return "save";
+    case Type::Copy:
+        return job.saving ? "save" : "read";
+    case Type::StreamCopy:
+        return "copy";
+    }
+    return QString();
+}
+
+QString JobScheduler::stateName(State state)
+{
+    switch (state) {
+    case State::Queued:
+        return "Queued";
+    case State::Running:
+        return "Running";
+    case State::Finished:
+        return "Finished";
+    case State::Failed:
+        return "Failed";
+    case State::Cancelled:
+        return "Cancelled";
+    }
+    return QString();
+}
+
+void JobScheduler::dispatch()
+{
+    for (int index = 0; index < m_slots.size(); ++index) {
+        if (m_slots[index].jobId != 0)
+            continue;
+
+        int id = nextJob();
+        if (id == 0)
+            return;
+
+        Job &job = m_jobs[id];
+        job.state = State::Running;
+        for (const QString &device : job.devices)
+            ++m_deviceLoad[device];
+
+        m_slots[index].jobId = id;
+        startPhase(index);
+    }
+}
+
+int JobScheduler::nextJob() const
+{
+    // Jobs are ordered by id, so the first one of the highest priority wins
+    const Job *next = nullptr;
+    for (const Job &job : m_jobs) {
+        if (job.state != State::Queued || (next && job.priority <= next->priority))
+            continue;
+
+        bool devicesFree = true;
+        for (const QString &device : job.devices)
+            devicesFree = devicesFree && m_deviceLoad.value(device) < m_deviceLimit;
+        if (devicesFree)
+            next = &job;
+    }
+    return next ? next->id : 0;
+}
+
+void JobScheduler::startPhase(int slotIndex)
+{
+    Slot &slot = m_slots[slotIndex];
+    Job &job = m_jobs[slot.jobId];
+    slot.succeeded = false;
+    slot.cancelled = false;
+    slot.error.clear();
+    slot.data = ChunkBuffer();
+
+    // A control block per phase keeps the save metrics apart from the read,
+    // a pause carries over
+    QSharedPointer<OperationControl> previous = job.control;
+    job.control = QSharedPointer<OperationControl>::create();
+    if (previous && (previous->state() == OperationControl::State::Pausing
+                     || previous->state() == OperationControl::State::Paused))
+        job.control->pause();
+
+    bool reading = job.type == Type::Read || (job.type == Type::Copy && !job.saving);
+    if (job.type == Type::StreamCopy) {
+        QMetaObject::invokeMethod(slot.worker, "streamCopy", Qt::QueuedConnection,
+                                 Q_ARG(QString, job.sourcePath),
+                                 Q_ARG(QString, job.destinationPath),
+                                 Q_ARG(TransferOptions, job.options),
+                                 Q_ARG(QSharedPointer<OperationControl>, job.control));
+    } else if (reading) {
+        QMetaObject::invokeMethod(slot.worker, "readFile", Qt::QueuedConnection,
+                                 Q_ARG(QString, job.sourcePath),
+                                 Q_ARG(TransferOptions, job.options),
+                                 Q_ARG(QSharedPointer<OperationControl>, job.control));
+    } else {
+        QMetaObject::invokeMethod(slot.worker, "saveFile", Qt::QueuedConnection,
+                                 Q_ARG(QString, job.destinationPath),
+                                 Q_ARG(ChunkBuffer, job.data),
+                                 Q_ARG(TransferOptions, job.options),
+                                 Q_ARG(QSharedPointer<OperationControl>, job.control));
+    }
+
+    // Queued behind the operation on the worker's thread, so it arrives
+    // after every signal the worker sent while running it
+    QMetaObject::invokeMethod(slot.worker, [this, slotIndex]() {
+        QMetaObject::invokeMethod(this, [this, slotIndex]() { onPhaseReturned(slotIndex); }, Qt::QueuedConnection);
+    }, Qt::QueuedConnection);
+
+    int id = job.id;
+    emit jobChanged(id);
+    emit phaseStarted(id);
+}
+
+void JobScheduler::onPhaseReturned(int slotIndex)
+{
+    Slot &slot = m_slots[slotIndex];
+    Job *job = slotJob(slotIndex);
+    if (!job)
+        return;
+
+    int id = job->id;
+    State outcome = State::Finished;
+    if (!slot.error.isEmpty()) {
+        outcome = State::Failed;
+    } else if (slot.cancelled) {
+        outcome = State::Cancelled;
+    } else if (!slot.succeeded) {
+        outcome = State::Failed;
+        slot.error = "The operation ended without a result.";
+    } else if (job->type == Type::Copy && !job->saving && job->control->isCancelled()) {
+        // Cancelled after the read completed, before the save started
+        outcome = State::Cancelled;
+    }
+
+    if (outcome == State::Finished && job->type == Type::Copy && !job->saving) {
+        emit phaseFinished(id);
+        job = slotJob(slotIndex);
+        job->saving = true;
+        job->data = slot.data;
+        slot.data = ChunkBuffer();
+        startPhase(slotIndex);
+        return;
+    }
+
+    // What a read job loaded is not kept
+    slot.data = ChunkBuffer();
+    slot.jobId = 0;
+    if (outcome == State::Failed)
+        job->error = slot.error;
+    endJob(*job, outcome);
+
+    if (outcome == State::Failed)
+        emit jobError(id, slot.error);
+    emit phaseFinished(id);
+    emit jobChanged(id);
+    emit jobFinished(id);
+
+    dispatch();
+    if (isIdle())
+        emit idle();
+}
+
+void JobScheduler::endJob(Job &job, State state)
+{
+    if (job.state == State::Running) {
+        for (const QString &device : job.devices) {
+            if (--m_deviceLoad[device] <= 0)
+                m_deviceLoad.remove(device);
+        }
+    }
+    job.state = state;
+    job.data = ChunkBuffer();
+}
+
+JobScheduler::Job *JobScheduler::slotJob(int slotIndex)
+{
+    auto it = m_jobs.find(m_slots[slotIndex].jobId);
+    return it == m_jobs.end() ? nullptr : &it.value();
+}
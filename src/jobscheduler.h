@@ -0,0 +1,145 @@
+#pragma once
+
+#include <QHash>
+#include <QMap>
+#include <QObject>
+#include <QSharedPointer>
+#include <QStringList>
+#include <QVector>
+#include "chunkbuffer.h"
+#include "operationcontrol.h"
+#include "transferoptions.h"
+
+class FileWorker;
+class QThread;
+
+// Runs queued read, save and copy jobs on a fixed pool of worker threads,
+// each with its own FileWorker. The highest priority job is started first,
+// older jobs first among equals, as long as none of the devices it touches
+// already runs deviceLimit() jobs. Every job has its own control block for
+// progress, pause, cancel and metrics.
+class JobScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    static constexpr int DefaultWorkerCount = 4;
+    static constexpr int DefaultDeviceLimit = 2;    // more streams only add seeks on a disk
+
+    enum class Type
+    {
+        Read,       // reads a file and reports its checksums, the data is dropped
+        Save,       // saves a loaded buffer
+        Copy,       // reads a file, then saves it
+        StreamCopy  // copies through a buffer ring without loading the file
+    };
+
+    enum class State { Queued, Running, Finished, Failed, Cancelled };
+
+    struct Job
+    {
+        int id = 0;
+        Type type = Type::Read;
+        State state = State::Queued;
+        int priority = 0;
+        QString sourcePath;
+        QString destinationPath;
+        TransferOptions options;
+        ChunkBuffer data;                           // to save, released when the job ends
+        QSharedPointer<OperationControl> control;   // of the running phase
+        QStringList devices;
+        bool saving = false;                        // a Copy job in its save phase
+        bool verificationFailed = false;
+        QString error;
+
+        bool isFinished() const { return state != State::Queued && state != State::Running; }
+    };
+
+    explicit JobScheduler(int workerCount = DefaultWorkerCount, QObject *parent = nullptr);
+    ~JobScheduler();    // cancels running jobs
+
+    // Each returns the new job's id. Copies of a file onto itself are
+    // refused with 0.
+    int addRead(const QString &filePath, const TransferOptions &options, int priority = 0);
+    int addSave(const QString &filePath, const ChunkBuffer &data, const TransferOptions &options, int priority = 0);
+    int addCopy(const QString &sourcePath, const QString &filePath, const TransferOptions &options,
+                int priority = 0);
+    int addStreamCopy(const QString &sourcePath, const QString &filePath, const TransferOptions &options,
+                      int priority = 0);
+
+    void cancel(int id);
+    void cancelAll();
+    void pause(int id);
+    void resume(int id);
+
+    // Only queued jobs can be reprioritised
+    void setPriority(int id, int priority);
+
+    int deviceLimit() const { return m_deviceLimit; }
+    void setDeviceLimit(int limit);
+
+    int workerCount() const { return m_slots.size(); }
+
+    // All jobs in the order they were added, finished ones included
+    QList<int> jobIds() const { return m_jobs.keys(); }
+    Job job(int id) const { return m_jobs.value(id); }
+
+    // Forgets finished, failed and cancelled jobs
+    void removeFinished();
+
+    bool isIdle() const;
+
+    // "read", "save" or "copy", what the job is doing right now
+    static QString operationName(const Job &job);
+    static QString stateName(State state);
+
+signals:
+    void jobAdded(int id);
+    void jobChanged(int id);
+
+    // A Copy job has a read and a save phase, the other jobs one phase.
+    // phaseFinished is sent before the next phase starts.
+    void phaseStarted(int id);
+    void phaseFinished(int id);
+    void jobFinished(int id);
+
+    void jobReport(int id, const QString &report);
+    void jobChecksums(int id, const QString &operation, const Checksums &checksums);
+    void jobVerified(int id, bool matches, const QString &details);
+    void jobError(int id, const QString &error);
+
+    // Nothing queued, nothing running and no content analysis outstanding
+    void idle();
+
+private:
+    // One worker thread. The outcome of its current phase is collected from
+    // the worker's signals and acted on once the worker has returned.
+    struct Slot
+    {
+        QThread *thread = nullptr;
+        FileWorker *worker = nullptr;
+        int jobId = 0;
+        bool succeeded = false;
+        bool cancelled = false;
+        QString error;
+        ChunkBuffer data;
+        QHash<int, int> analyses;   // job ids by FileWorker analysis id
+    };
+
+    int addJob(Job job);
+    void dispatch();
+    int nextJob() const;
+    void startPhase(int slotIndex);
+    void onPhaseReturned(int slotIndex);
+
+    // Releases the job's devices and data
+    void endJob(Job &job, State state);
+
+    Job *slotJob(int slotIndex);
+
+    QMap<int, Job> m_jobs;
+    QVector<Slot> m_slots;
+    QHash<QString, int> m_deviceLoad;   // running jobs per device
+    int m_deviceLimit;
+    int m_nextId;
+};
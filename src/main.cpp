@@ -1,14 +1,22 @@
 #include <QApplication>
+#include "headlessrunner.h"
 #include "mainwindow.h"
 
 int main(int argc, char *argv[])
 {
+    QCoreApplication::setApplicationName("File Processor");
+    QCoreApplication::setApplicationVersion("1.0");
+    QCoreApplication::setOrganizationName("Alex Petrov Company");
+
+    // Scripted runs need neither widgets nor an OpenGL context
+    if (HeadlessRunner::isRequested(argc, argv)) {
+        QCoreApplication app(argc, argv);
+        HeadlessRunner runner;
+        return runner.exec(app.arguments());
+    }
+
     QApplication app(argc, argv);
     
-    app.setApplicationName("File Processor");
-    app.setApplicationVersion("1.0");
-    app.setOrganizationName("Alex Petrov Company");
-    
     MainWindow window;
     window.show();
     
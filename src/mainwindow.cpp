@@ -1,6 +1,10 @@
 #include "mainwindow.h"
 #include "glwidget.h"
 #include "fileworker.h"
+#include "compressedfile.h"
+#include "fileinfoloader.h"
+#include "hexview.h"
+#include "jobscheduler.h"
 #include <QSlider>
 #include <QVBoxLayout>
 #include <QHBoxLayout>
@@ -14,20 +18,37 @@
 #include <QDateTime>
 #include <QMessageBox>
 #include <QThread>
-#include <QMimeDatabase>
-#include <QMimeType>
-#include <QCryptographicHash>
 #include <QTextCodec>
 #include <QKeyEvent>
 #include <QGroupBox>
 #include <QWidget>
+#include <QComboBox>
+#include <QSpinBox>
+#include <QCheckBox>
+#include <QDir>
+#include <QHeaderView>
+#include <QTableWidget>
+#include <QTimer>
 
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
+    , m_displayedBytes(-1)
     , m_fileLoaded(false)
+    , m_operationRunning(false)
+    , m_verificationFailed(false)
 {
+    m_scheduler = new JobScheduler(JobScheduler::DefaultWorkerCount, this);
+    m_fileInfoLoader = new FileInfoLoader(this);
+    connect(m_fileInfoLoader, &FileInfoLoader::loaded, this, &MainWindow::showFileInfo);
     setupUI();
+    updateButtons();
+
+    qRegisterMetaType<TransferOptions>();
+    qRegisterMetaType<ChunkBuffer>();
+    qRegisterMetaType<QSharedPointer<OperationControl>>();
+    qRegisterMetaType<Checksums>();
+    qRegisterMetaType<ByteStatistics>();
 
     m_workerThread = new QThread(this);
     m_fileWorker = new FileWorker();
@@ -35,12 +56,10 @@ MainWindow::MainWindow(QWidget *parent)
     
     // Connect signals for reading
     connect(m_workerThread, &QThread::finished, m_fileWorker, &QObject::deleteLater);
-    connect(m_fileWorker, &FileWorker::readProgress, this, &MainWindow::onReadProgress);
     connect(m_fileWorker, &FileWorker::readFinished, this, &MainWindow::onReadFinished);
     connect(m_fileWorker, &FileWorker::readError, this, &MainWindow::onReadError);
     
     // Connect signals for saving
-    connect(m_fileWorker, &FileWorker::saveProgress, this, &MainWindow::onSaveProgress);
     connect(m_fileWorker, &FileWorker::saveFinished, this, &MainWindow::onSaveFinished);
     connect(m_fileWorker, &FileWorker::saveError, this, &MainWindow::onSaveError);
 
@@ -52,9 +71,47 @@ MainWindow::MainWindow(QWidget *parent)
     connect(m_fileWorker, &FileWorker::stopWrite, glWidget, &GLWidget::setRunning, Qt::QueuedConnection);
     connect(m_fileWorker, &FileWorker::setRotationDirection, glWidget, &GLWidget::setRotationDirection, Qt::QueuedConnection);
 
-    connect(m_cancelButton, &QPushButton::clicked, m_fileWorker, &FileWorker::cancelOperation, Qt::QueuedConnection);
+    // The control block is thread-safe, no need to go through the worker's event queue
+    connect(m_cancelButton, &QPushButton::clicked, this, [this]() {
+        if (m_control)
+            m_control->cancel();
+    });
+    connect(m_pauseButton, &QPushButton::clicked, this, &MainWindow::pauseOperation);
+    connect(m_resumeButton, &QPushButton::clicked, this, &MainWindow::resumeOperation);
 
     connect(m_fileWorker, &FileWorker::cancelOperation_, this, &MainWindow::cancelOperation, Qt::QueuedConnection);
+    connect(m_fileWorker, &FileWorker::operationReport, this, &MainWindow::onOperationReport);
+    connect(m_fileWorker, &FileWorker::checksumsComputed, this, &MainWindow::onChecksumsComputed);
+    connect(m_fileWorker, &FileWorker::saveVerified, this, &MainWindow::onSaveVerified);
+    connect(m_fileWorker, &FileWorker::contentAnalyzed, this, &MainWindow::onContentAnalyzed);
+
+    // Progress is sampled from the control block on a timer of its own, the
+    // cube renders nothing while it is idle or hidden
+    m_progressTimer = new QTimer(this);
+    m_progressTimer->setInterval(50);
+    connect(m_progressTimer, &QTimer::timeout, this, &MainWindow::updateProgress);
+
+    // Queued jobs run on the scheduler's own workers
+    m_jobsTimer = new QTimer(this);
+    m_jobsTimer->setInterval(250);
+    connect(m_jobsTimer, &QTimer::timeout, this, &MainWindow::updateJobProgress);
+    connect(m_scheduler, &JobScheduler::jobAdded, this, &MainWindow::onJobAdded);
+    connect(m_scheduler, &JobScheduler::jobChanged, this, &MainWindow::updateJobRow);
+    connect(m_scheduler, &JobScheduler::jobReport, this, [this](int id, const QString &report) {
+        m_infoTextEdit->append(QString("Job %1: %2").arg(id).arg(report));
+    });
+    connect(m_scheduler, &JobScheduler::jobChecksums, this,
+            [this](int id, const QString &operation, const Checksums &checksums) {
+        m_infoTextEdit->append(QString("Job %1: %2 checksums: %3").arg(id).arg(operation, checksums.toString()));
+    });
+    connect(m_scheduler, &JobScheduler::jobVerified, this, [this](int id, bool matches, const QString &details) {
+        m_infoTextEdit->append(QString("Job %1: verification %2: %3")
+                                   .arg(id)
+                                   .arg(matches ? "passed" : "FAILED", details));
+    });
+    connect(m_scheduler, &JobScheduler::jobError, this, [this](int id, const QString &error) {
+        m_infoTextEdit->append(QString("Job %1 failed: %2").arg(id).arg(error));
+    });
 
     m_workerThread->start();
 }
@@ -76,6 +133,9 @@ void MainWindow::setupUI()
     m_browseSourceButton = new QPushButton("Browse...", this);
     m_readButton = new QPushButton("Read File", this);
     m_readButton->setEnabled(false);
+    m_previewButton = new QPushButton("Preview", this);
+    m_previewButton->setToolTip("Show the file in the preview without reading it");
+    m_previewButton->setEnabled(false);
     
     // Destination file selection
     m_destinationPathEdit = new QLineEdit(this);
@@ -83,11 +143,19 @@ void MainWindow::setupUI()
     m_browseDestinationButton = new QPushButton("Browse...", this);
     m_saveButton = new QPushButton("Save File", this);
     m_saveButton->setEnabled(false);
+    m_streamCopyButton = new QPushButton("Stream Copy", this);
+    m_streamCopyButton->setToolTip("Copy the source file to the destination without loading it into memory");
+    m_streamCopyButton->setEnabled(false);
     
     // Progress bar
     m_progressBar = new QProgressBar(this);
     m_progressBar->setVisible(false);
     m_progressBar->setAlignment(Qt::AlignCenter);
+
+    // Live throughput, ETA and latency below the progress bar
+    m_metricsLabel = new QLabel(this);
+    m_metricsLabel->setVisible(false);
+    m_metricsLabel->setAlignment(Qt::AlignCenter);
     
     // Status label
     m_statusLabel = new QLabel("Ready", this);
@@ -111,15 +179,159 @@ void MainWindow::setupUI()
     speedLayout->addWidget(m_speedSlider);
     speedLayout->addWidget(maxSpeedLabel);    
 
+    // Read mode
+    QLabel *readModeLabel = new QLabel("Read Mode:", this);
+    m_readModeCombo = new QComboBox(this);
+    m_readModeCombo->addItem("Buffered", QVariant::fromValue(static_cast<int>(TransferOptions::ReadMode::Buffered)));
+    m_readModeCombo->addItem("Memory-mapped", QVariant::fromValue(static_cast<int>(TransferOptions::ReadMode::Mapped)));
+    m_readModeCombo->setToolTip("Buffered copies the file into memory, memory-mapped reads it in place");
+
+    // I/O backend
+    QLabel *ioBackendLabel = new QLabel("I/O:", this);
+    m_ioBackendCombo = new QComboBox(this);
+    m_ioBackendCombo->addItem("QFile", QVariant::fromValue(static_cast<int>(TransferOptions::IoBackend::Blocking)));
+    m_ioBackendCombo->addItem("io_uring", QVariant::fromValue(static_cast<int>(TransferOptions::IoBackend::IoUring)));
+    m_ioBackendCombo->setToolTip("io_uring keeps many requests in flight, it falls back to QFile when unavailable");
+
+    QLabel *queueDepthLabel = new QLabel("Queue Depth:", this);
+    m_queueDepthSpin = new QSpinBox(this);
+    m_queueDepthSpin->setRange(1, 256);
+    m_queueDepthSpin->setValue(TransferOptions().queueDepth);
+    m_queueDepthSpin->setToolTip("Number of io_uring requests in flight");
+
+    QLabel *blockSizeLabel = new QLabel("Block:", this);
+    m_blockSizeCombo = new QComboBox(this);
+    for (qint64 blockSize = 64 * 1024; blockSize <= 16 * 1024 * 1024; blockSize *= 2)
+        m_blockSizeCombo->addItem(formatFileSize(blockSize), QVariant::fromValue(blockSize));
+    m_blockSizeCombo->setCurrentIndex(m_blockSizeCombo->findData(QVariant::fromValue(TransferOptions().blockSize)));
+    m_blockSizeCombo->setToolTip("Size of each io_uring request");
+
+    QLabel *readThreadsLabel = new QLabel("Threads:", this);
+    m_readThreadsSpin = new QSpinBox(this);
+    m_readThreadsSpin->setRange(0, 64);
+    m_readThreadsSpin->setSpecialValueText("Auto");
+    m_readThreadsSpin->setValue(TransferOptions().readThreads);
+    m_readThreadsSpin->setToolTip("Concurrent pread workers for large files. Auto picks 1 for spinning disks, "
+                                  "more for SSDs, NVMe and network file systems");
+
+    m_bypassCacheCheck = new QCheckBox("Bypass Page Cache", this);
+    m_bypassCacheCheck->setToolTip("Read and save with O_DIRECT (or drop cached ranges) so other processes keep their cache");
+
+    m_adaptiveChunkCheck = new QCheckBox("Adaptive Chunk Size", this);
+    m_adaptiveChunkCheck->setChecked(TransferOptions().adaptiveChunkSize);
+    m_adaptiveChunkCheck->setToolTip("Tune the QFile request size to the device, remembered between runs");
+
+    QLabel *memoryBudgetLabel = new QLabel("Memory:", this);
+    m_memoryBudgetCombo = new QComboBox(this);
+    m_memoryBudgetCombo->addItem("Auto", QVariant::fromValue<qint64>(0));
+    for (qint64 budget = qint64(1) << 30; budget <= qint64(64) << 30; budget *= 2)
+        m_memoryBudgetCombo->addItem(formatFileSize(budget), QVariant::fromValue(budget));
+    m_memoryBudgetCombo->addItem("Unlimited", QVariant::fromValue<qint64>(-1));
+    m_memoryBudgetCombo->setCurrentIndex(m_memoryBudgetCombo->findData(QVariant::fromValue(TransferOptions().memoryBudget)));
+    m_memoryBudgetCombo->setToolTip("Reads that do not fit into this next to the buffers already held are kept "
+                                    "in an unlinked file with only a small window in memory. Auto is half the "
+                                    "physical memory.");
+
+    m_checksumsCheck = new QCheckBox("Checksums", this);
+    m_checksumsCheck->setChecked(TransferOptions().checksums);
+    m_checksumsCheck->setToolTip(QString("CRC32C%1%2 of every read and save, computed on a helper thread")
+                                     .arg(Crc32cHasher::isHardwareAccelerated() ? " (hardware)" : "")
+                                     .arg(Checksums::available(false).testFlag(Checksums::Xxh3) ? " and xxHash3" : ""));
+
+    m_sha256Check = new QCheckBox("SHA-256", this);
+    m_sha256Check->setChecked(TransferOptions().sha256);
+    m_sha256Check->setToolTip("Also compute SHA-256, considerably slower than CRC32C");
+
+    m_verifyCheck = new QCheckBox("Verify Saved File", this);
+    m_verifyCheck->setChecked(TransferOptions().verifyAfterSave);
+    m_verifyCheck->setToolTip("Re-read the saved file and compare it with the source checksums");
+
+    m_resumableCheck = new QCheckBox("Resumable Saves", this);
+    m_resumableCheck->setChecked(TransferOptions().resumable);
+    m_resumableCheck->setToolTip("Keep a journal next to large saves and copies, so saving again after a cancel "
+                                 "or a crash continues where it stopped");
+
+    m_deltaSaveCheck = new QCheckBox("Delta Save", this);
+    m_deltaSaveCheck->setChecked(TransferOptions().deltaSave);
+    m_deltaSaveCheck->setToolTip("Saving over an existing file compares it block by block with the data "
+                                 "and rewrites only the blocks that changed");
+
+    m_punchZerosCheck = new QCheckBox("Punch Zero Runs", this);
+    m_punchZerosCheck->setChecked(TransferOptions().punchZeros);
+    m_punchZerosCheck->setToolTip("Leave runs of zeros out of saved files as holes. Holes of sparse files "
+                                  "are always kept.");
+
+    m_compressCheck = new QCheckBox("Compress", this);
+    m_compressCheck->setChecked(TransferOptions().compress);
+    m_compressCheck->setToolTip(QString("Save as independently compressed blocks (%1) on all cores. "
+                                        "Reading such a file decompresses it.")
+                                    .arg(CompressedFile::codecName(CompressedFile::defaultCodec())));
+
+    m_analyzeCheck = new QCheckBox("Analyze Content", this);
+    m_analyzeCheck->setChecked(TransferOptions().analyzeContent);
+    m_analyzeCheck->setToolTip("Byte histogram, entropy and a text/binary/compressed guess of every read, "
+                               "computed on a helper thread while the file is read");
+
+    connect(m_checksumsCheck, &QCheckBox::toggled, m_sha256Check, &QWidget::setEnabled);
+    connect(m_checksumsCheck, &QCheckBox::toggled, m_verifyCheck, &QWidget::setEnabled);
+
+    auto updateIoControls = [this]() {
+        bool uring = m_ioBackendCombo->currentData().toInt() == static_cast<int>(TransferOptions::IoBackend::IoUring);
+        m_queueDepthSpin->setEnabled(uring);
+        m_blockSizeCombo->setEnabled(uring);
+        m_readThreadsSpin->setEnabled(!uring);
+    };
+    connect(m_ioBackendCombo, &QComboBox::currentIndexChanged, this, updateIoControls);
+    updateIoControls();
+
     m_cancelButton = new QPushButton("Cancel Operation", this);
     m_cancelButton->setToolTip("Cancel operation");
+    m_pauseButton = new QPushButton("Pause", this);
+    m_pauseButton->setToolTip("Pause the current operation");
+    m_resumeButton = new QPushButton("Resume", this);
+    m_resumeButton->setToolTip("Continue the paused operation");
 
     // Layout for controls
-    QHBoxLayout *controlsLayout = new QHBoxLayout(controlsGroup);    
-    controlsLayout->addWidget(speedLabel);
-    controlsLayout->addLayout(speedLayout);
-    controlsLayout->addStretch();
-    controlsLayout->addWidget(m_cancelButton);    
+    QVBoxLayout *controlsLayout = new QVBoxLayout(controlsGroup);
+
+    QHBoxLayout *operationLayout = new QHBoxLayout;
+    operationLayout->addWidget(speedLabel);
+    operationLayout->addLayout(speedLayout);
+    operationLayout->addStretch();
+    operationLayout->addWidget(m_pauseButton);
+    operationLayout->addWidget(m_resumeButton);
+    operationLayout->addWidget(m_cancelButton);
+    controlsLayout->addLayout(operationLayout);
+
+    QHBoxLayout *ioLayout = new QHBoxLayout;
+    ioLayout->addWidget(readModeLabel);
+    ioLayout->addWidget(m_readModeCombo);
+    ioLayout->addWidget(ioBackendLabel);
+    ioLayout->addWidget(m_ioBackendCombo);
+    ioLayout->addWidget(queueDepthLabel);
+    ioLayout->addWidget(m_queueDepthSpin);
+    ioLayout->addWidget(blockSizeLabel);
+    ioLayout->addWidget(m_blockSizeCombo);
+    ioLayout->addWidget(readThreadsLabel);
+    ioLayout->addWidget(m_readThreadsSpin);
+    ioLayout->addWidget(m_bypassCacheCheck);
+    ioLayout->addWidget(m_adaptiveChunkCheck);
+    ioLayout->addWidget(memoryBudgetLabel);
+    ioLayout->addWidget(m_memoryBudgetCombo);
+    ioLayout->addStretch();
+    controlsLayout->addLayout(ioLayout);
+
+    QHBoxLayout *integrityLayout = new QHBoxLayout;
+    integrityLayout->addWidget(m_checksumsCheck);
+    integrityLayout->addWidget(m_sha256Check);
+    integrityLayout->addWidget(m_verifyCheck);
+    integrityLayout->addWidget(m_resumableCheck);
+    integrityLayout->addWidget(m_deltaSaveCheck);
+    integrityLayout->addWidget(m_punchZerosCheck);
+    integrityLayout->addWidget(m_compressCheck);
+    integrityLayout->addWidget(m_analyzeCheck);
+    integrityLayout->addStretch();
+    controlsLayout->addLayout(integrityLayout);
 
     // File information display
     QLabel *infoLabel = new QLabel("File Information:", this);
@@ -127,6 +339,18 @@ void MainWindow::setupUI()
 
     m_infoTextEdit = new QTextEdit(this);
     m_infoTextEdit->setReadOnly(true);    
+
+    // Content preview, formats only the rows on screen
+    QLabel *previewLabel = new QLabel("Content Preview:", this);
+    previewLabel->setStyleSheet("QLabel { font-weight: bold; }");
+    m_previewModeCombo = new QComboBox(this);
+    m_previewModeCombo->addItem("Hex", static_cast<int>(HexView::Mode::Hex));
+    m_previewModeCombo->addItem("Text", static_cast<int>(HexView::Mode::Text));
+    m_contentPreview = new HexView(this);
+    m_contentPreview->setMinimumHeight(160);
+    connect(m_previewModeCombo, &QComboBox::currentIndexChanged, this, [this]() {
+        m_contentPreview->setMode(static_cast<HexView::Mode>(m_previewModeCombo->currentData().toInt()));
+    });
     
     // Layout
     QVBoxLayout *mainLayout = new QVBoxLayout(centralWidget);
@@ -137,6 +361,7 @@ void MainWindow::setupUI()
     sourceLayout->addWidget(m_sourcePathEdit, 1);
     sourceLayout->addWidget(m_browseSourceButton);
     sourceLayout->addWidget(m_readButton);
+    sourceLayout->addWidget(m_previewButton);
     mainLayout->addLayout(sourceLayout);
     
     // Destination file selection row
@@ -145,10 +370,12 @@ void MainWindow::setupUI()
     destLayout->addWidget(m_destinationPathEdit, 1);
     destLayout->addWidget(m_browseDestinationButton);
     destLayout->addWidget(m_saveButton);
+    destLayout->addWidget(m_streamCopyButton);
     mainLayout->addLayout(destLayout);
     
     // Progress bar
     mainLayout->addWidget(m_progressBar);
+    mainLayout->addWidget(m_metricsLabel);
     
     // Status
     mainLayout->addWidget(m_statusLabel);
@@ -157,8 +384,17 @@ void MainWindow::setupUI()
     mainLayout->addWidget(infoLabel);
     mainLayout->addWidget(m_infoTextEdit);
 
+    // Content preview
+    QHBoxLayout *previewLayout = new QHBoxLayout;
+    previewLayout->addWidget(previewLabel);
+    previewLayout->addStretch();
+    previewLayout->addWidget(m_previewModeCombo);
+    mainLayout->addLayout(previewLayout);
+    mainLayout->addWidget(m_contentPreview);
+
     // Rotate
     mainLayout->addWidget(controlsGroup);
+    mainLayout->addWidget(createJobsGroup());
             
     openglGroup = new QGroupBox(tr("Cube (rotation around axes and color change)"));
 
@@ -259,23 +495,112 @@ void MainWindow::setupUI()
     connect(m_browseSourceButton, &QPushButton::clicked, this, &MainWindow::selectSourceFile);
     connect(m_browseDestinationButton, &QPushButton::clicked, this, &MainWindow::selectDestinationFile);
     connect(m_readButton, &QPushButton::clicked, this, &MainWindow::readFile);
+    connect(m_previewButton, &QPushButton::clicked, this, &MainWindow::previewFile);
     connect(m_saveButton, &QPushButton::clicked, this, &MainWindow::saveFile);
+    connect(m_streamCopyButton, &QPushButton::clicked, this, &MainWindow::streamCopy);
     
     connect(m_sourcePathEdit, &QLineEdit::textChanged, [this](const QString &text) {
-        m_readButton->setEnabled(!text.isEmpty());
-        if (!text.isEmpty()) {
+        updateButtons();
+        if (!text.isEmpty())
             updateFileInfo(text);
-        }
+        else
+            m_fileInfoLoader->cancel();
     });
     
-    connect(m_destinationPathEdit, &QLineEdit::textChanged, [this](const QString &text) {
-        m_saveButton->setEnabled(!text.isEmpty() && m_fileLoaded);
-    });
+    connect(m_destinationPathEdit, &QLineEdit::textChanged, this, &MainWindow::updateButtons);
 
     connect(m_speedSlider, &QSlider::valueChanged, glWidget, &GLWidget::setRotationSpeed);
 
     setWindowTitle("CubeReadWriteFile");
-    resize(800, 800);
+    resize(800, 960);
+}
+
+QGroupBox *MainWindow::createJobsGroup()
+{
+    QGroupBox *jobsGroup = new QGroupBox("Job Queue", this);
+
+    QPushButton *addReadJobsButton = new QPushButton("Queue Reads...", this);
+    addReadJobsButton->setToolTip("Read one or more files in the background and report their checksums");
+    QPushButton *addCopyJobsButton = new QPushButton("Queue Copies...", this);
+    addCopyJobsButton->setToolTip("Copy one or more files into a folder in the background");
+    m_addSaveJobButton = new QPushButton("Queue Save", this);
+    m_addSaveJobButton->setToolTip("Save the loaded file to the destination in the background");
+    m_addSaveJobButton->setEnabled(false);
+
+    QLabel *priorityLabel = new QLabel("Priority:", this);
+    m_jobPrioritySpin = new QSpinBox(this);
+    m_jobPrioritySpin->setRange(-10, 10);
+    m_jobPrioritySpin->setValue(0);
+    m_jobPrioritySpin->setToolTip("Priority of new jobs and of the selected queued job, higher runs first");
+
+    QLabel *deviceLimitLabel = new QLabel("Per Device:", this);
+    m_deviceLimitSpin = new QSpinBox(this);
+    m_deviceLimitSpin->setRange(1, 16);
+    m_deviceLimitSpin->setValue(m_scheduler->deviceLimit());
+    m_deviceLimitSpin->setToolTip(QString("Jobs running at the same time on one device, %1 at most overall")
+                                      .arg(m_scheduler->workerCount()));
+
+    m_jobsTable = new QTableWidget(0, 7, this);
+    m_jobsTable->setHorizontalHeaderLabels({"#", "Job", "File", "Priority", "State", "Progress", "Throughput"});
+    m_jobsTable->setSelectionBehavior(QAbstractItemView::SelectRows);
+    m_jobsTable->setSelectionMode(QAbstractItemView::SingleSelection);
+    m_jobsTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    m_jobsTable->verticalHeader()->setVisible(false);
+    m_jobsTable->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+    m_jobsTable->horizontalHeader()->setSectionResizeMode(2, QHeaderView::Stretch);
+    m_jobsTable->setMaximumHeight(160);
+
+    QPushButton *pauseJobButton = new QPushButton("Pause Job", this);
+    QPushButton *resumeJobButton = new QPushButton("Resume Job", this);
+    QPushButton *cancelJobButton = new QPushButton("Cancel Job", this);
+    QPushButton *clearJobsButton = new QPushButton("Clear Finished", this);
+
+    QHBoxLayout *addLayout = new QHBoxLayout;
+    addLayout->addWidget(addReadJobsButton);
+    addLayout->addWidget(addCopyJobsButton);
+    addLayout->addWidget(m_addSaveJobButton);
+    addLayout->addStretch();
+    addLayout->addWidget(priorityLabel);
+    addLayout->addWidget(m_jobPrioritySpin);
+    addLayout->addWidget(deviceLimitLabel);
+    addLayout->addWidget(m_deviceLimitSpin);
+
+    QHBoxLayout *jobControlLayout = new QHBoxLayout;
+    jobControlLayout->addStretch();
+    jobControlLayout->addWidget(pauseJobButton);
+    jobControlLayout->addWidget(resumeJobButton);
+    jobControlLayout->addWidget(cancelJobButton);
+    jobControlLayout->addWidget(clearJobsButton);
+
+    QVBoxLayout *jobsLayout = new QVBoxLayout(jobsGroup);
+    jobsLayout->addLayout(addLayout);
+    jobsLayout->addWidget(m_jobsTable);
+    jobsLayout->addLayout(jobControlLayout);
+
+    connect(addReadJobsButton, &QPushButton::clicked, this, &MainWindow::addReadJobs);
+    connect(addCopyJobsButton, &QPushButton::clicked, this, &MainWindow::addCopyJobs);
+    connect(m_addSaveJobButton, &QPushButton::clicked, this, &MainWindow::addSaveJob);
+    connect(clearJobsButton, &QPushButton::clicked, this, &MainWindow::clearFinishedJobs);
+    connect(pauseJobButton, &QPushButton::clicked, this, [this]() {
+        m_scheduler->pause(selectedJobId());
+    });
+    connect(resumeJobButton, &QPushButton::clicked, this, [this]() {
+        m_scheduler->resume(selectedJobId());
+    });
+    connect(cancelJobButton, &QPushButton::clicked, this, [this]() {
+        m_scheduler->cancel(selectedJobId());
+    });
+    connect(m_deviceLimitSpin, &QSpinBox::valueChanged, m_scheduler, &JobScheduler::setDeviceLimit);
+    connect(m_jobPrioritySpin, &QSpinBox::valueChanged, this, [this](int priority) {
+        m_scheduler->setPriority(selectedJobId(), priority);
+    });
+    connect(m_jobsTable, &QTableWidget::currentCellChanged, this, [this]() {
+        JobScheduler::Job job = m_scheduler->job(selectedJobId());
+        if (job.state == JobScheduler::State::Queued)
+            m_jobPrioritySpin->setValue(job.priority);
+    });
+
+    return jobsGroup;
 }
 
 void MainWindow::selectSourceFile()
@@ -317,14 +642,41 @@ void MainWindow::readFile()
     }    
 
     resetUI();
+
+    // Release the previous buffer before the new one is allocated, the
+    // preview holds a copy
+    m_contentPreview->clear();
+    m_fileData.clear();
+    m_fileLoaded = false;
+
     m_progressBar->setVisible(true);
     m_progressBar->setFormat("Reading: %p%");
+    startMetrics("Reading");
     m_statusLabel->setText("Reading file...");
-    m_readButton->setEnabled(false);
-    m_browseSourceButton->setEnabled(false);    
+    setOperationRunning(true);
 
+    m_control = QSharedPointer<OperationControl>::create();
     QMetaObject::invokeMethod(m_fileWorker, "readFile", Qt::QueuedConnection,
-                             Q_ARG(QString, m_currentSourcePath));
+                             Q_ARG(QString, m_currentSourcePath),
+                             Q_ARG(TransferOptions, currentOptions()),
+                             Q_ARG(QSharedPointer<OperationControl>, m_control));
+}
+
+void MainWindow::previewFile()
+{
+    QString filePath = m_sourcePathEdit->text();
+    if (!QFileInfo(filePath).isFile()) {
+        QMessageBox::warning(this, "Error", "Selected path is not a file.");
+        return;
+    }
+
+    // Read page by page, so even huge files open at once
+    QString error;
+    if (!m_contentPreview->openFile(filePath, &error)) {
+        QMessageBox::warning(this, "Error", QString("Cannot preview the file: %1").arg(error));
+        return;
+    }
+    m_statusLabel->setText(QString("Previewing %1").arg(QFileInfo(filePath).fileName()));
 }
 
 void MainWindow::saveFile()
@@ -341,40 +693,170 @@ void MainWindow::saveFile()
 
     m_progressBar->setVisible(true);
     m_progressBar->setFormat("Saving: %p%");
+    startMetrics("Saving");
+    m_verificationFailed = false;
     m_statusLabel->setText("Saving file...");
-    m_saveButton->setEnabled(false);
-    m_browseDestinationButton->setEnabled(false);    
+    setOperationRunning(true);
+    releasePreview(m_currentDestinationPath);
 
+    m_control = QSharedPointer<OperationControl>::create();
     QMetaObject::invokeMethod(m_fileWorker, "saveFile", Qt::QueuedConnection,
                              Q_ARG(QString, m_currentDestinationPath),
-                             Q_ARG(QByteArray, m_fileData));
+                             Q_ARG(ChunkBuffer, m_fileData),
+                             Q_ARG(TransferOptions, currentOptions()),
+                             Q_ARG(QSharedPointer<OperationControl>, m_control));
+}
+
+void MainWindow::streamCopy()
+{
+    if (m_currentSourcePath.isEmpty() || m_currentDestinationPath.isEmpty()) {
+        QMessageBox::warning(this, "Error", "Please select a source and a destination file first.");
+        return;
+    }
+
+    QFileInfo fileInfo(m_currentSourcePath);
+    if (!fileInfo.isFile()) {
+        QMessageBox::warning(this, "Error", "Selected source file does not exist.");
+        return;
+    }
+    if (FileWorker::isSameFile(m_currentSourcePath, m_currentDestinationPath)) {
+        QMessageBox::warning(this, "Error", "Source and destination are the same file.");
+        return;
+    }
+
+    resetUI();
+    m_progressBar->setVisible(true);
+    m_progressBar->setFormat("Copying: %p%");
+    startMetrics("Copying");
+    m_verificationFailed = false;
+    m_statusLabel->setText("Copying file...");
+    setOperationRunning(true);
+    releasePreview(m_currentDestinationPath);
+
+    m_control = QSharedPointer<OperationControl>::create();
+    QMetaObject::invokeMethod(m_fileWorker, "streamCopy", Qt::QueuedConnection,
+                             Q_ARG(QString, m_currentSourcePath),
+                             Q_ARG(QString, m_currentDestinationPath),
+                             Q_ARG(TransferOptions, currentOptions()),
+                             Q_ARG(QSharedPointer<OperationControl>, m_control));
 }
 
-void MainWindow::onReadProgress(qint64 bytesRead, qint64 totalBytes)
+void MainWindow::updateProgress()
 {
-    if (totalBytes > 0) {
-        int percentage = static_cast<int>((bytesRead * 100) / totalBytes);
-        m_progressBar->setValue(percentage);
-        m_progressBar->setFormat(QString("Reading: %p% (%1 / %2)")
-                                .arg(formatFileSize(bytesRead))
+    if (!m_control || !m_progressBar->isVisible())
+        return;
+
+    // Sampled on every tick, also while stalled or paused: the EWMA needs
+    // every interval and the rate has to fall to zero when nothing moves
+    TransferMetrics::Snapshot metrics = m_control->sampleMetrics();
+    glWidget->setThroughput(metrics.currentMBps);
+
+    qint64 bytesDone = metrics.bytesDone;
+    qint64 totalBytes = metrics.totalBytes;
+    qint64 storedBytes = m_control->storedBytes();
+    if (bytesDone != m_displayedBytes && totalBytes > 0) {
+        m_displayedBytes = bytesDone;
+        m_progressBar->setValue(static_cast<int>((bytesDone * 100) / totalBytes));
+        m_progressBar->setFormat(QString("%1: %p% (%2 / %3)")
+                                .arg(m_operationName)
+                                .arg(formatFileSize(bytesDone))
                                 .arg(formatFileSize(totalBytes)));
+
+        // Compressed transfers show what went to or came from the disk as well
+        if (storedBytes >= 0)
+            m_progressBar->setFormat(m_progressBar->format() + QString(", %1 compressed").arg(formatFileSize(storedBytes)));
+    }
+
+    // The text only changes a few times a second
+    if (m_metricsTimer.elapsed() >= 250) {
+        QString text = TransferMetrics::format(metrics);
+        if (storedBytes >= 0 && bytesDone > 0)
+            text += QString(" | %1 MB/s compressed").arg(metrics.currentMBps * storedBytes / bytesDone, 0, 'f', 1);
+        m_metricsLabel->setText(text);
+        m_metricsTimer.restart();
     }
 }
 
-void MainWindow::onReadFinished(const QByteArray &data)
+void MainWindow::startMetrics(const QString &operationName)
+{
+    m_operationName = operationName;
+    m_displayedBytes = -1;
+    m_metricsLabel->clear();
+    m_metricsLabel->setVisible(true);
+    m_metricsTimer.start();
+    m_progressTimer->start();
+}
+
+void MainWindow::finishMetrics(bool failed)
+{
+    m_progressTimer->stop();
+    glWidget->setThroughput(-1.0);
+
+    // A cancelled read reports both readFinished and cancelOperation_
+    if (!m_control || m_operationName.isEmpty())
+        return;
+
+    OperationSummary summary;
+    summary.name = m_operationName;
+    summary.outcome = failed ? "failed" : m_control->isCancelled() ? "cancelled" : "finished";
+    summary.metrics = m_control->sampleMetrics();
+    m_operationName.clear();
+    m_metricsLabel->setVisible(false);
+
+    QString report = QString("%1 %2: %3 in %4 ms\n%5")
+                         .arg(summary.name)
+                         .arg(summary.outcome)
+                         .arg(formatFileSize(summary.metrics.bytesDone))
+                         .arg(summary.metrics.elapsedMs)
+                         .arg(TransferMetrics::format(summary.metrics));
+
+    // Compare with the last completed operation of the same kind
+    for (int index = m_operationHistory.size() - 1; index >= 0; --index) {
+        const OperationSummary &previous = m_operationHistory.at(index);
+        if (previous.name != summary.name || previous.outcome != "finished")
+            continue;
+        if (summary.outcome != "finished")
+            break;
+        if (previous.metrics.averageMBps > 0.0) {
+            report += QString("\nvs previous %1: %2 MB/s -> %3 MB/s (%4%)")
+                          .arg(summary.name.toLower())
+                          .arg(previous.metrics.averageMBps, 0, 'f', 1)
+                          .arg(summary.metrics.averageMBps, 0, 'f', 1)
+                          .arg((summary.metrics.averageMBps / previous.metrics.averageMBps - 1.0) * 100.0,
+                               0, 'f', 1);
+        }
+        break;
+    }
+
+    m_operationHistory.append(summary);
+    m_infoTextEdit->append(report);
+}
+
+void MainWindow::onReadFinished(const ChunkBuffer &data)
 {
     m_fileData = data;
     m_fileLoaded = true;
+    m_contentPreview->setData(data);
     
     m_progressBar->setVisible(false);
     m_statusLabel->setText(QString("File read successfully! Size: %1").arg(formatFileSize(data.size())));
-    m_readButton->setEnabled(true);
-    m_browseSourceButton->setEnabled(true);
-    m_saveButton->setEnabled(!m_destinationPathEdit->text().isEmpty());    
+    if (data.isSpilled()) {
+        qint64 resident = data.residentBytes();
+        if (resident < 0) {
+            m_statusLabel->setText(m_statusLabel->text() + " (spilled to disk)");
+        } else {
+            m_statusLabel->setText(m_statusLabel->text()
+                                   + QString(" (%1 in memory, %2 spilled to disk)")
+                                         .arg(formatFileSize(resident), formatFileSize(data.size() - resident)));
+        }
+    }
+    setOperationRunning(false);
 
     QString currentInfo = m_infoTextEdit->toPlainText();
     currentInfo += QString("\nRead completed in: %1 ms").arg(m_fileWorker->getLastOperationTime());
     m_infoTextEdit->setPlainText(currentInfo);
+
+    finishMetrics();
 }
 
 void MainWindow::onReadError(const QString &error)
@@ -382,30 +864,28 @@ void MainWindow::onReadError(const QString &error)
     m_progressBar->setVisible(false);
     m_statusLabel->setText("Error reading file");
     m_statusLabel->setStyleSheet("QLabel { color: red; font-weight: bold; }");
-    m_readButton->setEnabled(true);
-    m_browseSourceButton->setEnabled(true);
+    setOperationRunning(false);
+    finishMetrics(true);
     
     QMessageBox::critical(this, "Read Error", error);
 }
 
-void MainWindow::onSaveProgress(qint64 bytesWritten, qint64 totalBytes)
-{
-    if (totalBytes > 0) {
-        int percentage = static_cast<int>((bytesWritten * 100) / totalBytes);
-        m_progressBar->setValue(percentage);
-        m_progressBar->setFormat(QString("Saving: %p% (%1 / %2)")
-                                .arg(formatFileSize(bytesWritten))
-                                .arg(formatFileSize(totalBytes)));
-    }
-}
-
 void MainWindow::onSaveFinished()
 {
     m_progressBar->setVisible(false);
+    setOperationRunning(false);
+    finishMetrics();
+
+    if (m_verificationFailed) {
+        m_statusLabel->setText("File saved, but verification failed!");
+        m_statusLabel->setStyleSheet("QLabel { color: red; font-weight: bold; }");
+        QMessageBox::warning(this, "Verification Failed",
+                             "The saved file does not match its source, see File Information.");
+        return;
+    }
+
     m_statusLabel->setText("File saved successfully!");
     m_statusLabel->setStyleSheet("QLabel { color: green; font-weight: bold; }");
-    m_saveButton->setEnabled(true);
-    m_browseDestinationButton->setEnabled(true);
     
     QMessageBox::information(this, "Success", "File saved successfully!");
 }
@@ -415,36 +895,62 @@ void MainWindow::onSaveError(const QString &error)
     m_progressBar->setVisible(false);
     m_statusLabel->setText("Error saving file");
     m_statusLabel->setStyleSheet("QLabel { color: red; font-weight: bold; }");
-    m_saveButton->setEnabled(true);
-    m_browseDestinationButton->setEnabled(true);
+    setOperationRunning(false);
+    finishMetrics(true);
     
     QMessageBox::critical(this, "Save Error", error);
 }
 
+void MainWindow::onOperationReport(const QString &report)
+{
+    m_infoTextEdit->append(report);
+}
+
+void MainWindow::onChecksumsComputed(const QString &operation, const Checksums &checksums)
+{
+    m_infoTextEdit->append(QString("%1 checksums: %2").arg(operation, checksums.toString()));
+}
+
+void MainWindow::onSaveVerified(bool matches, const QString &details)
+{
+    // Arrives right before saveFinished, which reports the outcome
+    m_infoTextEdit->append(QString("Verification %1: %2").arg(matches ? "passed" : "FAILED", details));
+    m_verificationFailed = !matches;
+}
+
+void MainWindow::onContentAnalyzed(const ByteStatistics &statistics)
+{
+    m_infoTextEdit->append(statistics.toString());
+}
+
 void MainWindow::updateFileInfo(const QString &filePath)
 {
-    QFileInfo fileInfo(filePath);
-    if (!fileInfo.exists()) {
+    // Stats and MIME sniffing may block on a slow mount, the loader runs
+    // them off the GUI thread and calls showFileInfo() for the latest path
+    m_fileInfoLoader->request(filePath);
+}
+
+void MainWindow::showFileInfo(const FileMetadata &metadata)
+{
+    if (!metadata.exists) {
         m_infoTextEdit->setPlainText("File does not exist.");
         return;
-    }    
+    }
 
     QString info;
-    info += QString("Name: %1\n").arg(fileInfo.fileName());
-    info += QString("Path: %1\n").arg(fileInfo.absolutePath());
-    info += QString("Size: %1 (%2 bytes)\n").arg(formatFileSize(fileInfo.size())).arg(fileInfo.size());
-    info += QString("Type: %1\n").arg(getFileType(fileInfo.fileName()));
-    info += QString("Created: %1\n").arg(fileInfo.birthTime().toString("yyyy-MM-dd hh:mm:ss"));
-    info += QString("Modified: %1\n").arg(fileInfo.lastModified().toString("yyyy-MM-dd hh:mm:ss"));
-    info += QString("Readable: %1\n").arg(fileInfo.isReadable() ? "Yes" : "No");
-    info += QString("Writable: %1\n").arg(fileInfo.isWritable() ? "Yes" : "No");
-    info += QString("Executable: %1\n").arg(fileInfo.isExecutable() ? "Yes" : "No");    
-
-    QMimeDatabase mimeDatabase;
-    QMimeType mimeType = mimeDatabase.mimeTypeForFile(filePath);
-    info += QString("MIME Type: %1\n").arg(mimeType.name());
-    if (!mimeType.comment().isEmpty()) {
-        info += QString("Description: %1\n").arg(mimeType.comment());
+    info += QString("Name: %1\n").arg(metadata.name);
+    info += QString("Path: %1\n").arg(metadata.path);
+    info += QString("Size: %1 (%2 bytes)\n").arg(formatFileSize(metadata.size)).arg(metadata.size);
+    info += QString("Type: %1\n").arg(getFileType(metadata.name));
+    info += QString("Created: %1\n").arg(metadata.created.toString("yyyy-MM-dd hh:mm:ss"));
+    info += QString("Modified: %1\n").arg(metadata.modified.toString("yyyy-MM-dd hh:mm:ss"));
+    info += QString("Readable: %1\n").arg(metadata.readable ? "Yes" : "No");
+    info += QString("Writable: %1\n").arg(metadata.writable ? "Yes" : "No");
+    info += QString("Executable: %1\n").arg(metadata.executable ? "Yes" : "No");
+
+    info += QString("MIME Type: %1\n").arg(metadata.mimeType);
+    if (!metadata.mimeComment.isEmpty()) {
+        info += QString("Description: %1\n").arg(metadata.mimeComment);
     }
     
     m_infoTextEdit->setPlainText(info);
@@ -454,9 +960,211 @@ void MainWindow::cancelOperation()
 {
     m_progressBar->setVisible(false);
     m_statusLabel->setText(QString("Operation canceled"));
-    m_readButton->setEnabled(true);
-    m_browseSourceButton->setEnabled(true);
-    m_saveButton->setEnabled(!m_destinationPathEdit->text().isEmpty());
+    setOperationRunning(false);
+    finishMetrics();
+}
+
+void MainWindow::pauseOperation()
+{
+    if (!m_control || m_control->state() != OperationControl::State::Running)
+        return;
+
+    m_control->pause();
+    glWidget->setPaused(true);
+    updateButtons();
+    m_statusLabel->setText("Operation paused");
+}
+
+void MainWindow::resumeOperation()
+{
+    if (!m_control)
+        return;
+
+    OperationControl::State state = m_control->state();
+    if (state != OperationControl::State::Pausing && state != OperationControl::State::Paused)
+        return;
+
+    m_control->resume();
+    glWidget->setPaused(false);
+    updateButtons();
+    m_statusLabel->setText("Operation resumed");
+}
+
+void MainWindow::addReadJobs()
+{
+    QStringList fileNames = QFileDialog::getOpenFileNames(this, "Select Files to Read");
+    for (const QString &fileName : fileNames)
+        m_scheduler->addRead(fileName, currentOptions(), m_jobPrioritySpin->value());
+}
+
+void MainWindow::addCopyJobs()
+{
+    QStringList fileNames = QFileDialog::getOpenFileNames(this, "Select Files to Copy");
+    if (fileNames.isEmpty())
+        return;
+
+    QString directory = QFileDialog::getExistingDirectory(this, "Select Destination Folder");
+    if (directory.isEmpty())
+        return;
+
+    for (const QString &fileName : fileNames) {
+        QFileInfo source(fileName);
+        QString destination = QDir(directory).filePath(source.fileName());
+        if (FileWorker::isSameFile(fileName, destination)) {
+            QMessageBox::warning(this, "Error", QString("%1 is already in that folder.").arg(source.fileName()));
+            continue;
+        }
+        releasePreview(destination);
+        m_scheduler->addCopy(fileName, destination, currentOptions(), m_jobPrioritySpin->value());
+    }
+}
+
+void MainWindow::addSaveJob()
+{
+    if (!m_fileLoaded || m_currentDestinationPath.isEmpty()) {
+        QMessageBox::warning(this, "Error", "Please read a file and select a destination file first.");
+        return;
+    }
+
+    // The job shares the loaded chunks, reading another file does not affect it
+    releasePreview(m_currentDestinationPath);
+    m_scheduler->addSave(m_currentDestinationPath, m_fileData, currentOptions(), m_jobPrioritySpin->value());
+}
+
+void MainWindow::onJobAdded(int id)
+{
+    int row = m_jobsTable->rowCount();
+    m_jobsTable->insertRow(row);
+    for (int column = 0; column < m_jobsTable->columnCount(); ++column)
+        m_jobsTable->setItem(row, column, new QTableWidgetItem);
+    m_jobsTable->item(row, 0)->setData(Qt::UserRole, id);
+    m_jobRows.insert(id, row);
+    updateJobRow(id);
+
+    if (!m_jobsTimer->isActive())
+        m_jobsTimer->start();
+}
+
+void MainWindow::updateJobRow(int id)
+{
+    int row = m_jobRows.value(id, -1);
+    if (row < 0)
+        return;
+
+    JobScheduler::Job job = m_scheduler->job(id);
+    QString type;
+    QString file;
+    switch (job.type) {
+    case JobScheduler::Type::Read:
+        type = "Read";
+        file = QFileInfo(job.sourcePath).fileName();
+        break;
+    case JobScheduler::Type::Save:
+        type = "Save";
+        file = QFileInfo(job.destinationPath).fileName();
+        break;
+    case JobScheduler::Type::Copy:
+        type = job.saving ? "Copy (saving)" : "Copy (reading)";
+        file = QString("%1 -> %2").arg(QFileInfo(job.sourcePath).fileName(), job.destinationPath);
+        break;
+    case JobScheduler::Type::StreamCopy:
+        type = "Stream Copy";
+        file = QString("%1 -> %2").arg(QFileInfo(job.sourcePath).fileName(), job.destinationPath);
+        break;
+    }
+
+    QString state = JobScheduler::stateName(job.state);
+    if (job.state == JobScheduler::State::Running && job.control->state() != OperationControl::State::Running)
+        state = job.control->isCancelled() ? "Cancelling" : "Paused";
+    else if (job.state == JobScheduler::State::Finished && job.verificationFailed)
+        state = "Verify failed";
+
+    m_jobsTable->item(row, 0)->setText(QString::number(id));
+    m_jobsTable->item(row, 1)->setText(type);
+    m_jobsTable->item(row, 2)->setText(file);
+    m_jobsTable->item(row, 2)->setToolTip(job.sourcePath.isEmpty() ? job.destinationPath : job.sourcePath);
+    m_jobsTable->item(row, 3)->setText(QString::number(job.priority));
+    m_jobsTable->item(row, 4)->setText(state);
+    m_jobsTable->item(row, 4)->setToolTip(job.error);
+
+    if (!job.control)
+        return;
+
+    // The scheduler's control blocks are sampled here only
+    TransferMetrics::Snapshot metrics = job.control->sampleMetrics();
+    if (metrics.totalBytes > 0) {
+        m_jobsTable->item(row, 5)->setText(QString("%1% (%2 / %3)")
+                                               .arg((metrics.bytesDone * 100) / metrics.totalBytes)
+                                               .arg(formatFileSize(metrics.bytesDone))
+                                               .arg(formatFileSize(metrics.totalBytes)));
+    }
+    double rate = job.state == JobScheduler::State::Running ? metrics.currentMBps : metrics.averageMBps;
+    m_jobsTable->item(row, 6)->setText(QString("%1 MB/s").arg(rate, 0, 'f', 1));
+    m_jobsTable->item(row, 6)->setToolTip(TransferMetrics::format(metrics));
+}
+
+void MainWindow::updateJobProgress()
+{
+    for (auto it = m_jobRows.cbegin(); it != m_jobRows.cend(); ++it) {
+        if (m_scheduler->job(it.key()).state == JobScheduler::State::Running)
+            updateJobRow(it.key());
+    }
+    if (m_scheduler->isIdle())
+        m_jobsTimer->stop();
+}
+
+void MainWindow::clearFinishedJobs()
+{
+    m_scheduler->removeFinished();
+    m_jobsTable->setRowCount(0);
+    m_jobRows.clear();
+    for (int id : m_scheduler->jobIds())
+        onJobAdded(id);
+}
+
+int MainWindow::selectedJobId() const
+{
+    int row = m_jobsTable->currentRow();
+    if (row < 0 || !m_jobsTable->item(row, 0))
+        return 0;
+    return m_jobsTable->item(row, 0)->data(Qt::UserRole).toInt();
+}
+
+// Drops the preview of a file that is about to be rewritten, its rows would
+// otherwise show a mix of the old and the new content
+void MainWindow::releasePreview(const QString &filePath)
+{
+    if (FileWorker::isSameFile(m_contentPreview->filePath(), filePath))
+        m_contentPreview->clear();
+}
+
+// The worker thread runs one operation at a time and m_control belongs to
+// it, so nothing new may start until it has finished, failed or cancelled
+void MainWindow::setOperationRunning(bool running)
+{
+    m_operationRunning = running;
+    updateButtons();
+}
+
+void MainWindow::updateButtons()
+{
+    bool idle = !m_operationRunning;
+    bool hasSource = !m_sourcePathEdit->text().isEmpty();
+    bool hasDestination = !m_destinationPathEdit->text().isEmpty();
+    OperationControl::State state = m_control ? m_control->state() : OperationControl::State::Running;
+    bool paused = state == OperationControl::State::Pausing || state == OperationControl::State::Paused;
+
+    m_readButton->setEnabled(idle && hasSource);
+    m_browseSourceButton->setEnabled(idle);
+    m_saveButton->setEnabled(idle && hasDestination && m_fileLoaded);
+    m_streamCopyButton->setEnabled(idle && hasSource && hasDestination);
+    m_browseDestinationButton->setEnabled(idle);
+    m_addSaveJobButton->setEnabled(idle && m_fileLoaded);
+    m_previewButton->setEnabled(hasSource);
+
+    m_pauseButton->setEnabled(m_operationRunning && !paused);
+    m_resumeButton->setEnabled(m_operationRunning && paused);
+    m_cancelButton->setEnabled(m_operationRunning);
 }
 
 void MainWindow::resetUI()
@@ -490,6 +1198,28 @@ QString MainWindow::getFileType(const QString &fileName) const
     return "File";
 }
 
+TransferOptions MainWindow::currentOptions() const
+{
+    TransferOptions options;
+    options.readMode = static_cast<TransferOptions::ReadMode>(m_readModeCombo->currentData().toInt());
+    options.ioBackend = static_cast<TransferOptions::IoBackend>(m_ioBackendCombo->currentData().toInt());
+    options.queueDepth = m_queueDepthSpin->value();
+    options.blockSize = m_blockSizeCombo->currentData().toLongLong();
+    options.readThreads = m_readThreadsSpin->value();
+    options.bypassCache = m_bypassCacheCheck->isChecked();
+    options.adaptiveChunkSize = m_adaptiveChunkCheck->isChecked();
+    options.memoryBudget = m_memoryBudgetCombo->currentData().toLongLong();
+    options.checksums = m_checksumsCheck->isChecked();
+    options.sha256 = m_sha256Check->isChecked();
+    options.verifyAfterSave = m_verifyCheck->isChecked();
+    options.resumable = m_resumableCheck->isChecked();
+    options.deltaSave = m_deltaSaveCheck->isChecked();
+    options.punchZeros = m_punchZerosCheck->isChecked();
+    options.compress = m_compressCheck->isChecked();
+    options.analyzeContent = m_analyzeCheck->isChecked();
+    return options;
+}
+
 void MainWindow::keyPressEvent(QKeyEvent *e)
 {
     if (isWindow() && e->key() == Qt::Key_Escape)
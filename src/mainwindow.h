@@ -1,7 +1,14 @@
 #pragma once
 
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
 #include <QMainWindow>
-#include <QByteArray>
+#include <QSharedPointer>
+#include "byteanalyzer.h"
+#include "chunkbuffer.h"
+#include "operationcontrol.h"
+#include "transferoptions.h"
 
 class GLWidget;
 class QPushButton;
@@ -14,6 +21,15 @@ class FileWorker;
 class QGroupBox;
 class QSlider;
 class QStandardItemModel;
+class QComboBox;
+class QSpinBox;
+class QCheckBox;
+class QTableWidget;
+class QTimer;
+class JobScheduler;
+class FileInfoLoader;
+class HexView;
+struct FileMetadata;
 
 // QT_BEGIN_NAMESPACE
 // class QGroupBox;
@@ -34,15 +50,30 @@ private slots:
     void selectSourceFile();
     void selectDestinationFile();
     void readFile();
+    void previewFile();
     void saveFile();
-    void onReadProgress(qint64 bytesRead, qint64 totalBytes);
-    void onReadFinished(const QByteArray &data);
+    void streamCopy();
+    void updateProgress();
+    void onReadFinished(const ChunkBuffer &data);
     void onReadError(const QString &error);
-    void onSaveProgress(qint64 bytesWritten, qint64 totalBytes);
     void onSaveFinished();
     void onSaveError(const QString &error);
+    void onOperationReport(const QString &report);
+    void onChecksumsComputed(const QString &operation, const Checksums &checksums);
+    void onSaveVerified(bool matches, const QString &details);
+    void onContentAnalyzed(const ByteStatistics &statistics);
     void updateFileInfo(const QString &filePath);
+    void showFileInfo(const FileMetadata &metadata);
     void cancelOperation();
+    void pauseOperation();
+    void resumeOperation();
+    void addReadJobs();
+    void addCopyJobs();
+    void addSaveJob();
+    void onJobAdded(int id);
+    void updateJobRow(int id);
+    void updateJobProgress();
+    void clearFinishedJobs();
 
 signals:
     void startRead(bool start);
@@ -55,19 +86,31 @@ private:
     void resetUI();
     QString formatFileSize(qint64 size) const;
     QString getFileType(const QString &fileName) const;
+    TransferOptions currentOptions() const;
+    void startMetrics(const QString &operationName);
+    void finishMetrics(bool failed = false);
+    QGroupBox *createJobsGroup();
+    int selectedJobId() const;     // 0 when no job is selected
+    void releasePreview(const QString &filePath);
+    void setOperationRunning(bool running);
+    void updateButtons();
 
     // UI Components
     QLineEdit *m_sourcePathEdit;
     QPushButton *m_browseSourceButton;
     QPushButton *m_readButton;
+    QPushButton *m_previewButton;
     
     QLineEdit *m_destinationPathEdit;
     QPushButton *m_browseDestinationButton;
     QPushButton *m_saveButton;
+    QPushButton *m_streamCopyButton;
     
     QProgressBar *m_progressBar;
+    QLabel *m_metricsLabel;
     QTextEdit *m_infoTextEdit;
-    //QTextEdit *m_contentPreview;
+    HexView *m_contentPreview;    // of the loaded data or a mapped file
+    QComboBox *m_previewModeCombo;
     QLabel *m_statusLabel;
     
     // Worker components
@@ -75,8 +118,25 @@ private:
     QThread *m_workerThread;
     QString m_currentSourcePath;
     QString m_currentDestinationPath;
-    QByteArray m_fileData;
+    QSharedPointer<OperationControl> m_control; // of the running operation
+    QString m_operationName;
+    qint64 m_displayedBytes;
+    QElapsedTimer m_metricsTimer;
+    QTimer *m_progressTimer;    // samples m_control while an operation runs
+    FileInfoLoader *m_fileInfoLoader;   // for the File Information panel
+
+    // Summary of every finished operation, newest last, for comparison
+    struct OperationSummary
+    {
+        QString name;
+        QString outcome;    // finished, cancelled or failed
+        TransferMetrics::Snapshot metrics;
+    };
+    QList<OperationSummary> m_operationHistory;
+    ChunkBuffer m_fileData;
     bool m_fileLoaded;
+    bool m_operationRunning;    // on m_fileWorker, it runs one at a time
+    bool m_verificationFailed;  // of the running save
 
     // For Cube and OpenGL components
     QSlider *createSlider();
@@ -91,7 +151,34 @@ private:
 
     // Controls components  
     QPushButton *m_cancelButton;
+    QPushButton *m_pauseButton;
+    QPushButton *m_resumeButton;
     QSlider *m_speedSlider;
+    QComboBox *m_readModeCombo;
+    QComboBox *m_ioBackendCombo;
+    QSpinBox *m_queueDepthSpin;
+    QComboBox *m_blockSizeCombo;
+    QSpinBox *m_readThreadsSpin;
+    QCheckBox *m_bypassCacheCheck;
+    QCheckBox *m_adaptiveChunkCheck;
+    QComboBox *m_memoryBudgetCombo;
+    QCheckBox *m_checksumsCheck;
+    QCheckBox *m_sha256Check;
+    QCheckBox *m_verifyCheck;
+    QCheckBox *m_resumableCheck;
+    QCheckBox *m_deltaSaveCheck;
+    QCheckBox *m_punchZerosCheck;
+    QCheckBox *m_compressCheck;
+    QCheckBox *m_analyzeCheck;
+
+    // Job queue, runs next to the operation above
+    JobScheduler *m_scheduler;
+    QTableWidget *m_jobsTable;
+    QSpinBox *m_jobPrioritySpin;
+    QSpinBox *m_deviceLimitSpin;
+    QPushButton *m_addSaveJobButton;
+    QTimer *m_jobsTimer;
+    QHash<int, int> m_jobRows;  // job id to table row
 //    QLabel *m_statusLabelRotate;
 };
 
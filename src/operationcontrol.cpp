@@ -0,0 +1,72 @@
+#include "operationcontrol.h"
+#include <QMutexLocker>
+
+OperationControl::OperationControl()
+    : m_state(static_cast<int>(State::Running))
+    , m_bytesDone(0)
+    , m_totalBytes(0)
+    , m_storedBytes(-1)
+{
+}
+
+OperationControl::State OperationControl::state() const
+{
+    return static_cast<State>(m_state.load(std::memory_order_acquire));
+}
+
+bool OperationControl::isCancelled() const
+{
+    return state() == State::Cancelling;
+}
+
+void OperationControl::pause()
+{
+    int expected = static_cast<int>(State::Running);
+    m_state.compare_exchange_strong(expected, static_cast<int>(State::Pausing), std::memory_order_acq_rel);
+}
+
+void OperationControl::resume()
+{
+    QMutexLocker locker(&m_mutex);
+    int state = m_state.load(std::memory_order_acquire);
+    if (state == static_cast<int>(State::Pausing) || state == static_cast<int>(State::Paused)) {
+        m_state.store(static_cast<int>(State::Running), std::memory_order_release);
+        m_resumed.wakeAll();
+    }
+}
+
+void OperationControl::cancel()
+{
+    QMutexLocker locker(&m_mutex);
+    m_state.store(static_cast<int>(State::Cancelling), std::memory_order_release);
+    m_resumed.wakeAll();
+}
+
+void OperationControl::setProgress(qint64 bytesDone, qint64 totalBytes)
+{
+    m_totalBytes.store(totalBytes, std::memory_order_relaxed);
+    m_bytesDone.store(bytesDone, std::memory_order_relaxed);
+}
+
+bool OperationControl::checkpoint()
+{
+    // Hot path, called once per syscall
+    int state = m_state.load(std::memory_order_relaxed);
+    if (state == static_cast<int>(State::Running))
+        return true;
+    if (state == static_cast<int>(State::Cancelling))
+        return false;
+    return park();
+}
+
+bool OperationControl::park()
+{
+    QMutexLocker locker(&m_mutex);
+    int expected = static_cast<int>(State::Pausing);
+    m_state.compare_exchange_strong(expected, static_cast<int>(State::Paused), std::memory_order_acq_rel);
+
+    while (m_state.load(std::memory_order_acquire) == static_cast<int>(State::Paused))
+        m_resumed.wait(&m_mutex);
+
+    return m_state.load(std::memory_order_acquire) != static_cast<int>(State::Cancelling);
+}
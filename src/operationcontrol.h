@@ -0,0 +1,70 @@
+#pragma once
+
+#include <QMetaType>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QWaitCondition>
+#include <atomic>
+#include "transfermetrics.h"
+
+// Control block shared between the GUI and the worker running one
+// operation. The GUI changes the state from its own thread, the worker polls
+// it with checkpoint() between syscalls: a relaxed atomic load while
+// running, parking on a wait condition (a futex on Linux) while paused.
+// The worker also publishes its progress here and the GUI samples it once
+// per frame, so no cross-thread event is sent per chunk. The same goes for
+// the throughput and latency metrics of the operation.
+class OperationControl
+{
+public:
+    enum class State
+    {
+        Running,
+        Pausing,    // requested, the worker has not reached a checkpoint yet
+        Paused,     // the worker is parked in checkpoint()
+        Cancelling
+    };
+
+    OperationControl();
+
+    State state() const;
+    bool isCancelled() const;
+
+    // GUI side
+    void pause();
+    void resume();
+    void cancel();
+
+    // Worker side: returns false once the operation has to stop, blocks for
+    // as long as it is paused
+    bool checkpoint();
+
+    // Worker side progress, plain stores the GUI may read at any time
+    void setProgress(qint64 bytesDone) { m_bytesDone.store(bytesDone, std::memory_order_relaxed); }
+    void setProgress(qint64 bytesDone, qint64 totalBytes);
+
+    qint64 bytesDone() const { return m_bytesDone.load(std::memory_order_relaxed); }
+    qint64 totalBytes() const { return m_totalBytes.load(std::memory_order_relaxed); }
+
+    // Bytes actually read from or written to disk when they differ from the
+    // progress, as for compressed files. -1 when they do not.
+    void setStoredBytes(qint64 bytes) { m_storedBytes.store(bytes, std::memory_order_relaxed); }
+    qint64 storedBytes() const { return m_storedBytes.load(std::memory_order_relaxed); }
+
+    // The worker records syscall latencies, the sampling thread reads them
+    TransferMetrics &metrics() { return m_metrics; }
+    TransferMetrics::Snapshot sampleMetrics() { return m_metrics.sample(bytesDone(), totalBytes()); }
+
+private:
+    bool park();
+
+    std::atomic<int> m_state;
+    std::atomic<qint64> m_bytesDone;
+    std::atomic<qint64> m_totalBytes;
+    std::atomic<qint64> m_storedBytes;
+    TransferMetrics m_metrics;
+    QMutex m_mutex;
+    QWaitCondition m_resumed;
+};
+
+Q_DECLARE_METATYPE(QSharedPointer<OperationControl>)
@@ -0,0 +1,221 @@
+#include "parallelreader.h"
+#include "operationcontrol.h"
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QStorageInfo>
+#include <QThreadPool>
+#include <QVector>
+#include <QWaitCondition>
+#include <atomic>
+
+#ifdef Q_OS_UNIX
+#include <cerrno>
+#include <unistd.h>
+#endif
+
+namespace {
+const int RotationalThreads = 1;    // parallel seeks only hurt a spinning disk
+const int SsdThreads = 4;
+const int NvmeThreads = 8;
+const int NetworkThreads = 8;       // hides round trips rather than device limits
+
+bool isNetworkFileSystem(const QByteArray &type)
+{
+    return type.startsWith("nfs") || type.startsWith("smb") || type == "cifs" || type == "9p"
+           || type == "ceph" || type.startsWith("fuse.sshfs") || type == "afs";
+}
+
+// Reads /sys/class/block/<name>/queue/rotational, looking at the parent
+// disk for partitions. Returns -1 when unknown.
+int readRotational(const QString &blockDevice, QString *diskName)
+{
+    QString sysPath = QFileInfo("/sys/class/block/" + blockDevice).canonicalFilePath();
+    if (sysPath.isEmpty())
+        return -1;
+
+    QDir dir(sysPath);
+    if (!dir.exists("queue/rotational"))
+        dir.cdUp();
+
+    QFile rotational(dir.filePath("queue/rotational"));
+    if (!rotational.open(QIODevice::ReadOnly))
+        return -1;
+
+    *diskName = dir.dirName();
+    return rotational.readAll().trimmed().toInt();
+}
+}
+
+ParallelReader::ParallelReader(int threadCount, qint64 rangeSize)
+    : m_threadCount(qMax(1, threadCount))
+    , m_rangeSize(rangeSize)
+    , m_contiguousBytes(0)
+{
+}
+
+bool ParallelReader::isSupported()
+{
+#ifdef Q_OS_UNIX
+    return true;
+#else
+    return false;
+#endif
+}
+
+int ParallelReader::threadCountFor(const QString &filePath)
+{
+    QStorageInfo storage(filePath);
+    if (isNetworkFileSystem(storage.fileSystemType()))
+        return NetworkThreads;
+
+#ifdef Q_OS_LINUX
+    // /dev/mapper/... and /dev/disk/by-... are symlinks to the kernel name
+    QString device = QFileInfo(QString::fromLocal8Bit(storage.device())).canonicalFilePath();
+    if (device.startsWith("/dev/")) {
+        QString diskName;
+        int rotational = readRotational(QFileInfo(device).fileName(), &diskName);
+        if (rotational == 1)
+            return RotationalThreads;
+        if (rotational == 0)
+            return diskName.startsWith("nvme") ? NvmeThreads : SsdThreads;
+    }
+#endif
+
+    return RotationalThreads;
+}
+
+ParallelReader::Result ParallelReader::read(int fd, ChunkBuffer &data, qint64 size, OperationControl &control,
+                                            const Progress &progress, QString *error)
+{
+    m_contiguousBytes = 0;
+
+#ifdef Q_OS_UNIX
+    // Every chunk is allocated up front, the workers only ever see raw pointers
+    data.reserve(size);
+    QVector<char *> chunks;
+    for (qint64 offset = 0; offset < size; offset += data.chunkSize())
+        chunks.append(data.appendChunk(qMin(data.chunkSize(), size - offset)));
+
+    const qint64 chunkSize = data.chunkSize();
+    const qint64 rangeCount = (size + m_rangeSize - 1) / m_rangeSize;
+    std::atomic<qint64> nextRange(0);
+    std::atomic<qint64> bytesDone(0);
+    std::atomic<bool> stop(false);
+
+    QMutex mutex;
+    QWaitCondition changed;
+    QVector<bool> completed(static_cast<int>(rangeCount), false);
+    int running = m_threadCount;
+    bool cancelled = false;
+    QString firstError;
+
+    auto worker = [&]() {
+        QElapsedTimer syscallTimer;
+        for (;;) {
+            qint64 range = nextRange.fetch_add(1, std::memory_order_relaxed);
+            if (range >= rangeCount || stop.load(std::memory_order_relaxed))
+                break;
+
+            qint64 offset = range * m_rangeSize;
+            qint64 end = qMin(offset + m_rangeSize, size);
+            QString rangeError;
+            bool rangeCancelled = false;
+
+            while (offset < end) {
+                if (!control.checkpoint()) {
+                    rangeCancelled = true;
+                    break;
+                }
+
+                int index = static_cast<int>(offset / chunkSize);
+                qint64 inChunk = offset - index * chunkSize;
+                qint64 length = qMin(end - offset, chunkSize - inChunk);
+
+                syscallTimer.start();
+                ssize_t bytesRead = ::pread(fd, chunks[index] + inChunk, static_cast<size_t>(length),
+                                            static_cast<off_t>(offset));
+                control.metrics().recordLatency(syscallTimer.nsecsElapsed());
+
+                if (bytesRead < 0) {
+                    if (errno == EINTR)
+                        continue;
+                    rangeError = qt_error_string(errno);
+                    break;
+                }
+                if (bytesRead == 0) {
+                    rangeError = "the file shrank while it was read";
+                    break;
+                }
+
+                offset += bytesRead;
+                bytesDone.fetch_add(bytesRead, std::memory_order_relaxed);
+            }
+
+            QMutexLocker locker(&mutex);
+            if (rangeCancelled || !rangeError.isEmpty()) {
+                cancelled = cancelled || rangeCancelled;
+                if (firstError.isEmpty())
+                    firstError = rangeError;
+                stop.store(true, std::memory_order_relaxed);
+                changed.wakeAll();
+                break;
+            }
+            completed[static_cast<int>(range)] = true;
+            changed.wakeAll();
+        }
+
+        QMutexLocker locker(&mutex);
+        --running;
+        changed.wakeAll();
+    };
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(m_threadCount);
+    for (int thread = 0; thread < m_threadCount; ++thread)
+        pool.start(worker);
+
+    // Report progress while the workers run. The timeout keeps progress
+    // moving within long ranges on slow devices.
+    qint64 contiguousRanges = 0;
+    QMutexLocker locker(&mutex);
+    for (;;) {
+        while (contiguousRanges < rangeCount && completed[static_cast<int>(contiguousRanges)])
+            ++contiguousRanges;
+        bool finished = running == 0;
+        m_contiguousBytes = qMin(contiguousRanges * m_rangeSize, size);
+
+        locker.unlock();
+        progress(bytesDone.load(std::memory_order_relaxed), m_contiguousBytes);
+        locker.relock();
+
+        if (finished)
+            break;
+        if (running > 0 && (contiguousRanges == rangeCount || !completed[static_cast<int>(contiguousRanges)]))
+            changed.wait(&mutex, 50);
+    }
+    locker.unlock();
+    pool.waitForDone();
+
+    if (!firstError.isEmpty()) {
+        if (error)
+            *error = firstError;
+        return Result::Failed;
+    }
+    if (cancelled)
+        return Result::Cancelled;
+    return Result::Done;
+#else
+    Q_UNUSED(fd);
+    Q_UNUSED(data);
+    Q_UNUSED(size);
+    Q_UNUSED(control);
+    Q_UNUSED(progress);
+    if (error)
+        *error = "Parallel reads are not supported on this platform";
+    return Result::Failed;
+#endif
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <QString>
+#include <functional>
+#include "chunkbuffer.h"
+
+class OperationControl;
+
+// Reads a file with several threads at once. The file is cut into ranges
+// that a pool of workers claims in order and reads with pread() straight to
+// their final place in a preallocated ChunkBuffer, so deep NVMe queues and
+// high-latency network mounts see many requests in flight. Unix only.
+class ParallelReader
+{
+public:
+    static constexpr qint64 DefaultRangeSize = 4 * 1024 * 1024;     // divides ChunkBuffer chunks
+    static constexpr qint64 MinFileSize = 64 * 1024 * 1024;         // smaller files are read by one thread
+
+    // Called on the reading thread while the workers run: bytes read by all
+    // workers, and the length of the prefix that is complete
+    using Progress = std::function<void(qint64 bytesDone, qint64 contiguousBytes)>;
+
+    enum class Result { Done, Cancelled, Failed };
+
+    explicit ParallelReader(int threadCount, qint64 rangeSize = DefaultRangeSize);
+
+    static bool isSupported();
+
+    // Thread count suited to the device holding filePath: one for spinning
+    // disks and unknown devices, more for SSDs, NVMe and network file systems
+    static int threadCountFor(const QString &filePath);
+
+    // Reads size bytes of fd into data, which must be empty. Workers honour
+    // pause and cancel through control.
+    Result read(int fd, ChunkBuffer &data, qint64 size, OperationControl &control,
+                const Progress &progress, QString *error);
+
+    // Complete prefix when read() returned, what a cancelled read keeps
+    qint64 contiguousBytes() const { return m_contiguousBytes; }
+
+    int threadCount() const { return m_threadCount; }
+
+private:
+    int m_threadCount;
+    qint64 m_rangeSize;
+    qint64 m_contiguousBytes;
+};
@@ -0,0 +1,95 @@
+#include "sparsefile.h"
+#include <cstring>
+
+#ifdef Q_OS_LINUX
+#include <cerrno>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool SparseFile::isSupported()
+{
+#if defined(Q_OS_LINUX) && defined(SEEK_DATA) && defined(SEEK_HOLE)
+    return true;
+#else
+    return false;
+#endif
+}
+
+qint64 SparseFile::allocatedBytes(int fd)
+{
+#ifdef Q_OS_LINUX
+    struct stat status;
+    if (::fstat(fd, &status) != 0)
+        return -1;
+    return static_cast<qint64>(status.st_blocks) * 512;
+#else
+    Q_UNUSED(fd);
+    return -1;
+#endif
+}
+
+bool SparseFile::hasHoles(int fd, qint64 size)
+{
+    qint64 allocated = allocatedBytes(fd);
+    return allocated >= 0 && allocated + MinHoleSize <= size;
+}
+
+bool SparseFile::dataExtents(int fd, qint64 size, QVector<ChunkBuffer::Extent> *extents)
+{
+    extents->clear();
+
+#if defined(Q_OS_LINUX) && defined(SEEK_DATA) && defined(SEEK_HOLE)
+    qint64 offset = 0;
+    while (offset < size) {
+        off_t dataStart = ::lseek(fd, static_cast<off_t>(offset), SEEK_DATA);
+        if (dataStart < 0) {
+            // Nothing but a hole up to the end of the file
+            if (errno == ENXIO)
+                break;
+            return false;
+        }
+        if (dataStart >= size)
+            break;
+
+        off_t holeStart = ::lseek(fd, dataStart, SEEK_HOLE);
+        if (holeStart < 0)
+            return false;
+
+        qint64 end = qMin<qint64>(holeStart, size);
+        if (!extents->isEmpty() && dataStart - (extents->last().offset + extents->last().length) < MinHoleSize)
+            extents->last().length = end - extents->last().offset;
+        else
+            extents->append(ChunkBuffer::Extent{dataStart, end - dataStart});
+        offset = end;
+    }
+    return true;
+#else
+    Q_UNUSED(fd);
+    Q_UNUSED(size);
+    return false;
+#endif
+}
+
+bool SparseFile::isZero(const char *data, qint64 size)
+{
+    // Every byte equals the one before it, and the first is zero
+    return size <= 0 || (data[0] == 0 && memcmp(data, data + 1, static_cast<size_t>(size - 1)) == 0);
+}
+
+qint64 SparseFile::runLength(const char *data, qint64 offset, qint64 size, bool *zeros)
+{
+    qint64 done = 0;
+    while (done < size) {
+        qint64 inBlock = (offset + done) % ZeroBlockSize;
+        qint64 blockEnd = qMin(size, done + ZeroBlockSize - inBlock);
+        bool blockZeros = inBlock == 0 && blockEnd - done == ZeroBlockSize && isZero(data + done, ZeroBlockSize);
+
+        if (done == 0)
+            *zeros = blockZeros;
+        else if (blockZeros != *zeros)
+            break;
+        done = blockEnd;
+    }
+    return done;
+}
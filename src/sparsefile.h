@@ -0,0 +1,37 @@
+#pragma once
+
+#include <QVector>
+#include "chunkbuffer.h"
+
+// Holes in files. VM images and database files are mostly holes, so they
+// are read extent by extent with SEEK_DATA/SEEK_HOLE instead of reading
+// gigabytes of zeros, and saved by seeking over the holes instead of
+// writing them, which leaves the destination just as sparse. Linux only,
+// see isSupported().
+class SparseFile
+{
+public:
+    static constexpr qint64 MinHoleSize = 64 * 1024;       // smaller holes are read as data
+    static constexpr qint64 ZeroBlockSize = 64 * 1024;     // zero runs are left out in whole blocks
+
+    static bool isSupported();
+
+    // Bytes the file at fd occupies on disk, -1 when unknown
+    static qint64 allocatedBytes(int fd);
+
+    // True when at least MinHoleSize of the first size bytes of fd are not
+    // allocated, i.e. reading by extents pays off
+    static bool hasHoles(int fd, qint64 size);
+
+    // Data extents of the first size bytes of fd, in order, with holes
+    // smaller than MinHoleSize merged away. Returns false when the file
+    // system cannot tell data from holes. Moves the file offset of fd.
+    static bool dataExtents(int fd, qint64 size, QVector<ChunkBuffer::Extent> *extents);
+
+    static bool isZero(const char *data, qint64 size);
+
+    // Length of the first run of data that is either only whole, aligned
+    // zero blocks or no such block at all. offset is where data lies in the
+    // file, zeros tells which kind of run it is.
+    static qint64 runLength(const char *data, qint64 offset, qint64 size, bool *zeros);
+};
@@ -0,0 +1,251 @@
+#include "spillfile.h"
+#include <QDir>
+#include <QFile>
+#include <QStandardPaths>
+#include <QStorageInfo>
+#include <QVector>
+#include <atomic>
+
+#ifdef Q_OS_UNIX
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef Q_OS_UNIX
+namespace {
+// Page-aligned [offset, offset + length) within size
+bool pageRange(qint64 size, qint64 *offset, qint64 *length)
+{
+    const qint64 pageSize = sysconf(_SC_PAGESIZE);
+    qint64 start = *offset / pageSize * pageSize;
+    qint64 end = qMin(*offset + *length, size);
+    if (end <= start)
+        return false;
+    *offset = start;
+    *length = end - start;
+    return true;
+}
+
+// An unlinked file in directory: O_TMPFILE where the file system has it,
+// otherwise a named file that is unlinked right away
+int openUnlinked(const QString &directory, QString *error)
+{
+    QByteArray path = QFile::encodeName(directory);
+    int fd = -1;
+#ifdef O_TMPFILE
+    fd = ::open(path.constData(), O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd >= 0)
+        return fd;
+#endif
+    QByteArray pattern = path + "/CubeReadWriteFile-spill-XXXXXX";
+    fd = ::mkstemp(pattern.data());
+    if (fd < 0) {
+        *error = qt_error_string(errno);
+        return -1;
+    }
+    ::unlink(pattern.constData());
+    ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return fd;
+}
+}
+#endif
+
+SpillFile::SpillFile()
+    : m_fd(-1)
+    , m_data(nullptr)
+    , m_size(0)
+    , m_writtenBack(0)
+    , m_evicted(0)
+{
+}
+
+SpillFile::~SpillFile()
+{
+#ifdef Q_OS_UNIX
+    if (m_data)
+        ::munmap(m_data, static_cast<size_t>(m_size));
+    if (m_fd >= 0)
+        ::close(m_fd);
+#endif
+}
+
+bool SpillFile::isSupported()
+{
+#ifdef Q_OS_UNIX
+    return true;
+#else
+    return false;
+#endif
+}
+
+qint64 SpillFile::defaultBudget()
+{
+#ifdef Q_OS_UNIX
+    qint64 pages = sysconf(_SC_PHYS_PAGES);
+    qint64 pageSize = sysconf(_SC_PAGESIZE);
+    if (pages > 0 && pageSize > 0)
+        return pages * pageSize / 2;
+#endif
+    return 0;   // unknown, never spill
+}
+
+QString SpillFile::defaultDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+}
+
+bool SpillFile::isInMemory(const QString &directory)
+{
+    QByteArray type = QStorageInfo(directory).fileSystemType();
+    return type == "tmpfs" || type == "ramfs";
+}
+
+QSharedPointer<SpillFile> SpillFile::create(qint64 size, const QString &directory, QString *error)
+{
+#ifdef Q_OS_UNIX
+    QSharedPointer<SpillFile> file(new SpillFile);
+    file->m_directory = directory.isEmpty() ? defaultDirectory() : directory;
+    if (file->m_directory.isEmpty() || !QDir().mkpath(file->m_directory)) {
+        *error = QString("cannot create the spill directory %1").arg(QDir::toNativeSeparators(file->m_directory));
+        return QSharedPointer<SpillFile>();
+    }
+    if (isInMemory(file->m_directory)) {
+        *error = QString("%1 is in memory, spilling there would not free any")
+                     .arg(QDir::toNativeSeparators(file->m_directory));
+        return QSharedPointer<SpillFile>();
+    }
+    file->m_fd = openUnlinked(file->m_directory, error);
+    if (file->m_fd < 0)
+        return QSharedPointer<SpillFile>();
+
+    // Reserved up front: running out of space under a shared mapping
+    // would be a SIGBUS in the middle of a read, not a write error
+    int result = EOPNOTSUPP;
+#ifdef Q_OS_LINUX
+    result = ::fallocate(file->m_fd, 0, 0, static_cast<off_t>(size)) == 0 ? 0 : errno;
+#endif
+    if (result == EOPNOTSUPP)
+        result = ::ftruncate(file->m_fd, static_cast<off_t>(size)) == 0 ? 0 : errno;
+    if (result != 0) {
+        *error = QString("cannot reserve %1 bytes in %2: %3")
+                     .arg(size).arg(QDir::toNativeSeparators(file->m_directory), qt_error_string(result));
+        return QSharedPointer<SpillFile>();
+    }
+
+    void *data = ::mmap(nullptr, static_cast<size_t>(size), PROT_READ | PROT_WRITE, MAP_SHARED, file->m_fd, 0);
+    if (data == MAP_FAILED) {
+        *error = qt_error_string(errno);
+        return QSharedPointer<SpillFile>();
+    }
+    file->m_data = static_cast<char *>(data);
+    file->m_size = size;
+    return file;
+#else
+    Q_UNUSED(size);
+    Q_UNUSED(directory);
+    *error = "Spilling to disk is not supported on this platform";
+    return QSharedPointer<SpillFile>();
+#endif
+}
+
+void SpillFile::writeBack(qint64 offset, qint64 length)
+{
+#ifdef Q_OS_LINUX
+    if (pageRange(m_size, &offset, &length))
+        ::sync_file_range(m_fd, offset, length, SYNC_FILE_RANGE_WRITE);
+#else
+    Q_UNUSED(offset);
+    Q_UNUSED(length);
+#endif
+}
+
+void SpillFile::evict(qint64 offset, qint64 length)
+{
+#ifdef Q_OS_UNIX
+    if (!pageRange(m_size, &offset, &length))
+        return;
+
+    // Dirty pages cannot be dropped, so they are written first. Data stays
+    // in the file, a later access faults it back in.
+    ::msync(m_data + offset, static_cast<size_t>(length), MS_SYNC);
+    ::madvise(m_data + offset, static_cast<size_t>(length), MADV_DONTNEED);
+#ifdef Q_OS_LINUX
+    ::posix_fadvise(m_fd, offset, length, POSIX_FADV_DONTNEED);
+#endif
+#else
+    Q_UNUSED(offset);
+    Q_UNUSED(length);
+#endif
+}
+
+void SpillFile::filled(qint64 prefix)
+{
+    prefix = qMin(prefix, m_size);
+    if (prefix > m_writtenBack) {
+        writeBack(m_writtenBack, prefix - m_writtenBack);
+        m_writtenBack = prefix;
+    }
+
+    qint64 evictEnd = prefix - HotWindow;
+    if (evictEnd - m_evicted >= EvictStep) {
+        evict(m_evicted, evictEnd - m_evicted);
+        m_evicted = evictEnd;
+    }
+}
+
+qint64 SpillFile::residentBytes() const
+{
+#ifdef Q_OS_UNIX
+    const qint64 pageSize = sysconf(_SC_PAGESIZE);
+    const qint64 window = 1024 * pageSize;    // pages asked about at a time
+    QVector<unsigned char> pages(static_cast<int>(window / pageSize));
+    qint64 resident = 0;
+    for (qint64 offset = 0; offset < m_size; offset += window) {
+        qint64 length = qMin(window, m_size - offset);
+        if (::mincore(m_data + offset, static_cast<size_t>(length), pages.data()) != 0)
+            return -1;
+        for (qint64 page = 0; page < (length + pageSize - 1) / pageSize; ++page) {
+            if (pages[static_cast<int>(page)] & 1)
+                resident += qMin(pageSize, length - page * pageSize);
+        }
+    }
+    return resident;
+#else
+    return m_size;
+#endif
+}
+
+// Bytes of all MemoryReservations alive
+static std::atomic<qint64> &reservedMemory()
+{
+    static std::atomic<qint64> reserved(0);
+    return reserved;
+}
+
+MemoryReservation::MemoryReservation(qint64 bytes)
+    : m_bytes(bytes)
+{
+}
+
+MemoryReservation::~MemoryReservation()
+{
+    reservedMemory().fetch_sub(m_bytes, std::memory_order_relaxed);
+}
+
+QSharedPointer<MemoryReservation> MemoryReservation::reserve(qint64 bytes, qint64 budget)
+{
+    std::atomic<qint64> &reserved = reservedMemory();
+    qint64 current = reserved.load(std::memory_order_relaxed);
+    do {
+        if (budget >= 0 && current + bytes > budget)
+            return QSharedPointer<MemoryReservation>();
+    } while (!reserved.compare_exchange_weak(current, current + bytes, std::memory_order_relaxed));
+    return QSharedPointer<MemoryReservation>(new MemoryReservation(bytes));
+}
+
+qint64 MemoryReservation::reservedBytes()
+{
+    return reservedMemory().load(std::memory_order_relaxed);
+}
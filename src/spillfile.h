@@ -0,0 +1,90 @@
+#pragma once
+
+#include <QSharedPointer>
+#include <QString>
+
+// Disk backing for buffers larger than the memory budget. The file is
+// created unlinked in the cache directory, so nothing is left behind even
+// after a crash, and mapped shared: chunks live in the mapping, pages that
+// were written back can be dropped at any time and fault back in from the
+// file when read. A memfd would not help, it is as unswappable as the heap
+// without swap. Unix only, see isSupported().
+class SpillFile
+{
+public:
+    static constexpr qint64 HotWindow = 64 * 1024 * 1024;  // kept resident behind the write position
+    static constexpr qint64 EvictStep = 16 * 1024 * 1024;
+
+    ~SpillFile();   // unmaps and closes, the file goes with it
+
+    static bool isSupported();
+
+    // Reserves size bytes in an unlinked file in directory, defaultDirectory()
+    // when empty, and maps it. Returns null on error, also for a directory
+    // in memory.
+    static QSharedPointer<SpillFile> create(qint64 size, const QString &directory, QString *error);
+
+    // The per-user cache directory. The temp directory is tmpfs on most
+    // distributions, a spill file there takes as much memory as the heap.
+    static QString defaultDirectory();
+
+    // True for tmpfs and ramfs, whose pages cannot leave memory but to swap
+    static bool isInMemory(const QString &directory);
+
+    // Bytes the reads of the process may hold in memory together when the
+    // budget is 0: half the physical memory
+    static qint64 defaultBudget();
+
+    char *data() const { return m_data; }
+    qint64 size() const { return m_size; }
+    QString directory() const { return m_directory; }
+
+    // Starts writing back [offset, offset + length) without waiting
+    void writeBack(qint64 offset, qint64 length);
+
+    // Writes back [offset, offset + length) and drops it from memory
+    void evict(qint64 offset, qint64 length);
+
+    // The first prefix bytes hold their final data. What was filled since the
+    // last call starts writing back, and what lies more than HotWindow behind
+    // prefix is dropped, in steps of EvictStep. Called by the filling thread.
+    void filled(qint64 prefix);
+
+    // Pages of the mapping in memory, in bytes, -1 when mincore() fails
+    qint64 residentBytes() const;
+
+private:
+    SpillFile();
+    Q_DISABLE_COPY(SpillFile)
+
+    int m_fd;
+    char *m_data;
+    qint64 m_size;
+    QString m_directory;
+    qint64 m_writtenBack;   // filled() has started writing back up to here
+    qint64 m_evicted;       // and dropped up to here
+};
+
+// Heap memory held by read buffers, counted for the whole process. A buffer
+// keeps its reservation until its last copy goes away, so reads running on
+// other workers and the buffer the window shows all take from one budget.
+class MemoryReservation
+{
+public:
+    ~MemoryReservation();   // returns the bytes
+
+    // Reserves bytes if they fit into budget next to what is reserved
+    // already, returns null when they do not. A negative budget always fits.
+    static QSharedPointer<MemoryReservation> reserve(qint64 bytes, qint64 budget);
+
+    // Bytes reserved by all buffers alive right now
+    static qint64 reservedBytes();
+
+    qint64 bytes() const { return m_bytes; }
+
+private:
+    explicit MemoryReservation(qint64 bytes);
+    Q_DISABLE_COPY(MemoryReservation)
+
+    qint64 m_bytes;
+};
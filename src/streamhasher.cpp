@@ -0,0 +1,115 @@
+#include "streamhasher.h"
+#include <QMutexLocker>
+#include <QThread>
+
+StreamHasher::StreamHasher(Checksums::Algorithms algorithms, bool analyze)
+    : m_algorithms(algorithms)
+    , m_analyze(analyze)
+    , m_thread(nullptr)
+    , m_analyzerThread(nullptr)
+    , m_finished(false)
+    , m_aborted(false)
+{
+    m_thread = QThread::create([this]() {
+        ChecksumCalculator calculator(m_algorithms);
+        run(m_ranges, [&calculator](const Range &range) { calculator.update(range.data, range.size); });
+        // Only read by finish() after the thread has been joined
+        m_result = calculator.result();
+    });
+    m_thread->start();
+
+    if (analyze) {
+        m_analyzerThread = QThread::create([this]() {
+            ByteAnalyzer analyzer;
+            run(m_analyzerRanges, [&analyzer](const Range &range) { analyzer.update(range.data, range.size); });
+            m_statistics = analyzer.result();
+        });
+        m_analyzerThread->start();
+    }
+}
+
+StreamHasher::~StreamHasher()
+{
+    abort();
+}
+
+void StreamHasher::add(const char *data, qint64 size)
+{
+    if (size <= 0)
+        return;
+
+    QMutexLocker locker(&m_mutex);
+    if (m_algorithms != Checksums::Algorithms())
+        m_ranges.enqueue({data, size});
+    if (m_analyzerThread)
+        m_analyzerRanges.enqueue({data, size});
+    m_queued.wakeAll();
+}
+
+Checksums StreamHasher::finish()
+{
+    endInput();
+    join(m_thread);
+    return m_result;
+}
+
+bool StreamHasher::finishAnalysis(ByteStatistics *statistics)
+{
+    endInput();
+    join(m_analyzerThread);
+
+    QMutexLocker locker(&m_mutex);
+    if (m_aborted)
+        return false;
+    *statistics = m_statistics;
+    return true;
+}
+
+void StreamHasher::abort()
+{
+    cancel();
+    join(m_thread);
+    join(m_analyzerThread);
+}
+
+void StreamHasher::cancel()
+{
+    QMutexLocker locker(&m_mutex);
+    m_aborted = true;
+    m_ranges.clear();
+    m_analyzerRanges.clear();
+    m_queued.wakeAll();
+}
+
+void StreamHasher::endInput()
+{
+    QMutexLocker locker(&m_mutex);
+    m_finished = true;
+    m_queued.wakeAll();
+}
+
+void StreamHasher::join(QThread *&thread)
+{
+    if (!thread)
+        return;
+    thread->wait();
+    delete thread;
+    thread = nullptr;
+}
+
+void StreamHasher::run(QQueue<Range> &ranges, const std::function<void(const Range &)> &consume)
+{
+    for (;;) {
+        Range range;
+        {
+            QMutexLocker locker(&m_mutex);
+            while (ranges.isEmpty() && !m_finished && !m_aborted)
+                m_queued.wait(&m_mutex);
+            if (m_aborted || ranges.isEmpty())
+                break;
+            range = ranges.dequeue();
+        }
+
+        consume(range);
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <QMutex>
+#include <QQueue>
+#include <QWaitCondition>
+#include <functional>
+#include "byteanalyzer.h"
+#include "checksums.h"
+
+class QThread;
+
+// Computes Checksums over a stream of byte ranges on a helper thread, so
+// the I/O loop only queues a pointer per completed read or write. Ranges
+// are hashed in the order they were added. With analyze set, a second
+// helper thread also builds ByteStatistics over the same ranges, so neither
+// the hashing nor the I/O waits for it, and it may still be running after
+// finish(). The caller keeps the memory valid until finish(), and with
+// analyze finishAnalysis(), or abort() has returned.
+class StreamHasher
+{
+public:
+    explicit StreamHasher(Checksums::Algorithms algorithms, bool analyze = false);
+    ~StreamHasher();    // aborts
+
+    void add(const char *data, qint64 size);
+
+    // Waits for the queued ranges to be hashed and returns the digests. No
+    // more ranges may be added.
+    Checksums finish();
+
+    // Waits for the analysis of everything added, after finish(). Returns
+    // false when it was cancelled.
+    bool finishAnalysis(ByteStatistics *statistics);
+
+    // Drops the queued ranges and stops the helper threads
+    void abort();
+
+    // Like abort() but does not wait for the helper threads, so another
+    // thread may call it while finish() or finishAnalysis() is waiting
+    void cancel();
+
+    bool isAnalyzing() const { return m_analyze; }
+
+private:
+    struct Range
+    {
+        const char *data;
+        qint64 size;
+    };
+
+    void run(QQueue<Range> &ranges, const std::function<void(const Range &)> &consume);
+    void endInput();
+    static void join(QThread *&thread);
+
+    Checksums::Algorithms m_algorithms;
+    bool m_analyze;
+    Checksums m_result;
+    ByteStatistics m_statistics;
+    QThread *m_thread;
+    QThread *m_analyzerThread;
+    QMutex m_mutex;
+    QWaitCondition m_queued;
+    QQueue<Range> m_ranges;
+    QQueue<Range> m_analyzerRanges;
+    bool m_finished;
+    bool m_aborted;
+};
@@ -0,0 +1,182 @@
+#include "transferjournal.h"
+#include "operationcontrol.h"
+#include <QDataStream>
+#include <QDateTime>
+#include <QFileInfo>
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+namespace {
+const char Magic[8] = {'C', 'U', 'B', 'E', 'J', 'R', 'N', '1'};
+const qint64 VerifyReadSize = 1024 * 1024;
+}
+
+TransferJournal::TransferJournal(const QString &filePath, qint64 totalBytes, const QByteArray &sourceId)
+    : m_filePath(filePath)
+    , m_totalBytes(totalBytes)
+    , m_sourceId(sourceId)
+    , m_recorded(0)
+    , m_blockBytes(0)
+{
+}
+
+QByteArray TransferJournal::fileIdentity(const QString &filePath)
+{
+    QFileInfo fileInfo(filePath);
+    return QString("%1\n%2\n%3")
+        .arg(fileInfo.canonicalFilePath())
+        .arg(fileInfo.size())
+        .arg(fileInfo.lastModified().toMSecsSinceEpoch())
+        .toUtf8();
+}
+
+qint64 TransferJournal::resumableBytes(OperationControl &control, const DataCrc &dataCrc)
+{
+    if (!load() || m_blocks.isEmpty())
+        return 0;
+
+    QFile destination(m_filePath);
+    if (!destination.open(QIODevice::ReadOnly))
+        return 0;
+
+    QByteArray buffer(VerifyReadSize, Qt::Uninitialized);
+    qint64 kept = 0;
+    for (int block = 0; block < m_blocks.size(); ++block) {
+        qint64 offset = block * BlockSize;
+        qint64 size = qMin(BlockSize, m_totalBytes - offset);
+        Crc32cHasher hasher;
+        qint64 done = 0;
+
+        while (done < size) {
+            qint64 bytesRead = destination.read(buffer.data(), qMin(VerifyReadSize, size - done));
+            if (bytesRead <= 0)
+                break;
+            hasher.update(buffer.constData(), bytesRead);
+            done += bytesRead;
+
+            if (!control.checkpoint())
+                return -1;
+            control.setProgress(offset + done, m_totalBytes);
+        }
+
+        if (done < size || hasher.value() != m_blocks.at(block))
+            break;
+        if (dataCrc && dataCrc(offset, size) != m_blocks.at(block))
+            break;
+        kept = offset + size;
+    }
+
+    // Writing continues at a block boundary, later blocks are written again
+    kept = (kept / BlockSize) * BlockSize;
+    m_blocks.resize(static_cast<int>(kept / BlockSize));
+    return kept;
+}
+
+bool TransferJournal::begin(qint64 offset)
+{
+    m_blocks.resize(static_cast<int>(qMin<qint64>(m_blocks.size(), offset / BlockSize)));
+    m_recorded = m_blocks.size();
+    m_block = Crc32cHasher();
+    m_blockBytes = 0;
+
+    m_file.close();
+    m_file.setFileName(journalPath(m_filePath));
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+    return writeHeader();
+}
+
+void TransferJournal::add(const char *data, qint64 size)
+{
+    while (size > 0) {
+        qint64 length = qMin(size, BlockSize - m_blockBytes);
+        m_block.update(data, length);
+        m_blockBytes += length;
+        data += length;
+        size -= length;
+
+        if (m_blockBytes == BlockSize) {
+            m_blocks.append(m_block.value());
+            m_block = Crc32cHasher();
+            m_blockBytes = 0;
+        }
+    }
+}
+
+bool TransferJournal::checkpoint(int fd, bool force)
+{
+    qint64 pending = m_blocks.size() - m_recorded;
+    if (!m_file.isOpen() || pending == 0 || (!force && pending * BlockSize < CheckpointBytes))
+        return true;
+
+    // The data first, so the journal never lists a block that is not on disk
+#if defined(Q_OS_LINUX)
+    if (::fdatasync(fd) != 0)
+        return false;
+#elif defined(Q_OS_UNIX)
+    if (::fsync(fd) != 0)
+        return false;
+#else
+    Q_UNUSED(fd);
+#endif
+
+    QDataStream out(&m_file);
+    out.setByteOrder(QDataStream::LittleEndian);
+    for (int block = m_recorded; block < m_blocks.size(); ++block)
+        out << m_blocks.at(block);
+    m_recorded = m_blocks.size();
+    return out.status() == QDataStream::Ok && m_file.flush();
+}
+
+void TransferJournal::remove()
+{
+    m_file.close();
+    QFile::remove(journalPath(m_filePath));
+}
+
+bool TransferJournal::load()
+{
+    m_blocks.clear();
+
+    QFile file(journalPath(m_filePath));
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream in(&file);
+    in.setByteOrder(QDataStream::LittleEndian);
+    char magic[sizeof(Magic)];
+    qint64 totalBytes = 0;
+    qint64 blockSize = 0;
+    QByteArray sourceId;
+    if (in.readRawData(magic, sizeof(magic)) != sizeof(magic) || memcmp(magic, Magic, sizeof(Magic)) != 0)
+        return false;
+    in >> totalBytes >> blockSize >> sourceId;
+    if (in.status() != QDataStream::Ok || totalBytes != m_totalBytes || blockSize != BlockSize
+        || sourceId != m_sourceId)
+        return false;
+
+    // A record torn by a crash is simply not read
+    int blockCount = static_cast<int>((m_totalBytes + BlockSize - 1) / BlockSize);
+    while (m_blocks.size() < blockCount) {
+        quint32 crc = 0;
+        in >> crc;
+        if (in.status() != QDataStream::Ok)
+            break;
+        m_blocks.append(crc);
+    }
+    return true;
+}
+
+bool TransferJournal::writeHeader()
+{
+    QDataStream out(&m_file);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out.writeRawData(Magic, sizeof(Magic));
+    out << m_totalBytes << BlockSize << m_sourceId;
+    for (quint32 crc : m_blocks)
+        out << crc;
+    return out.status() == QDataStream::Ok && m_file.flush();
+}
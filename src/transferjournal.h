@@ -0,0 +1,76 @@
+#pragma once
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <QVector>
+#include <functional>
+#include "checksums.h"
+
+class OperationControl;
+
+// Sidecar journal that makes a large save or copy resumable. It lives next
+// to the destination as <file>.journal and lists the CRC32C of every
+// completed block. Blocks are recorded only after the destination has been
+// synced up to them, so after a cancel, a crash or a reboot the journal
+// never claims more than is on disk. Running the same transfer again
+// re-reads the listed blocks and continues after the last one that still
+// matches. The journal is removed once the transfer completes.
+class TransferJournal
+{
+public:
+    static constexpr qint64 BlockSize = 16 * 1024 * 1024;          // 16 MB
+    static constexpr qint64 CheckpointBytes = 256 * 1024 * 1024;   // synced and recorded this often
+    static constexpr qint64 MinFileSize = 64 * 1024 * 1024;        // smaller transfers start over
+
+    // Returns the CRC32C of [offset, offset + size) of the data about to be
+    // written, for sources that are not a file on disk
+    using DataCrc = std::function<quint32(qint64 offset, qint64 size)>;
+
+    // sourceId tells apart transfers to the same destination, a journal
+    // written for another source or size is ignored
+    TransferJournal(const QString &filePath, qint64 totalBytes, const QByteArray &sourceId);
+
+    static bool isUseful(qint64 totalBytes) { return totalBytes >= MinFileSize; }
+    static QString journalPath(const QString &filePath) { return filePath + ".journal"; }
+
+    // Path, size and modification time of a source file
+    static QByteArray fileIdentity(const QString &filePath);
+
+    // Looks for a journal of this transfer and checks the blocks it lists
+    // against the destination and, when dataCrc is given, the new data.
+    // Returns the length of the prefix that can be kept, 0 to start over,
+    // -1 when control was cancelled meanwhile. Progress is published to
+    // control as the prefix is checked.
+    qint64 resumableBytes(OperationControl &control, const DataCrc &dataCrc = DataCrc());
+
+    // Starts recording at offset, which is 0 or what resumableBytes()
+    // returned, dropping whatever the journal listed past it
+    bool begin(qint64 offset);
+
+    // Feeds the bytes written to the destination, in order
+    void add(const char *data, qint64 size);
+
+    // Once CheckpointBytes have completed since the last checkpoint, or
+    // always when force is set, syncs fd and records the completed blocks
+    bool checkpoint(int fd, bool force = false);
+
+    // The transfer completed, the journal is no longer needed
+    void remove();
+
+    // Length of the prefix the journal vouches for
+    qint64 committedBytes() const { return qMin(m_totalBytes, m_recorded * BlockSize); }
+
+private:
+    bool load();
+    bool writeHeader();
+
+    QString m_filePath;
+    qint64 m_totalBytes;
+    QByteArray m_sourceId;
+    QFile m_file;
+    QVector<quint32> m_blocks;  // every completed block, recorded or not
+    int m_recorded;             // blocks already in the journal file
+    Crc32cHasher m_block;       // of the block being written
+    qint64 m_blockBytes;
+};
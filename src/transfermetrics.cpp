@@ -0,0 +1,154 @@
+#include "transfermetrics.h"
+#include <QtAlgorithms>
+#include <chrono>
+#include <cmath>
+
+namespace {
+qint64 nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const double Megabyte = 1024.0 * 1024.0;
+const double EwmaHalfLifeMs = 1000.0; // instantaneous speed follows the last ~second
+}
+
+TransferMetrics::TransferMetrics()
+    : m_startNs(0)
+    , m_stopNs(0)
+    , m_calls(0)
+    , m_maxNs(0)
+    , m_lastSampleNs(0)
+    , m_lastSampleBytes(0)
+    , m_ewmaBytesPerSecond(0.0)
+{
+    for (std::atomic<quint64> &bucket : m_buckets)
+        bucket.store(0, std::memory_order_relaxed);
+}
+
+void TransferMetrics::start()
+{
+    m_stopNs.store(0, std::memory_order_relaxed);
+    m_startNs.store(nowNs(), std::memory_order_release);
+}
+
+void TransferMetrics::stop()
+{
+    m_stopNs.store(nowNs(), std::memory_order_release);
+}
+
+void TransferMetrics::recordLatency(qint64 latencyNs)
+{
+    m_buckets[static_cast<size_t>(bucketFor(latencyNs))].fetch_add(1, std::memory_order_relaxed);
+    m_calls.fetch_add(1, std::memory_order_relaxed);
+
+    qint64 max = m_maxNs.load(std::memory_order_relaxed);
+    while (latencyNs > max && !m_maxNs.compare_exchange_weak(max, latencyNs, std::memory_order_relaxed)) {
+    }
+}
+
+TransferMetrics::Snapshot TransferMetrics::sample(qint64 bytesDone, qint64 totalBytes)
+{
+    Snapshot snapshot;
+    snapshot.bytesDone = bytesDone;
+    snapshot.totalBytes = totalBytes;
+    snapshot.calls = m_calls.load(std::memory_order_relaxed);
+    snapshot.p50Ns = percentile(0.50, snapshot.calls);
+    snapshot.p99Ns = percentile(0.99, snapshot.calls);
+    snapshot.maxNs = m_maxNs.load(std::memory_order_relaxed);
+
+    qint64 startNs = m_startNs.load(std::memory_order_acquire);
+    qint64 now = nowNs();
+    if (startNs == 0)
+        return snapshot;
+
+    qint64 stopNs = m_stopNs.load(std::memory_order_acquire);
+    qint64 elapsedNs = (stopNs > startNs ? stopNs : now) - startNs;
+    snapshot.elapsedMs = elapsedNs / 1000000;
+    if (elapsedNs > 0)
+        snapshot.averageMBps = bytesDone / Megabyte / (elapsedNs / 1e9);
+
+    // Exponentially weighted rate, weighted by the time between samples so
+    // it does not depend on how often sample() is called
+    if (m_lastSampleNs == 0 || m_lastSampleNs < startNs) {
+        m_lastSampleNs = startNs;
+        m_lastSampleBytes = 0;
+        m_ewmaBytesPerSecond = 0.0;
+    }
+    qint64 intervalNs = now - m_lastSampleNs;
+    if (intervalNs > 0 && bytesDone >= m_lastSampleBytes) {
+        double rate = (bytesDone - m_lastSampleBytes) / (intervalNs / 1e9);
+        double alpha = 1.0 - std::exp2(-(intervalNs / 1e6) / EwmaHalfLifeMs);
+        m_ewmaBytesPerSecond = m_ewmaBytesPerSecond == 0.0 ? rate
+                                                           : m_ewmaBytesPerSecond + alpha * (rate - m_ewmaBytesPerSecond);
+        m_lastSampleNs = now;
+        m_lastSampleBytes = bytesDone;
+    }
+    snapshot.currentMBps = m_ewmaBytesPerSecond / Megabyte;
+
+    if (totalBytes > 0 && bytesDone >= totalBytes)
+        snapshot.etaMs = 0;
+    else if (totalBytes > 0 && m_ewmaBytesPerSecond > 0.0)
+        snapshot.etaMs = static_cast<qint64>((totalBytes - bytesDone) / m_ewmaBytesPerSecond * 1000.0);
+
+    return snapshot;
+}
+
+QString TransferMetrics::format(const Snapshot &snapshot)
+{
+    QString eta = snapshot.etaMs < 0 ? QString("--")
+                                     : QString("%1 s").arg(snapshot.etaMs / 1000.0, 0, 'f', 1);
+    return QString("Avg %1 MB/s | Now %2 MB/s | ETA %3 | Latency p50 %4, p99 %5, max %6")
+        .arg(snapshot.averageMBps, 0, 'f', 1)
+        .arg(snapshot.currentMBps, 0, 'f', 1)
+        .arg(eta)
+        .arg(formatLatency(snapshot.p50Ns))
+        .arg(formatLatency(snapshot.p99Ns))
+        .arg(formatLatency(snapshot.maxNs));
+}
+
+QString TransferMetrics::formatLatency(qint64 latencyNs)
+{
+    if (latencyNs < 1000)
+        return QString("%1 ns").arg(latencyNs);
+    if (latencyNs < 1000000)
+        return QString("%1 us").arg(latencyNs / 1000.0, 0, 'f', 1);
+    return QString("%1 ms").arg(latencyNs / 1000000.0, 0, 'f', 2);
+}
+
+int TransferMetrics::bucketFor(qint64 latencyNs)
+{
+    if (latencyNs < SubBuckets)
+        return static_cast<int>(qMax<qint64>(0, latencyNs));
+
+    // Position of the top bit plus the bits right below it
+    int exponent = 63 - static_cast<int>(qCountLeadingZeroBits(static_cast<quint64>(latencyNs)));
+    int mantissa = static_cast<int>((latencyNs >> (exponent - SubBucketBits)) & (SubBuckets - 1));
+    return qMin(BucketCount - 1, (exponent - SubBucketBits + 1) * SubBuckets + mantissa);
+}
+
+qint64 TransferMetrics::bucketUpperBound(int bucket)
+{
+    if (bucket < SubBuckets)
+        return bucket;
+
+    int exponent = bucket / SubBuckets + SubBucketBits - 1;
+    int mantissa = bucket % SubBuckets;
+    return (static_cast<qint64>(SubBuckets + mantissa + 1) << (exponent - SubBucketBits)) - 1;
+}
+
+qint64 TransferMetrics::percentile(double fraction, quint64 calls) const
+{
+    if (calls == 0)
+        return 0;
+
+    quint64 rank = static_cast<quint64>(fraction * calls + 0.5);
+    quint64 seen = 0;
+    for (int bucket = 0; bucket < BucketCount; ++bucket) {
+        seen += m_buckets[static_cast<size_t>(bucket)].load(std::memory_order_relaxed);
+        if (seen >= qMax<quint64>(1, rank))
+            return qMin(bucketUpperBound(bucket), m_maxNs.load(std::memory_order_relaxed));
+    }
+    return m_maxNs.load(std::memory_order_relaxed);
+}
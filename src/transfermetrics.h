@@ -0,0 +1,61 @@
+#pragma once
+
+#include <QString>
+#include <array>
+#include <atomic>
+
+// Throughput, ETA and syscall latency of one operation. The worker records
+// the latency of every read/write call lock-free, one thread (the GUI, the
+// CLI, the benchmark) samples it. Latencies go into a log-linear histogram
+// (eight sub-buckets per power of two) so p50/p99 cost no memory per call.
+class TransferMetrics
+{
+public:
+    struct Snapshot
+    {
+        qint64 bytesDone = 0;
+        qint64 totalBytes = 0;
+        qint64 elapsedMs = 0;
+        double averageMBps = 0.0;
+        double currentMBps = 0.0;   // EWMA over the samples
+        qint64 etaMs = -1;          // -1 while unknown
+        quint64 calls = 0;
+        qint64 p50Ns = 0;
+        qint64 p99Ns = 0;
+        qint64 maxNs = 0;
+    };
+
+    TransferMetrics();
+
+    // Worker side
+    void start();
+    void stop();    // freezes the elapsed time, e.g. before verification
+    void recordLatency(qint64 latencyNs);
+
+    // Sampling side, not thread-safe against itself: one sampler per operation
+    Snapshot sample(qint64 bytesDone, qint64 totalBytes);
+
+    // One line summary, e.g. for the status area and the operation history
+    static QString format(const Snapshot &snapshot);
+    static QString formatLatency(qint64 latencyNs);
+
+private:
+    static constexpr int SubBucketBits = 3;
+    static constexpr int SubBuckets = 1 << SubBucketBits;
+    static constexpr int BucketCount = 64 * SubBuckets;
+
+    static int bucketFor(qint64 latencyNs);
+    static qint64 bucketUpperBound(int bucket);
+    qint64 percentile(double fraction, quint64 calls) const;
+
+    std::atomic<qint64> m_startNs;
+    std::atomic<qint64> m_stopNs;
+    std::atomic<quint64> m_calls;
+    std::atomic<qint64> m_maxNs;
+    std::array<std::atomic<quint64>, BucketCount> m_buckets;
+
+    // Sampler state
+    qint64 m_lastSampleNs;
+    qint64 m_lastSampleBytes;
+    double m_ewmaBytesPerSecond;
+};
@@ -0,0 +1,25 @@
+#include "transferoptions.h"
+
+qint64 TransferOptions::parseSize(const QString &text, bool *ok)
+{
+    QString value = text.trimmed().toUpper();
+    if (value.endsWith('B'))
+        value.chop(1);
+
+    qint64 factor = 1;
+    if (value.endsWith('K'))
+        factor = 1024;
+    else if (value.endsWith('M'))
+        factor = 1024 * 1024;
+    else if (value.endsWith('G'))
+        factor = 1024 * 1024 * 1024;
+    if (factor != 1)
+        value.chop(1);
+
+    bool valid = false;
+    qint64 size = value.toLongLong(&valid);
+    valid = valid && size > 0;
+    if (ok)
+        *ok = valid;
+    return valid ? size * factor : 0;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <QMetaType>
+#include <QString>
+
+// Settings chosen in the Controls group and handed to FileWorker together
+// with each operation, so a queued request always runs with the options that
+// were current when the user started it.
+struct TransferOptions
+{
+    enum class ReadMode
+    {
+        Buffered,   // QFile::read into heap memory
+        Mapped      // QFile::map, the mapping itself becomes the loaded data
+    };
+
+    enum class IoBackend
+    {
+        Blocking,   // one blocking QFile call at a time
+        IoUring     // many requests in flight (Linux, falls back to QFile)
+    };
+
+    ReadMode readMode = ReadMode::Buffered;
+    IoBackend ioBackend = IoBackend::Blocking;
+    int queueDepth = 32;                // io_uring requests in flight
+    qint64 blockSize = 1024 * 1024;     // io_uring request size, divides ChunkBuffer chunks
+    bool bypassCache = false;           // O_DIRECT / fadvise transfers, see UncachedFile
+    bool adaptiveChunkSize = true;      // QFile request size tuned per device, see ChunkTuner
+    qint64 chunkSize = 0;               // fixed QFile request size, 0 leaves it to ChunkTuner
+    int readThreads = 0;                // parallel pread workers for large files, 0 = by device type
+    bool checksums = true;              // CRC32C (+ xxHash3) of every read and save, see StreamHasher
+    bool sha256 = false;                // SHA-256 as well, much slower
+    bool verifyAfterSave = true;        // re-read a saved file and compare its checksums
+    bool resumable = true;              // journal large saves and copies, see TransferJournal
+    bool deltaSave = false;             // rewrite only the changed blocks of an existing file, see DeltaWriter
+    bool punchZeros = false;            // leave whole zero blocks out of saved files as holes, see SparseFile
+    bool compress = false;              // save as a block-compressed container, see CompressedFile
+    bool analyzeContent = true;         // byte statistics of every read, see ByteAnalyzer
+    qint64 memoryBudget = 0;            // reads past it spill to disk, 0 = half the RAM, -1 = unlimited, see MemoryReservation
+    QString spillDirectory;             // for spill files, the cache directory when empty
+
+    // Parses sizes given on the command line: "4096", "64K", "4M", "1G"
+    static qint64 parseSize(const QString &text, bool *ok = nullptr);
+};
+
+Q_DECLARE_METATYPE(TransferOptions)
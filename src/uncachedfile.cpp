@@ -0,0 +1,320 @@
+#include "uncachedfile.h"
+#include <QFile>
+#include <cstring>
+
+#ifdef Q_OS_LINUX
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#endif
+
+namespace {
+const qint64 Alignment = 4096;                  // covers any logical block size in use
+const qint64 BounceSize = 4 * 1024 * 1024;      // 4 MB per direct syscall
+const qint64 DropWindow = 16 * 1024 * 1024;     // fadvise granularity of the fallback
+}
+
+UncachedFile::UncachedFile(const QString &fileName, QObject *parent)
+    : QIODevice(parent)
+    , m_fileName(fileName)
+    , m_fd(-1)
+    , m_direct(false)
+    , m_size(0)
+    , m_fileOffset(0)
+    , m_consumed(0)
+    , m_bounce(nullptr)
+    , m_bounceFill(0)
+    , m_bounceRead(0)
+    , m_droppedUntil(0)
+    , m_cachedBytes(0)
+{
+}
+
+UncachedFile::~UncachedFile()
+{
+    close();
+}
+
+bool UncachedFile::isSupported()
+{
+#ifdef Q_OS_LINUX
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool UncachedFile::open(OpenMode mode)
+{
+#ifdef Q_OS_LINUX
+    bool writing = mode & QIODevice::WriteOnly;
+    int flags = writing ? O_WRONLY | O_CREAT | O_TRUNC : O_RDONLY;
+    QByteArray path = QFile::encodeName(m_fileName);
+
+    m_fd = ::open(path.constData(), flags | O_DIRECT | O_CLOEXEC, 0666);
+    m_direct = m_fd >= 0;
+    if (m_fd < 0 && errno == EINVAL) // the filesystem has no O_DIRECT (tmpfs, some FUSE)
+        m_fd = ::open(path.constData(), flags | O_CLOEXEC, 0666);
+    if (m_fd < 0) {
+        setErrorString(qt_error_string(errno));
+        return false;
+    }
+
+    if (m_direct && posix_memalign(reinterpret_cast<void **>(&m_bounce), Alignment, BounceSize) != 0) {
+        m_bounce = nullptr;
+        ::close(m_fd);
+        m_fd = -1;
+        setErrorString("Out of memory");
+        return false;
+    }
+
+    struct stat status;
+    m_size = ::fstat(m_fd, &status) == 0 ? status.st_size : 0;
+    m_fileOffset = 0;
+    m_consumed = 0;
+    m_bounceFill = 0;
+    m_bounceRead = 0;
+    m_droppedUntil = 0;
+    m_cachedBytes = 0;
+
+    if (!m_direct)
+        posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    return QIODevice::open(mode | QIODevice::Unbuffered);
+#else
+    Q_UNUSED(mode);
+    setErrorString("Uncached I/O is not supported on this platform");
+    return false;
+#endif
+}
+
+void UncachedFile::close()
+{
+#ifdef Q_OS_LINUX
+    if (m_fd >= 0) {
+        dropCompleted(true);
+        ::close(m_fd);
+        m_fd = -1;
+
+        // Probe through a separate read-only descriptor, a write-only one
+        // cannot be mapped
+        int probe = ::open(QFile::encodeName(m_fileName).constData(), O_RDONLY | O_CLOEXEC);
+        if (probe >= 0) {
+            struct stat status;
+            qint64 size = ::fstat(probe, &status) == 0 ? status.st_size : 0;
+            m_cachedBytes = residentBytes(probe, size);
+            ::close(probe);
+        }
+    }
+    free(m_bounce);
+    m_bounce = nullptr;
+#endif
+    if (isOpen())
+        QIODevice::close();
+}
+
+qint64 UncachedFile::size() const
+{
+    return m_size;
+}
+
+qint64 UncachedFile::bytesAvailable() const
+{
+    return qMax<qint64>(0, m_size - m_consumed) + QIODevice::bytesAvailable();
+}
+
+bool UncachedFile::commit()
+{
+#ifdef Q_OS_LINUX
+    if (!m_direct || m_bounceFill == 0)
+        return true;
+
+    // O_DIRECT only writes whole blocks: pad the tail with zeros, write it,
+    // then cut the file back to its real length
+    qint64 tail = m_bounceFill;
+    qint64 padded = (tail + Alignment - 1) / Alignment * Alignment;
+    memset(m_bounce + tail, 0, static_cast<size_t>(padded - tail));
+    if (!flushBounce(padded))
+        return false;
+
+    m_fileOffset -= padded - tail;
+    if (::ftruncate(m_fd, m_fileOffset) != 0) {
+        setErrorString(qt_error_string(errno));
+        return false;
+    }
+#endif
+    return true;
+}
+
+qint64 UncachedFile::residentBytes(int fd, qint64 size)
+{
+#ifdef Q_OS_LINUX
+    const qint64 pageSize = sysconf(_SC_PAGESIZE);
+    const qint64 window = 1024 * 1024 * 1024; // map and probe 1 GB at a time
+    std::vector<unsigned char> residency;
+    qint64 resident = 0;
+
+    for (qint64 offset = 0; offset < size; offset += window) {
+        size_t length = static_cast<size_t>(qMin(window, size - offset));
+        void *mapping = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, offset);
+        if (mapping == MAP_FAILED)
+            return -1;
+
+        residency.resize((length + pageSize - 1) / pageSize);
+        if (mincore(mapping, length, residency.data()) == 0) {
+            for (unsigned char page : residency)
+                resident += page & 1;
+        }
+        munmap(mapping, length);
+    }
+
+    return qMin(resident * pageSize, size);
+#else
+    Q_UNUSED(fd);
+    Q_UNUSED(size);
+    return -1;
+#endif
+}
+
+qint64 UncachedFile::readData(char *data, qint64 maxSize)
+{
+#ifdef Q_OS_LINUX
+    if (!m_direct) {
+        ssize_t bytesRead;
+        do {
+            bytesRead = ::read(m_fd, data, static_cast<size_t>(maxSize));
+        } while (bytesRead < 0 && errno == EINTR);
+        if (bytesRead < 0) {
+            setErrorString(qt_error_string(errno));
+            return -1;
+        }
+        m_fileOffset += bytesRead;
+        m_consumed += bytesRead;
+        dropCompleted(false);
+        return bytesRead;
+    }
+
+    qint64 copied = 0;
+    while (copied < maxSize) {
+        if (m_bounceRead == m_bounceFill) {
+            if (m_fileOffset >= m_size)
+                break;
+
+            // Refill with whole aligned blocks, the kernel returns a short
+            // count for the unaligned end of the file
+            ssize_t bytesRead;
+            do {
+                bytesRead = ::pread(m_fd, m_bounce, BounceSize, m_fileOffset);
+            } while (bytesRead < 0 && errno == EINTR);
+            if (bytesRead < 0) {
+                setErrorString(qt_error_string(errno));
+                return copied > 0 ? copied : -1;
+            }
+            if (bytesRead == 0)
+                break;
+            m_fileOffset += bytesRead;
+            m_bounceFill = bytesRead;
+            m_bounceRead = 0;
+        }
+
+        qint64 count = qMin(maxSize - copied, m_bounceFill - m_bounceRead);
+        memcpy(data + copied, m_bounce + m_bounceRead, static_cast<size_t>(count));
+        m_bounceRead += count;
+        copied += count;
+    }
+
+    m_consumed += copied;
+    return copied;
+#else
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+    return -1;
+#endif
+}
+
+qint64 UncachedFile::writeData(const char *data, qint64 size)
+{
+#ifdef Q_OS_LINUX
+    if (!m_direct) {
+        qint64 written = 0;
+        while (written < size) {
+            ssize_t bytesWritten = ::write(m_fd, data + written, static_cast<size_t>(size - written));
+            if (bytesWritten < 0) {
+                if (errno == EINTR)
+                    continue;
+                setErrorString(qt_error_string(errno));
+                return -1;
+            }
+            written += bytesWritten;
+        }
+        m_fileOffset += written;
+        dropCompleted(false);
+        return written;
+    }
+
+    qint64 copied = 0;
+    while (copied < size) {
+        qint64 count = qMin(size - copied, BounceSize - m_bounceFill);
+        memcpy(m_bounce + m_bounceFill, data + copied, static_cast<size_t>(count));
+        m_bounceFill += count;
+        copied += count;
+
+        if (m_bounceFill == BounceSize && !flushBounce(BounceSize))
+            return -1;
+    }
+    return copied;
+#else
+    Q_UNUSED(data);
+    Q_UNUSED(size);
+    return -1;
+#endif
+}
+
+bool UncachedFile::flushBounce(qint64 length)
+{
+#ifdef Q_OS_LINUX
+    qint64 written = 0;
+    while (written < length) {
+        ssize_t bytesWritten = ::pwrite(m_fd, m_bounce + written, static_cast<size_t>(length - written),
+                                        m_fileOffset + written);
+        if (bytesWritten < 0) {
+            if (errno == EINTR)
+                continue;
+            setErrorString(qt_error_string(errno));
+            return false;
+        }
+        written += bytesWritten;
+    }
+    m_fileOffset += length;
+    m_bounceFill = 0;
+    return true;
+#else
+    Q_UNUSED(length);
+    return false;
+#endif
+}
+
+void UncachedFile::dropCompleted(bool force)
+{
+#ifdef Q_OS_LINUX
+    if (m_direct)
+        return;
+
+    qint64 length = m_fileOffset - m_droppedUntil;
+    if (length <= 0 || (!force && length < DropWindow))
+        return;
+
+    // Dirty pages cannot be dropped, write the range back first
+    if (openMode() & QIODevice::WriteOnly)
+        sync_file_range(m_fd, m_droppedUntil, length,
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+    posix_fadvise(m_fd, m_droppedUntil, length, POSIX_FADV_DONTNEED);
+    m_droppedUntil = m_fileOffset;
+#else
+    Q_UNUSED(force);
+#endif
+}
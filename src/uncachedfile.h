@@ -0,0 +1,62 @@
+#pragma once
+
+#include <QIODevice>
+
+// File device that keeps transfers out of the page cache, so reading or
+// writing a huge file does not evict the working set of everything else on
+// the host. Opens with O_DIRECT and moves data through an aligned bounce
+// buffer, padding the unaligned tail of a write and truncating it back. If
+// the filesystem refuses O_DIRECT, it falls back to buffered I/O and drops
+// each completed range with posix_fadvise(POSIX_FADV_DONTNEED). Linux only,
+// see isSupported().
+class UncachedFile : public QIODevice
+{
+    Q_OBJECT
+
+public:
+    explicit UncachedFile(const QString &fileName, QObject *parent = nullptr);
+    ~UncachedFile() override;
+
+    static bool isSupported();
+
+    // ReadOnly, or WriteOnly which always truncates
+    bool open(OpenMode mode) override;
+    void close() override;
+
+    bool isSequential() const override { return true; }
+    qint64 size() const override;
+    qint64 bytesAvailable() const override;
+
+    // Writes out the buffered tail of a direct write and fixes the file size.
+    // Must be called before close() for the written file to be complete.
+    bool commit();
+
+    // True when O_DIRECT is in use, false for the fadvise fallback
+    bool isDirect() const { return m_direct; }
+
+    // Bytes of this file resident in the page cache, measured on close()
+    qint64 cachedBytes() const { return m_cachedBytes; }
+
+    // Bytes of the first size bytes of fd currently in the page cache
+    static qint64 residentBytes(int fd, qint64 size);
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 size) override;
+
+private:
+    bool flushBounce(qint64 length);
+    void dropCompleted(bool force);
+
+    QString m_fileName;
+    int m_fd;
+    bool m_direct;
+    qint64 m_size;          // file size when reading
+    qint64 m_fileOffset;    // offset of the next read or write syscall
+    qint64 m_consumed;      // bytes handed to the reader
+    char *m_bounce;
+    qint64 m_bounceFill;    // valid bytes in the bounce buffer
+    qint64 m_bounceRead;    // bytes of the bounce buffer already handed out
+    qint64 m_droppedUntil;  // everything before this offset was dropped
+    qint64 m_cachedBytes;
+};
@@ -0,0 +1,308 @@
+#include "uringtransfer.h"
+
+#ifdef CUBE_HAVE_LIBURING
+#include <liburing.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#endif
+
+#ifdef CUBE_HAVE_LIBURING
+
+struct UringTransfer::Private
+{
+    // One in-flight block. A read in slot i lands in bounce buffer i, a
+    // write is submitted from the chunk that holds its block.
+    struct Request
+    {
+        qint64 offset = 0;
+        qint64 length = 0;
+        qint64 done = 0;
+        const char *source = nullptr;
+        bool complete = false;
+    };
+
+    io_uring ring;
+    bool ringReady = false;
+    bool fixedBuffers = false;
+    bool fixedFile = false;
+    int fd = -1;
+    std::vector<iovec> buffers;
+    std::vector<Request> requests;
+
+    ~Private()
+    {
+        if (ringReady)
+            io_uring_queue_exit(&ring);
+        for (iovec &buffer : buffers)
+            std::free(buffer.iov_base);
+    }
+
+    void prepare(int slot, bool writing)
+    {
+        Request &request = requests[slot];
+        io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+        unsigned length = static_cast<unsigned>(request.length - request.done);
+        __u64 offset = static_cast<__u64>(request.offset + request.done);
+        int target = fixedFile ? 0 : fd;
+
+        if (writing) {
+            io_uring_prep_write(sqe, target, request.source + request.done, length, offset);
+        } else {
+            char *buffer = static_cast<char *>(buffers[slot].iov_base) + request.done;
+            if (fixedBuffers)
+                io_uring_prep_read_fixed(sqe, target, buffer, length, offset, slot);
+            else
+                io_uring_prep_read(sqe, target, buffer, length, offset);
+        }
+        if (fixedFile)
+            io_uring_sqe_set_flags(sqe, IOSQE_FIXED_FILE);
+        io_uring_sqe_set_data(sqe, reinterpret_cast<void *>(static_cast<quintptr>(slot)));
+    }
+
+    // Waits for everything still in flight, the buffers must not be freed
+    // or reused while the kernel may still access them
+    void drain(int inFlight)
+    {
+        while (inFlight > 0) {
+            io_uring_cqe *cqe = nullptr;
+            if (io_uring_wait_cqe(&ring, &cqe) < 0)
+                return;
+            io_uring_cqe_seen(&ring, cqe);
+            --inFlight;
+        }
+    }
+};
+
+UringTransfer::UringTransfer(int queueDepth, qint64 blockSize)
+    : m_queueDepth(qBound(1, queueDepth, 4096))
+    , m_blockSize(blockSize)
+    , d(new Private)
+{
+}
+
+UringTransfer::~UringTransfer()
+{
+    delete d;
+}
+
+bool UringTransfer::isAvailable()
+{
+    static const bool available = []() {
+        io_uring ring;
+        if (io_uring_queue_init(2, &ring, 0) < 0)
+            return false;
+        io_uring_queue_exit(&ring);
+        return true;
+    }();
+    return available;
+}
+
+bool UringTransfer::open(int fd, qint64 chunkSize, QString *error)
+{
+    // Blocks must tile the buffer chunks exactly, a block is written from
+    // or read into a single chunk
+    if (m_blockSize <= 0 || chunkSize % m_blockSize != 0) {
+        *error = QString("io_uring block size %1 does not divide the %2 byte chunks")
+                     .arg(m_blockSize).arg(chunkSize);
+        return false;
+    }
+
+    int result = io_uring_queue_init(static_cast<unsigned>(m_queueDepth), &d->ring, 0);
+    if (result < 0) {
+        *error = QString("io_uring setup failed: %1").arg(qt_error_string(-result));
+        return false;
+    }
+    d->ringReady = true;
+    d->fd = fd;
+
+    d->buffers.resize(static_cast<size_t>(m_queueDepth));
+    for (iovec &buffer : d->buffers) {
+        void *memory = nullptr;
+        if (posix_memalign(&memory, 4096, static_cast<size_t>(m_blockSize)) != 0) {
+            *error = "io_uring setup failed: out of memory";
+            return false;
+        }
+        buffer.iov_base = memory;
+        buffer.iov_len = static_cast<size_t>(m_blockSize);
+    }
+    d->requests.resize(static_cast<size_t>(m_queueDepth));
+
+    // Registration saves the kernel from pinning pages and looking up the fd
+    // on every request. It is limited by RLIMIT_MEMLOCK, so failing here only
+    // means the plain opcodes are used. Writes come from the chunks, which
+    // are not registered: registering a whole buffer would pin all of it.
+    d->fixedBuffers = io_uring_register_buffers(&d->ring, d->buffers.data(),
+                                                static_cast<unsigned>(d->buffers.size())) == 0;
+    d->fixedFile = io_uring_register_files(&d->ring, &fd, 1) == 0;
+    return true;
+}
+
+UringTransfer::Result UringTransfer::read(ChunkBuffer &data, qint64 size, const Progress &progress,
+                                          QString *error)
+{
+    return run(size, false, &data, nullptr, progress, error);
+}
+
+UringTransfer::Result UringTransfer::write(const ChunkBuffer &data, const Progress &progress,
+                                           QString *error)
+{
+    return run(data.size(), true, nullptr, &data, progress, error);
+}
+
+UringTransfer::Result UringTransfer::run(qint64 size, bool writing, ChunkBuffer *destination,
+                                         const ChunkBuffer *source, const Progress &progress,
+                                         QString *error)
+{
+    qint64 blockCount = (size + m_blockSize - 1) / m_blockSize;
+    qint64 submitted = 0;   // blocks handed to the kernel
+    qint64 retired = 0;     // blocks completed and consumed in file order
+    int inFlight = 0;
+    char *chunk = nullptr;
+
+    while (retired < blockCount) {
+        // Keep the queue full
+        while (submitted < blockCount && submitted - retired < m_queueDepth) {
+            int slot = static_cast<int>(submitted % m_queueDepth);
+            Private::Request &request = d->requests[static_cast<size_t>(slot)];
+            request.offset = submitted * m_blockSize;
+            request.length = qMin(m_blockSize, size - request.offset);
+            request.done = 0;
+            request.complete = false;
+
+            // Writes go straight from the chunk, no copy. The caller keeps
+            // the buffer alive and unchanged until the transfer returns.
+            if (writing) {
+                int index = source->chunkIndex(request.offset);
+                request.source = source->chunkData(index) + (request.offset - source->chunkOffset(index));
+            }
+
+            d->prepare(slot, writing);
+            ++submitted;
+            ++inFlight;
+        }
+
+        int result = io_uring_submit_and_wait(&d->ring, 1);
+        if (result < 0 && result != -EINTR) {
+            // The ring itself is broken, it is torn down with the transfer
+            *error = qt_error_string(-result);
+            return Result::Failed;
+        }
+
+        // Reap whatever has completed, in any order
+        io_uring_cqe *cqe;
+        unsigned head;
+        unsigned seen = 0;
+        int failure = 0;
+        io_uring_for_each_cqe(&d->ring, head, cqe) {
+            ++seen;
+            --inFlight;
+            int slot = static_cast<int>(reinterpret_cast<quintptr>(io_uring_cqe_get_data(cqe)));
+            Private::Request &request = d->requests[static_cast<size_t>(slot)];
+
+            if (cqe->res == -EAGAIN || cqe->res == -EINTR) {
+                d->prepare(slot, writing);
+                ++inFlight;
+            } else if (cqe->res < 0) {
+                failure = -cqe->res;
+            } else if (cqe->res == 0) {
+                failure = writing ? EIO : ENODATA; // file shrank under us
+            } else {
+                request.done += cqe->res;
+                if (request.done < request.length) {
+                    // Short transfer, queue the remainder of the block
+                    d->prepare(slot, writing);
+                    ++inFlight;
+                } else {
+                    request.complete = true;
+                }
+            }
+        }
+        io_uring_cq_advance(&d->ring, seen);
+
+        if (failure != 0) {
+            *error = qt_error_string(failure);
+            io_uring_submit(&d->ring);
+            d->drain(inFlight);
+            return Result::Failed;
+        }
+
+        // Retire the oldest blocks that are complete, so data and progress
+        // only ever advance contiguously
+        qint64 retiredBefore = retired;
+        while (retired < submitted) {
+            int slot = static_cast<int>(retired % m_queueDepth);
+            const Private::Request &request = d->requests[static_cast<size_t>(slot)];
+            if (!request.complete)
+                break;
+
+            if (!writing) {
+                if (request.offset % destination->chunkSize() == 0)
+                    chunk = destination->appendChunk(qMin(destination->chunkSize(), size - request.offset));
+                memcpy(chunk + request.offset % destination->chunkSize(),
+                       d->buffers[static_cast<size_t>(slot)].iov_base, static_cast<size_t>(request.length));
+            }
+            ++retired;
+        }
+
+        if (retired != retiredBefore && !progress(qMin(retired * m_blockSize, size))) {
+            io_uring_submit(&d->ring);
+            d->drain(inFlight);
+            return Result::Cancelled;
+        }
+    }
+
+    return Result::Done;
+}
+
+#else // CUBE_HAVE_LIBURING
+
+struct UringTransfer::Private
+{
+};
+
+UringTransfer::UringTransfer(int queueDepth, qint64 blockSize)
+    : m_queueDepth(queueDepth)
+    , m_blockSize(blockSize)
+    , d(nullptr)
+{
+}
+
+UringTransfer::~UringTransfer()
+{
+}
+
+bool UringTransfer::isAvailable()
+{
+    return false;
+}
+
+bool UringTransfer::open(int fd, qint64 chunkSize, QString *error)
+{
+    Q_UNUSED(fd);
+    Q_UNUSED(chunkSize);
+    *error = "io_uring support is not built in";
+    return false;
+}
+
+UringTransfer::Result UringTransfer::read(ChunkBuffer &data, qint64 size, const Progress &progress,
+                                          QString *error)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(size);
+    Q_UNUSED(progress);
+    *error = "io_uring support is not built in";
+    return Result::Failed;
+}
+
+UringTransfer::Result UringTransfer::write(const ChunkBuffer &data, const Progress &progress,
+                                           QString *error)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(progress);
+    *error = "io_uring support is not built in";
+    return Result::Failed;
+}
+
+#endif // CUBE_HAVE_LIBURING
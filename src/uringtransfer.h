@@ -0,0 +1,52 @@
+#pragma once
+
+#include <QString>
+#include <functional>
+#include "chunkbuffer.h"
+
+// Linux io_uring backend for FileWorker. Keeps up to queueDepth block-sized
+// reads or writes in flight against a registered file, and retires them in
+// file order so progress stays monotonic. Reads go through a registered set
+// of bounce buffers and are copied into the chunks they complete, writes are
+// submitted straight from the chunks. Only functional when built with
+// liburing (CUBE_HAVE_LIBURING).
+class UringTransfer
+{
+public:
+    // Called with the number of bytes retired so far, returns false to cancel
+    using Progress = std::function<bool(qint64)>;
+
+    enum class Result { Done, Cancelled, Failed };
+
+    UringTransfer(int queueDepth, qint64 blockSize);
+    ~UringTransfer();
+
+    UringTransfer(const UringTransfer &) = delete;
+    UringTransfer &operator=(const UringTransfer &) = delete;
+
+    // Whether this build and the running kernel support io_uring at all
+    static bool isAvailable();
+
+    // Sets up the ring and registers the buffers and the file, for a buffer
+    // of chunkSize chunks. Fails when the block size does not divide them or
+    // the ring cannot be set up, the caller then falls back to the QFile path.
+    bool open(int fd, qint64 chunkSize, QString *error);
+
+    // Reads size bytes from offset 0 and appends them to data
+    Result read(ChunkBuffer &data, qint64 size, const Progress &progress, QString *error);
+    // Writes data to offset 0
+    Result write(const ChunkBuffer &data, const Progress &progress, QString *error);
+
+    int queueDepth() const { return m_queueDepth; }
+    qint64 blockSize() const { return m_blockSize; }
+
+private:
+    struct Private;
+
+    Result run(qint64 size, bool writing, ChunkBuffer *destination, const ChunkBuffer *source,
+               const Progress &progress, QString *error);
+
+    int m_queueDepth;
+    qint64 m_blockSize;
+    Private *d;
+};
@@ -0,0 +1,312 @@
+#include <QDir>
+#include <QTemporaryDir>
+#include <QtTest>
+#include "chunkbuffer.h"
+#include "spillfile.h"
+
+// ChunkBuffer's spilled, sparse and truncated buffers
+class TestChunkBuffer : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void readAcrossChunks();
+    void sparse();
+    void truncate_data();
+    void truncate();
+    void truncateSparse();
+    void truncateKeepsNothingOfTheSource();
+    void spill();
+    void truncateSpilled();
+    void memoryReservation();
+};
+
+namespace {
+const qint64 SmallChunk = 4096;
+
+char byteAt(qint64 offset)
+{
+    return char((offset * 131 + (offset >> 12)) & 0xFF);
+}
+
+void fill(char *data, qint64 offset, qint64 length)
+{
+    for (qint64 index = 0; index < length; ++index)
+        data[index] = byteAt(offset + index);
+}
+
+ChunkBuffer patternBuffer(qint64 size, qint64 chunkSize)
+{
+    ChunkBuffer data(chunkSize);
+    for (qint64 offset = 0; offset < size; offset += chunkSize) {
+        qint64 length = qMin(chunkSize, size - offset);
+        fill(data.appendChunk(length), offset, length);
+    }
+    return data;
+}
+
+// Spill files are refused in memory, and the temp directory often is
+QString spillTemplate()
+{
+    QDir().mkpath(SpillFile::defaultDirectory());
+    return SpillFile::defaultDirectory() + "/tst_chunkbuffer-XXXXXX";
+}
+
+bool hasPattern(const ChunkBuffer &data, qint64 offset, qint64 length)
+{
+    QByteArray bytes = data.read(offset, length);
+    if (bytes.size() != length)
+        return false;
+    for (qint64 index = 0; index < length; ++index) {
+        if (bytes[index] != byteAt(offset + index))
+            return false;
+    }
+    return true;
+}
+}
+
+void TestChunkBuffer::readAcrossChunks()
+{
+    ChunkBuffer data = patternBuffer(3 * SmallChunk + 100, SmallChunk);
+    QCOMPARE(data.size(), 3 * SmallChunk + 100);
+    QCOMPARE(data.chunkCount(), 4);
+    QVERIFY(hasPattern(data, 0, data.size()));
+    QVERIFY(hasPattern(data, SmallChunk - 10, 2 * SmallChunk + 20));
+
+    // Reads are clipped to the end and empty outside the buffer
+    QCOMPARE(data.read(data.size() - 50, 1000).size(), qsizetype(50));
+    QVERIFY(data.read(data.size(), 10).isEmpty());
+    QVERIFY(data.read(-1, 10).isEmpty());
+}
+
+void TestChunkBuffer::sparse()
+{
+    // data, hole, hole, data, partial hole at the end
+    ChunkBuffer data(SmallChunk);
+    fill(data.appendChunk(SmallChunk), 0, SmallChunk);
+    data.appendZeroChunk(SmallChunk);
+    data.appendZeroChunk(SmallChunk);
+    fill(data.appendChunk(SmallChunk), 3 * SmallChunk, SmallChunk);
+    data.appendZeroChunk(123);
+    data.setExtents({{0, SmallChunk}, {3 * SmallChunk, SmallChunk}});
+
+    QVERIFY(data.isSparse());
+    QCOMPARE(data.size(), 4 * SmallChunk + 123);
+    QCOMPARE(data.dataBytes(), 2 * SmallChunk);
+    QCOMPARE(data.residentBytes(), 2 * SmallChunk);
+    QVERIFY(!data.isSpilled());
+    QCOMPARE(data.spilledBytes(), qint64(0));
+
+    QVERIFY(hasPattern(data, 0, SmallChunk));
+    QVERIFY(hasPattern(data, 3 * SmallChunk, SmallChunk));
+    QVERIFY(data.read(SmallChunk, 2 * SmallChunk) == QByteArray(2 * SmallChunk, '\0'));
+    QVERIFY(data.read(4 * SmallChunk, 123) == QByteArray(123, '\0'));
+
+    // Holes share one allocation
+    QVERIFY(data.chunkData(1) == data.chunkData(2));
+
+    // A hole bigger than the shared zeros still reads as zeros
+    ChunkBuffer large(2 * ChunkBuffer::DefaultChunkSize);
+    large.appendZeroChunk(ChunkBuffer::DefaultChunkSize + 1);
+    QCOMPARE(large.size(), ChunkBuffer::DefaultChunkSize + 1);
+    QCOMPARE(large.read(ChunkBuffer::DefaultChunkSize - 1, 2), QByteArray(2, '\0'));
+}
+
+void TestChunkBuffer::truncate_data()
+{
+    QTest::addColumn<qint64>("size");
+    QTest::addColumn<int>("chunkCount");
+
+    QTest::newRow("inside the last chunk") << 3 * SmallChunk + 50 << 4;
+    QTest::newRow("on a chunk border") << 2 * SmallChunk << 2;
+    QTest::newRow("one byte into a chunk") << 2 * SmallChunk + 1 << 3;
+    QTest::newRow("inside the first chunk") << qint64(7) << 1;
+}
+
+void TestChunkBuffer::truncate()
+{
+    QFETCH(qint64, size);
+    QFETCH(int, chunkCount);
+
+    ChunkBuffer data = patternBuffer(3 * SmallChunk + 100, SmallChunk);
+    ChunkBuffer copy = data;
+    data.truncate(size);
+
+    QCOMPARE(data.size(), size);
+    QCOMPARE(data.chunkCount(), chunkCount);
+    QCOMPARE(qint64(data.chunk(chunkCount - 1).size()), size - data.chunkOffset(chunkCount - 1));
+    QVERIFY(hasPattern(data, 0, size));
+    QVERIFY(data.read(size, 1).isEmpty());
+
+    // Chunks are shared, the copy keeps its length and bytes
+    QCOMPARE(copy.size(), 3 * SmallChunk + 100);
+    QVERIFY(hasPattern(copy, 0, copy.size()));
+
+    // Growing is not what truncate does
+    data.truncate(size + 1000);
+    QCOMPARE(data.size(), size);
+
+    data.truncate(0);
+    QVERIFY(data.isEmpty());
+    QCOMPARE(data.chunkCount(), 0);
+}
+
+void TestChunkBuffer::truncateSparse()
+{
+    ChunkBuffer data(SmallChunk);
+    fill(data.appendChunk(SmallChunk), 0, SmallChunk);
+    data.appendZeroChunk(SmallChunk);
+    fill(data.appendChunk(SmallChunk), 2 * SmallChunk, SmallChunk);
+    data.appendZeroChunk(SmallChunk);
+    data.setExtents({{0, SmallChunk}, {2 * SmallChunk, SmallChunk}});
+
+    // The second extent ends early
+    data.truncate(2 * SmallChunk + 10);
+    QCOMPARE(data.extents().size(), 2);
+    QCOMPARE(data.extents().last().length, qint64(10));
+    QCOMPARE(data.dataBytes(), SmallChunk + 10);
+    QVERIFY(hasPattern(data, 2 * SmallChunk, 10));
+
+    // Into the hole: the extent past the end goes, the shared zeros stay intact
+    data.truncate(SmallChunk + 100);
+    QCOMPARE(data.extents().size(), 1);
+    QCOMPARE(data.dataBytes(), SmallChunk);
+    QVERIFY(data.read(SmallChunk, 100) == QByteArray(100, '\0'));
+    QVERIFY(data.isSparse());
+
+    ChunkBuffer holes(SmallChunk);
+    holes.appendZeroChunk(SmallChunk);
+    QVERIFY(holes.read(0, SmallChunk) == QByteArray(SmallChunk, '\0'));
+}
+
+void TestChunkBuffer::truncateKeepsNothingOfTheSource()
+{
+    ChunkBuffer data = patternBuffer(2 * SmallChunk, SmallChunk);
+    data.setSource(QCoreApplication::applicationFilePath(), QDateTime::currentDateTime());
+    Checksums checksums;
+    checksums.algorithms = Checksums::Crc32c;
+    checksums.crc32c = 0x12345678u;
+    data.setChecksums(checksums);
+
+    data.truncate(data.size() + 1);
+    QVERIFY(!data.sourcePath().isEmpty());
+    QVERIFY(!data.checksums().isEmpty());
+
+    // A prefix is not a copy of the source, nor do its digests match
+    data.truncate(SmallChunk + 1);
+    QVERIFY(data.sourcePath().isEmpty());
+    QVERIFY(!data.matchesSource());
+    QVERIFY(data.checksums().isEmpty());
+}
+
+void TestChunkBuffer::spill()
+{
+    if (!SpillFile::isSupported())
+        QSKIP("Spilling to disk is not supported on this platform");
+
+    QTemporaryDir dir(spillTemplate());
+    QVERIFY(dir.isValid());
+    if (SpillFile::isInMemory(dir.path()))
+        QSKIP("The cache directory is in memory, spill files are refused there");
+
+    // Past the hot window by several evict steps, with a partial last chunk
+    const qint64 chunkSize = 1024 * 1024;
+    const qint64 size = SpillFile::HotWindow + 4 * SpillFile::EvictStep + 12345;
+    QString error;
+    ChunkBuffer data = ChunkBuffer::spilled(size, dir.path(), &error, chunkSize);
+    QVERIFY2(data.isSpilled(), qPrintable(error));
+    QCOMPARE(data.spillDirectory(), dir.path());
+
+    // Filled the way readers do, marking the contiguous prefix as they go
+    for (qint64 offset = 0; offset < size; offset += chunkSize) {
+        qint64 length = qMin(chunkSize, size - offset);
+        fill(data.appendChunk(length), offset, length);
+        data.markFilled(offset + length);
+    }
+    QCOMPARE(data.size(), size);
+
+    // Both are -1 when the system cannot tell
+    qint64 resident = data.residentBytes();
+    QVERIFY(resident >= -1 && resident <= size);
+    QVERIFY(data.spilledBytes() >= -1 && data.spilledBytes() <= size);
+    QCOMPARE(data.spilledBytes() < 0, resident < 0);
+
+    // Copies share the file, dropping it from memory loses no data
+    ChunkBuffer copy = data;
+    data.releaseResident();
+    QVERIFY(data.residentBytes() <= resident);
+    QVERIFY(hasPattern(data, 0, chunkSize));
+    QVERIFY(hasPattern(data, SpillFile::HotWindow - 100, 2 * chunkSize));
+    QVERIFY(hasPattern(copy, size - 3 * chunkSize, 3 * chunkSize));
+
+    // A buffer that is not spilled ignores both
+    ChunkBuffer heap = patternBuffer(3 * SmallChunk, SmallChunk);
+    heap.markFilled(heap.size());
+    heap.releaseResident();
+    QCOMPARE(heap.residentBytes(), heap.size());
+    QVERIFY(hasPattern(heap, 0, heap.size()));
+}
+
+void TestChunkBuffer::truncateSpilled()
+{
+    if (!SpillFile::isSupported())
+        QSKIP("Spilling to disk is not supported on this platform");
+
+    QTemporaryDir dir(spillTemplate());
+    QVERIFY(dir.isValid());
+    if (SpillFile::isInMemory(dir.path()))
+        QSKIP("The cache directory is in memory, spill files are refused there");
+
+    // A read that ended early leaves a spilled buffer shorter than its file
+    const qint64 size = 8 * SmallChunk;
+    QString error;
+    ChunkBuffer data = ChunkBuffer::spilled(size, dir.path(), &error, SmallChunk);
+    QVERIFY2(data.isSpilled(), qPrintable(error));
+    for (qint64 offset = 0; offset < 5 * SmallChunk; offset += SmallChunk)
+        fill(data.appendChunk(SmallChunk), offset, SmallChunk);
+
+    data.truncate(3 * SmallChunk + 17);
+    QVERIFY(data.isSpilled());
+    QCOMPARE(data.size(), 3 * SmallChunk + 17);
+    QCOMPARE(data.chunkCount(), 4);
+    QVERIFY(hasPattern(data, 0, data.size()));
+    QVERIFY(data.spilledBytes() >= -1 && data.spilledBytes() <= data.size());
+
+    data.truncate(0);
+    QVERIFY(!data.isSpilled());
+    QVERIFY(data.isEmpty());
+
+    // Chunks past the end of the spill file are on the heap and stay valid
+    ChunkBuffer grown = ChunkBuffer::spilled(2 * SmallChunk, dir.path(), &error, SmallChunk);
+    QVERIFY2(grown.isSpilled(), qPrintable(error));
+    for (qint64 offset = 0; offset < 4 * SmallChunk; offset += SmallChunk)
+        fill(grown.appendChunk(SmallChunk), offset, SmallChunk);
+    grown.truncate(3 * SmallChunk + 10);
+    QCOMPARE(grown.size(), 3 * SmallChunk + 10);
+    QVERIFY(hasPattern(grown, 0, grown.size()));
+}
+
+void TestChunkBuffer::memoryReservation()
+{
+    const qint64 held = MemoryReservation::reservedBytes();
+    const qint64 budget = held + 1000;
+
+    // The reservation lives as long as the last copy of its buffer
+    ChunkBuffer first(SmallChunk);
+    first.setReservation(MemoryReservation::reserve(600, budget));
+    QCOMPARE(MemoryReservation::reservedBytes(), held + 600);
+    ChunkBuffer copy = first;
+
+    QVERIFY(MemoryReservation::reserve(600, budget).isNull());
+    QVERIFY(!MemoryReservation::reserve(600, -1).isNull());
+    QCOMPARE(MemoryReservation::reservedBytes(), held + 600);
+
+    first.clear();
+    QVERIFY(MemoryReservation::reserve(600, budget).isNull());
+    copy = ChunkBuffer();
+    QCOMPARE(MemoryReservation::reservedBytes(), held);
+    QVERIFY(!MemoryReservation::reserve(1000, budget).isNull());
+}
+
+QTEST_GUILESS_MAIN(TestChunkBuffer)
+#include "tst_chunkbuffer.moc"
@@ -0,0 +1,200 @@
+#include <QDataStream>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+#include <QtTest>
+#include "compressedfile.h"
+#include "operationcontrol.h"
+
+// Compress -> open -> read round trips of CompressedFile, and containers
+// that were cut short or have a damaged index
+class TestCompressedFile : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void roundTrip_data();
+    void roundTrip();
+    void readBlock();
+    void truncatedFile();
+    void damagedIndex();
+    void damagedBlock();
+
+private:
+    QString write(const ChunkBuffer &data, const QString &name);
+
+    QTemporaryDir m_dir;
+};
+
+namespace {
+// Text-like runs with some noise, so blocks compress but not to nothing
+ChunkBuffer patternBuffer(qint64 size)
+{
+    ChunkBuffer data;
+    quint32 state = 12345;
+    for (qint64 offset = 0; offset < size; offset += data.chunkSize()) {
+        qint64 length = qMin(data.chunkSize(), size - offset);
+        char *chunk = data.appendChunk(length);
+        for (qint64 index = 0; index < length; ++index) {
+            state = state * 1103515245u + 12345u;
+            chunk[index] = (index & 0xFF) < 200 ? char('a' + (offset + index) % 26) : char(state >> 24);
+        }
+    }
+    return data;
+}
+
+bool sameBytes(const ChunkBuffer &a, const ChunkBuffer &b)
+{
+    return a.size() == b.size() && a.read(0, a.size()) == b.read(0, b.size());
+}
+
+// Overwrites the file at filePath with bytes, starting at offset
+void patch(const QString &filePath, qint64 offset, const QByteArray &bytes)
+{
+    QFile file(filePath);
+    QVERIFY(file.open(QIODevice::ReadWrite));
+    QVERIFY(file.seek(offset));
+    QCOMPARE(file.write(bytes), qint64(bytes.size()));
+}
+}
+
+void TestCompressedFile::initTestCase()
+{
+    QVERIFY(m_dir.isValid());
+}
+
+QString TestCompressedFile::write(const ChunkBuffer &data, const QString &name)
+{
+    QString filePath = m_dir.filePath(name);
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return QString();
+
+    CompressedFile container(4);
+    OperationControl control;
+    QString error;
+    CompressedFile::Result result = container.write(file, data, control, CompressedFile::Progress(), &error);
+    if (result != CompressedFile::Result::Done) {
+        qWarning() << error;
+        return QString();
+    }
+    return filePath;
+}
+
+void TestCompressedFile::roundTrip_data()
+{
+    QTest::addColumn<qint64>("size");
+
+    QTest::newRow("empty") << qint64(0);
+    QTest::newRow("one byte") << qint64(1);
+    QTest::newRow("one block") << CompressedFile::BlockSize;
+    QTest::newRow("partial last block") << 2 * CompressedFile::BlockSize + 12345;
+    QTest::newRow("several chunks") << 2 * ChunkBuffer::DefaultChunkSize + 777;
+}
+
+void TestCompressedFile::roundTrip()
+{
+    QFETCH(qint64, size);
+
+    ChunkBuffer data = patternBuffer(size);
+    QString filePath = write(data, "roundtrip.cube");
+    QVERIFY(!filePath.isEmpty());
+    QVERIFY(CompressedFile::isContainer(filePath));
+
+    CompressedFile container(4);
+    QString error;
+    QVERIFY2(container.open(filePath, &error), qPrintable(error));
+    QCOMPARE(container.logicalSize(), size);
+    QCOMPARE(qint64(container.blockCount()), (size + CompressedFile::BlockSize - 1) / CompressedFile::BlockSize);
+
+    ChunkBuffer result;
+    OperationControl control;
+    qint64 contiguous = 0;
+    CompressedFile::Result outcome = container.read(result, control,
+                                                    [&](qint64, qint64, qint64 contiguousBytes) {
+        QVERIFY(contiguousBytes >= contiguous);
+        contiguous = contiguousBytes;
+    }, &error);
+    QVERIFY2(outcome == CompressedFile::Result::Done, qPrintable(error));
+    QVERIFY(sameBytes(result, data));
+}
+
+void TestCompressedFile::readBlock()
+{
+    ChunkBuffer data = patternBuffer(3 * CompressedFile::BlockSize + 100);
+    QString filePath = write(data, "blocks.cube");
+    QVERIFY(!filePath.isEmpty());
+
+    CompressedFile container(1);
+    QString error;
+    QVERIFY2(container.open(filePath, &error), qPrintable(error));
+
+    QFile file(filePath);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    for (int index = container.blockCount() - 1; index >= 0; --index) {
+        QByteArray block = container.readBlock(file, index, &error);
+        QVERIFY2(!block.isNull(), qPrintable(error));
+        QCOMPARE(block, data.read(index * CompressedFile::BlockSize, CompressedFile::BlockSize));
+    }
+}
+
+void TestCompressedFile::truncatedFile()
+{
+    ChunkBuffer data = patternBuffer(2 * CompressedFile::BlockSize);
+
+    // A save that stopped in the footer, in the index or among the blocks
+    for (qint64 cut : {qint64(1), qint64(20), qint64(100000)}) {
+        QString filePath = write(data, "truncated.cube");
+        QVERIFY(!filePath.isEmpty());
+        QVERIFY(QFile::resize(filePath, QFileInfo(filePath).size() - cut));
+
+        CompressedFile container(2);
+        QString error;
+        QVERIFY(!container.open(filePath, &error));
+        QVERIFY(!error.isEmpty());
+    }
+}
+
+void TestCompressedFile::damagedIndex()
+{
+    ChunkBuffer data = patternBuffer(3 * CompressedFile::BlockSize);
+    QString filePath = write(data, "index.cube");
+    QVERIFY(!filePath.isEmpty());
+
+    // The last index entry sits right before the 24-byte footer. Point its
+    // block past the index.
+    const qint64 fileSize = QFileInfo(filePath).size();
+    QByteArray entry(16, '\0');
+    QDataStream out(&entry, QIODevice::WriteOnly);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out << fileSize << qint64(1000);
+    patch(filePath, fileSize - 24 - 16, entry);
+
+    CompressedFile container(2);
+    QString error;
+    QVERIFY(!container.open(filePath, &error));
+    QVERIFY(error.contains("index"));
+}
+
+void TestCompressedFile::damagedBlock()
+{
+    ChunkBuffer data = patternBuffer(3 * CompressedFile::BlockSize);
+    QString filePath = write(data, "block.cube");
+    QVERIFY(!filePath.isEmpty());
+
+    // The index is intact, the first block behind the 32-byte header is not
+    patch(filePath, 32, QByteArray(64, '\x5A'));
+
+    CompressedFile container(2);
+    QString error;
+    QVERIFY2(container.open(filePath, &error), qPrintable(error));
+
+    ChunkBuffer result;
+    OperationControl control;
+    QVERIFY(container.read(result, control, CompressedFile::Progress(), &error) == CompressedFile::Result::Failed);
+    QVERIFY(!error.isEmpty());
+}
+
+QTEST_GUILESS_MAIN(TestCompressedFile)
+#include "tst_compressedfile.moc"
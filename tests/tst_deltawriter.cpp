@@ -0,0 +1,143 @@
+#include <QFile>
+#include <QTemporaryDir>
+#include <QtTest>
+#include "deltawriter.h"
+#include "operationcontrol.h"
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Delta saves over older versions of a file, compared byte for byte
+class TestDeltaWriter : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void write_data();
+    void write();
+    void identicalFileIsNotWritten();
+
+private:
+    QTemporaryDir m_dir;
+};
+
+namespace {
+const qint64 BlockSize = 64 * 1024;
+
+QByteArray pattern(qint64 size, quint32 seed)
+{
+    QByteArray bytes(size, Qt::Uninitialized);
+    quint32 state = seed;
+    for (qint64 index = 0; index < size; ++index) {
+        state = state * 1664525u + 1013904223u;
+        bytes[index] = char(state >> 24);
+    }
+    return bytes;
+}
+
+ChunkBuffer toBuffer(const QByteArray &bytes, qint64 chunkSize)
+{
+    ChunkBuffer data(chunkSize);
+    for (qint64 offset = 0; offset < bytes.size(); offset += chunkSize) {
+        qint64 length = qMin<qint64>(chunkSize, bytes.size() - offset);
+        memcpy(data.appendChunk(length), bytes.constData() + offset, static_cast<size_t>(length));
+    }
+    return data;
+}
+
+bool writeFile(const QString &filePath, const QByteArray &bytes)
+{
+    QFile file(filePath);
+    return file.open(QIODevice::WriteOnly | QIODevice::Truncate) && file.write(bytes) == bytes.size();
+}
+
+QByteArray readFile(const QString &filePath)
+{
+    QFile file(filePath);
+    return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+}
+}
+
+void TestDeltaWriter::initTestCase()
+{
+    if (!DeltaWriter::isSupported())
+        QSKIP("Delta saves are not supported on this platform");
+    QVERIFY(m_dir.isValid());
+}
+
+void TestDeltaWriter::write_data()
+{
+    QTest::addColumn<QByteArray>("oldContents");
+    QTest::addColumn<QByteArray>("newContents");
+
+    const qint64 size = 3 * 1024 * 1024 + 4321;    // ranges and blocks with a partial last one
+    QByteArray contents = pattern(size, 1);
+
+    QByteArray edited = contents;
+    for (qint64 offset : {qint64(0), BlockSize * 7 + 5, size - 1})
+        edited[offset] = char(edited[offset] ^ 0x55);
+
+    QTest::newRow("shorter old file") << contents.left(size / 3 + 17) << contents;
+    QTest::newRow("shorter old file, edited") << edited.left(size / 2) << contents;
+    QTest::newRow("longer old file") << contents + pattern(BlockSize * 5 + 3, 2) << contents;
+    QTest::newRow("longer old file, edited") << edited + pattern(100, 3) << contents;
+    QTest::newRow("same size, edited") << edited << contents;
+    QTest::newRow("empty old file") << QByteArray() << contents;
+    QTest::newRow("empty new file") << contents << QByteArray();
+}
+
+void TestDeltaWriter::write()
+{
+    QFETCH(QByteArray, oldContents);
+    QFETCH(QByteArray, newContents);
+
+    QString filePath = m_dir.filePath("delta.bin");
+    QVERIFY(writeFile(filePath, oldContents));
+
+    int fd = ::open(QFile::encodeName(filePath).constData(), O_RDWR | O_CLOEXEC);
+    QVERIFY(fd >= 0);
+
+    DeltaWriter writer(3, BlockSize);
+    OperationControl control;
+    QString error;
+    qint64 contiguous = 0;
+    DeltaWriter::Result result = writer.write(fd, toBuffer(newContents, 1024 * 1024), control,
+                                              [&](qint64, qint64 contiguousBytes) {
+        QVERIFY(contiguousBytes >= contiguous);
+        contiguous = contiguousBytes;
+    }, &error);
+    ::close(fd);
+
+    QVERIFY2(result == DeltaWriter::Result::Done, qPrintable(error));
+    QCOMPARE(writer.bytesWritten() + writer.bytesSkipped(), qint64(newContents.size()));
+    QVERIFY(readFile(filePath) == newContents);
+}
+
+void TestDeltaWriter::identicalFileIsNotWritten()
+{
+    QByteArray contents = pattern(2 * 1024 * 1024 + 99, 4);
+    QString filePath = m_dir.filePath("identical.bin");
+    QVERIFY(writeFile(filePath, contents));
+
+    int fd = ::open(QFile::encodeName(filePath).constData(), O_RDWR | O_CLOEXEC);
+    QVERIFY(fd >= 0);
+
+    DeltaWriter writer(2, BlockSize);
+    OperationControl control;
+    QString error;
+    DeltaWriter::Result result = writer.write(fd, toBuffer(contents, 1024 * 1024), control,
+                                              DeltaWriter::Progress(), &error);
+    ::close(fd);
+
+    QVERIFY2(result == DeltaWriter::Result::Done, qPrintable(error));
+    QCOMPARE(writer.bytesWritten(), qint64(0));
+    QCOMPARE(writer.blocksWritten(), qint64(0));
+    QCOMPARE(writer.bytesSkipped(), qint64(contents.size()));
+    QVERIFY(readFile(filePath) == contents);
+}
+
+QTEST_GUILESS_MAIN(TestDeltaWriter)
+#include "tst_deltawriter.moc"
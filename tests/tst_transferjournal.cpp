@@ -0,0 +1,159 @@
+#include <QFile>
+#include <QTemporaryDir>
+#include <QtTest>
+#include "operationcontrol.h"
+#include "transferjournal.h"
+
+// Resuming a journaled transfer that was cancelled part way through a block
+class TestTransferJournal : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+    void resumeAfterCancel();
+    void damagedBlockIsWrittenAgain();
+    void otherSourceStartsOver();
+    void changedDataStartsOver();
+
+private:
+    // Writes data[from, to) to the destination and feeds it to journal,
+    // then syncs and records it like a cancelled save does
+    void writeRange(TransferJournal &journal, qint64 from, qint64 to);
+    void cancelAt(qint64 offset);
+    TransferJournal::DataCrc dataCrc() const;
+
+    QTemporaryDir *m_dir = nullptr;
+    QString m_filePath;
+    QByteArray m_data;
+    QByteArray m_sourceId;
+};
+
+namespace {
+// Past MinFileSize, so the journal is used, and not a whole number of blocks
+const qint64 TotalBytes = 5 * TransferJournal::BlockSize + 4321;
+
+// Cancelled inside the fourth block, three blocks are complete
+const qint64 CancelOffset = 3 * TransferJournal::BlockSize + 777777;
+
+quint32 crc(const QByteArray &bytes, qint64 offset, qint64 size)
+{
+    Crc32cHasher hasher;
+    hasher.update(bytes.constData() + offset, size);
+    return hasher.value();
+}
+}
+
+void TestTransferJournal::init()
+{
+    m_dir = new QTemporaryDir;
+    QVERIFY(m_dir->isValid());
+    m_filePath = m_dir->filePath("destination.bin");
+    m_sourceId = "test source";
+
+    m_data.resize(TotalBytes);
+    quint32 state = 1;
+    for (qint64 index = 0; index < TotalBytes; ++index) {
+        state = state * 1664525u + 1013904223u;
+        m_data[index] = char(state >> 24);
+    }
+}
+
+void TestTransferJournal::cleanup()
+{
+    delete m_dir;
+    m_dir = nullptr;
+}
+
+void TestTransferJournal::writeRange(TransferJournal &journal, qint64 from, qint64 to)
+{
+    QFile file(m_filePath);
+    QVERIFY(file.open(from > 0 ? QIODevice::ReadWrite : QIODevice::WriteOnly));
+    QVERIFY(file.seek(from));
+    QCOMPARE(file.write(m_data.constData() + from, to - from), to - from);
+    QVERIFY(file.flush());
+    journal.add(m_data.constData() + from, to - from);
+    QVERIFY(journal.checkpoint(file.handle(), true));
+}
+
+void TestTransferJournal::cancelAt(qint64 offset)
+{
+    TransferJournal journal(m_filePath, TotalBytes, m_sourceId);
+    QVERIFY(journal.begin(0));
+    writeRange(journal, 0, offset);
+    QCOMPARE(journal.committedBytes(), offset / TransferJournal::BlockSize * TransferJournal::BlockSize);
+    QVERIFY(QFile::exists(TransferJournal::journalPath(m_filePath)));
+}
+
+TransferJournal::DataCrc TestTransferJournal::dataCrc() const
+{
+    QByteArray data = m_data;
+    return [data](qint64 offset, qint64 size) { return crc(data, offset, size); };
+}
+
+void TestTransferJournal::resumeAfterCancel()
+{
+    cancelAt(CancelOffset);
+
+    // The partial fourth block is on disk but not in the journal
+    TransferJournal journal(m_filePath, TotalBytes, m_sourceId);
+    OperationControl control;
+    qint64 resumeOffset = journal.resumableBytes(control, dataCrc());
+    QCOMPARE(resumeOffset, 3 * TransferJournal::BlockSize);
+
+    QVERIFY(journal.begin(resumeOffset));
+    writeRange(journal, resumeOffset, TotalBytes);
+    journal.remove();
+    QVERIFY(!QFile::exists(TransferJournal::journalPath(m_filePath)));
+
+    QFile file(m_filePath);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QCOMPARE(file.size(), TotalBytes);
+    QVERIFY(file.readAll() == m_data);
+}
+
+void TestTransferJournal::damagedBlockIsWrittenAgain()
+{
+    cancelAt(CancelOffset);
+
+    // Something changed the second block behind the journal's back
+    QFile file(m_filePath);
+    QVERIFY(file.open(QIODevice::ReadWrite));
+    QVERIFY(file.seek(TransferJournal::BlockSize + 100));
+    QCOMPARE(file.write("X", 1), qint64(1));
+    file.close();
+
+    TransferJournal journal(m_filePath, TotalBytes, m_sourceId);
+    OperationControl control;
+    QCOMPARE(journal.resumableBytes(control, dataCrc()), TransferJournal::BlockSize);
+}
+
+void TestTransferJournal::otherSourceStartsOver()
+{
+    cancelAt(CancelOffset);
+
+    OperationControl control;
+    TransferJournal otherSource(m_filePath, TotalBytes, "another source");
+    QCOMPARE(otherSource.resumableBytes(control), qint64(0));
+    TransferJournal otherSize(m_filePath, TotalBytes + 1, m_sourceId);
+    QCOMPARE(otherSize.resumableBytes(control), qint64(0));
+}
+
+void TestTransferJournal::changedDataStartsOver()
+{
+    cancelAt(CancelOffset);
+
+    // The new data differs in the first block, nothing on disk is kept
+    QByteArray changed = m_data;
+    changed[10] = char(changed[10] ^ 0xFF);
+    TransferJournal journal(m_filePath, TotalBytes, m_sourceId);
+    OperationControl control;
+    qint64 kept = journal.resumableBytes(control, [changed](qint64 offset, qint64 size) {
+        return crc(changed, offset, size);
+    });
+    QCOMPARE(kept, qint64(0));
+}
+
+QTEST_GUILESS_MAIN(TestTransferJournal)
+#include "tst_transferjournal.moc"